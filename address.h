@@ -0,0 +1,242 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Address value types used throughout the simulator. An IPv4 address is packed into a 32-bit
+integer and a MAC address into the low 48 bits of a 64-bit integer, so addresses can be
+copied, compared and hashed as plain integers. Parsing and formatting are constexpr and
+do not allocate; addresses only become strings when they are printed.
+*/
+#ifndef ADDRESS_H
+#define ADDRESS_H
+
+#include <iostream>
+#include <string>
+#include <functional>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+IPv4 address stored in host byte order (192.168.1.2 is 0xC0A80102). The all-zero address
+is used to mean "no address".
+*/
+class IPv4Addr
+{
+	public:
+		// Longest dotted-quad text ("255.255.255.255")
+		static constexpr size_t maxLength = 15;
+
+		// Constructors
+		constexpr IPv4Addr() : value(0) {}
+		constexpr explicit IPv4Addr(uint32_t v) : value(v) {}
+		constexpr IPv4Addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+			: value(((uint32_t) a << 24) | ((uint32_t) b << 16) | ((uint32_t) c << 8) | d) {}
+
+		// Member Functions
+		constexpr uint32_t toUint() const { return value; }
+		constexpr bool isSet() const { return value != 0; }
+		constexpr uint8_t octet(int i) const { return (uint8_t) (value >> (24 - 8 * i)); }
+
+		// Parses dotted-quad text. Returns false (and leaves out untouched) if the text is
+		// not exactly four decimal octets in the range 0-255.
+		static constexpr bool parse(const char* text, size_t length, IPv4Addr &out)
+		{
+			uint32_t result = 0;
+			uint32_t octetValue = 0;
+			int digits = 0;
+			int dots = 0;
+			for(size_t i = 0; i < length; i++)
+			{
+				char c = text[i];
+				if(c >= '0' && c <= '9')
+				{
+					octetValue = octetValue * 10 + (uint32_t) (c - '0');
+					if(++digits > 3 || octetValue > 255) return false;
+				}
+				else if(c == '.' && digits > 0 && dots < 3)
+				{
+					result = (result << 8) | octetValue;
+					octetValue = 0;
+					digits = 0;
+					dots++;
+				}
+				else return false;
+			}
+			if(dots != 3 || digits == 0) return false;
+			out = IPv4Addr((result << 8) | octetValue);
+			return true;
+		}
+
+		static IPv4Addr parse(const string &text)
+		{
+			IPv4Addr address;
+			parse(text.data(), text.length(), address);
+			return address;
+		}
+
+		// Writes dotted-quad text into out (at least maxLength chars, not terminated) and
+		// returns the number of characters written
+		constexpr size_t format(char* out) const
+		{
+			size_t length = 0;
+			for(int i = 0; i < 4; i++)
+			{
+				uint8_t o = octet(i);
+				if(i > 0) out[length++] = '.';
+				if(o >= 100) out[length++] = (char) ('0' + o / 100);
+				if(o >= 10) out[length++] = (char) ('0' + (o / 10) % 10);
+				out[length++] = (char) ('0' + o % 10);
+			}
+			return length;
+		}
+
+		constexpr size_t length() const
+		{
+			size_t length = 3;
+			for(int i = 0; i < 4; i++) length += octet(i) >= 100 ? 3 : (octet(i) >= 10 ? 2 : 1);
+			return length;
+		}
+
+		string toString() const
+		{
+			char buffer[maxLength];
+			return string(buffer, format(buffer));
+		}
+
+		// Operators
+		constexpr bool operator==(const IPv4Addr &other) const { return value == other.value; }
+		constexpr bool operator!=(const IPv4Addr &other) const { return value != other.value; }
+		constexpr bool operator<(const IPv4Addr &other) const { return value < other.value; }
+
+	private:
+		// Data Members
+		uint32_t value;  // Address in host byte order
+};
+
+/*
+48-bit MAC address stored in the low bits of a 64-bit integer. Printed in the simulator's
+"xx-xx-xx-xx-xx-xx" lowercase format.
+*/
+class MacAddr
+{
+	public:
+		// Length of "xx-xx-xx-xx-xx-xx"
+		static constexpr size_t maxLength = 17;
+
+		// Constructors
+		constexpr MacAddr() : value(0) {}
+		constexpr explicit MacAddr(uint64_t v) : value(v & 0xFFFFFFFFFFFFull) {}
+
+		// Member Functions
+		constexpr uint64_t toUint() const { return value; }
+		constexpr bool isSet() const { return value != 0; }
+		constexpr uint8_t octet(int i) const { return (uint8_t) (value >> (40 - 8 * i)); }
+
+		// Parses six hex octets separated by '-' or ':'
+		static constexpr bool parse(const char* text, size_t length, MacAddr &out)
+		{
+			if(length != maxLength) return false;
+			uint64_t result = 0;
+			for(size_t i = 0; i < length; i++)
+			{
+				char c = text[i];
+				if(i % 3 == 2)
+				{
+					if(c != '-' && c != ':') return false;
+					continue;
+				}
+				uint64_t nibble = 0;
+				if(c >= '0' && c <= '9') nibble = (uint64_t) (c - '0');
+				else if(c >= 'a' && c <= 'f') nibble = (uint64_t) (c - 'a' + 10);
+				else if(c >= 'A' && c <= 'F') nibble = (uint64_t) (c - 'A' + 10);
+				else return false;
+				result = (result << 4) | nibble;
+			}
+			out = MacAddr(result);
+			return true;
+		}
+
+		static MacAddr parse(const string &text)
+		{
+			MacAddr address;
+			parse(text.data(), text.length(), address);
+			return address;
+		}
+
+		// Writes "xx-xx-xx-xx-xx-xx" into out (at least maxLength chars, not terminated)
+		constexpr size_t format(char* out) const
+		{
+			const char* hex = "0123456789abcdef";
+			size_t length = 0;
+			for(int i = 0; i < 6; i++)
+			{
+				if(i > 0) out[length++] = '-';
+				out[length++] = hex[octet(i) >> 4];
+				out[length++] = hex[octet(i) & 0xF];
+			}
+			return length;
+		}
+
+		string toString() const
+		{
+			char buffer[maxLength];
+			return string(buffer, format(buffer));
+		}
+
+		// Operators
+		constexpr bool operator==(const MacAddr &other) const { return value == other.value; }
+		constexpr bool operator!=(const MacAddr &other) const { return value != other.value; }
+		constexpr bool operator<(const MacAddr &other) const { return value < other.value; }
+
+	private:
+		// Data Members
+		uint64_t value;  // Address in the low 48 bits
+};
+
+static_assert(is_trivially_copyable<IPv4Addr>::value && sizeof(IPv4Addr) == 4, "IPv4Addr must stay a packed value type");
+static_assert(is_trivially_copyable<MacAddr>::value && sizeof(MacAddr) == 8, "MacAddr must stay a packed value type");
+
+// Print edges
+inline ostream& operator<<(ostream &out, const IPv4Addr &address)
+{
+	char buffer[IPv4Addr::maxLength];
+	return out.write(buffer, (streamsize) address.format(buffer));
+}
+
+inline ostream& operator<<(ostream &out, const MacAddr &address)
+{
+	char buffer[MacAddr::maxLength];
+	return out.write(buffer, (streamsize) address.format(buffer));
+}
+
+// Integer mixing used by the simulator's hash tables (murmur3 finalizer)
+inline size_t hashAddress(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ull;
+	key ^= key >> 33;
+	return (size_t) key;
+}
+
+namespace std
+{
+	template <> struct hash<IPv4Addr>
+	{
+		size_t operator()(const IPv4Addr &address) const { return hashAddress(address.toUint()); }
+	};
+
+	template <> struct hash<MacAddr>
+	{
+		size_t operator()(const MacAddr &address) const { return hashAddress(address.toUint()); }
+	};
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Compact open-addressing hash index from an address (IPv4 or MAC, packed into a non-zero
+64-bit key) to a 32-bit handle. Used to find entities and table rows by address in constant
+time. Each slot is 16 bytes and key 0 marks an empty slot, so the index needs no per-entry
+allocation. Deletion uses backward shifting, so there are no tombstones.
+*/
+#ifndef ADDRESS_INDEX_H
+#define ADDRESS_INDEX_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+
+using namespace std;
+
+class addressIndex
+{
+	public:
+		// Returned by find when the key is not in the index
+		static const uint32_t NONE = 0xFFFFFFFF;
+
+		// Constructor
+		addressIndex(size_t expected = 16) : count(0) { allocate(capacityFor(expected)); }
+
+		// Member Functions
+		size_t size() const { return count; }
+		size_t memoryUsage() const { return slots.capacity() * sizeof(slot); }
+
+		void reserve(size_t expected)
+		{
+			size_t wanted = capacityFor(expected);
+			if(wanted > slots.size()) rehash(wanted);
+		}
+
+		// Maps key to value, replacing any previous value. key must not be 0.
+		void insert(uint64_t key, uint32_t value)
+		{
+			if((count + 1) * 10 > slots.size() * 7) rehash(slots.size() * 2);
+			size_t i = hashAddress(key) & mask;
+			while(slots[i].key != 0)
+			{
+				if(slots[i].key == key)
+				{
+					slots[i].value = value;
+					return;
+				}
+				i = (i + 1) & mask;
+			}
+			slots[i].key = key;
+			slots[i].value = value;
+			count++;
+		}
+
+		// Returns the value stored for key, or NONE
+		uint32_t find(uint64_t key) const
+		{
+			size_t i = hashAddress(key) & mask;
+			while(slots[i].key != 0)
+			{
+				if(slots[i].key == key) return slots[i].value;
+				i = (i + 1) & mask;
+			}
+			return NONE;
+		}
+
+		bool contains(uint64_t key) const { return find(key) != NONE; }
+
+		// Removes key. Returns false if it was not in the index.
+		bool erase(uint64_t key)
+		{
+			size_t hole = hashAddress(key) & mask;
+			while(slots[hole].key != key)
+			{
+				if(slots[hole].key == 0) return false;
+				hole = (hole + 1) & mask;
+			}
+
+			// Backward-shift later entries of the probe run into the hole
+			size_t i = hole;
+			while(true)
+			{
+				i = (i + 1) & mask;
+				if(slots[i].key == 0) break;
+				size_t home = hashAddress(slots[i].key) & mask;
+				if(((i - home) & mask) >= ((i - hole) & mask))
+				{
+					slots[hole] = slots[i];
+					hole = i;
+				}
+			}
+			slots[hole] = slot();
+			count--;
+			return true;
+		}
+
+		// Snapshot support: the slot array is saved and restored as one block
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.array(slots);
+			out.value(count);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.array(slots) || !in.value(count)) return false;
+			if(slots.size() < 16 || (slots.size() & (slots.size() - 1)) != 0 || count >= slots.size())
+				return in.fail("address index is inconsistent");
+			mask = slots.size() - 1;
+			return true;
+		}
+
+	private:
+		// Index slot
+		struct slot
+		{
+			slot() : key(0), value(0) {}
+
+			uint64_t key;    // Packed address (0 if empty)
+			uint32_t value;  // Handle stored for the address
+		};
+
+		// Member Functions
+		static size_t capacityFor(size_t expected)
+		{
+			size_t cap = 16;
+			while(cap * 7 < expected * 10) cap *= 2;
+			return cap;
+		}
+
+		void allocate(size_t cap)
+		{
+			slots.assign(cap, slot());
+			mask = cap - 1;
+		}
+
+		void rehash(size_t cap)
+		{
+			vector<slot> old;
+			old.swap(slots);
+			allocate(cap);
+			for(size_t i = 0; i < old.size(); i++)
+			{
+				if(old[i].key == 0) continue;
+				size_t j = hashAddress(old[i].key) & mask;
+				while(slots[j].key != 0) j = (j + 1) & mask;
+				slots[j] = old[i];
+			}
+		}
+
+		// Data Members
+		vector<slot> slots;  // Open-addressing slot array (power of two)
+		size_t mask;         // slots.size() - 1
+		size_t count;        // Keys in the index
+};
+
+#endif
@@ -0,0 +1,52 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Counts every heap allocation made by the program by replacing the global operator new. The
+benchmarks read the counter before and after an operation to report allocations per
+operation. The replacement operators must be defined in exactly one translation unit, so this
+header is only included by main.cpp.
+*/
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <stdint.h>
+
+using namespace std;
+
+// Heap allocations made so far
+inline atomic<uint64_t> heapAllocations(0);
+
+void* operator new(size_t size)
+{
+	heapAllocations.fetch_add(1, memory_order_relaxed);
+	void* memory = malloc(size != 0 ? size : 1);
+	if(memory == NULL) throw bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+	heapAllocations.fetch_add(1, memory_order_relaxed);
+	return malloc(size != 0 ? size : 1);
+}
+
+// Kept out of line: when GCC inlines a replacement delete it pairs the free() with operator new
+// at the call site and reports a false -Wmismatched-new-delete
+#ifdef __GNUC__
+#define ALLOCATION_COUNTER_NOINLINE __attribute__((noinline))
+#else
+#define ALLOCATION_COUNTER_NOINLINE
+#endif
+
+ALLOCATION_COUNTER_NOINLINE void operator delete(void* memory) noexcept { free(memory); }
+ALLOCATION_COUNTER_NOINLINE void operator delete(void* memory, size_t) noexcept { free(memory); }
+ALLOCATION_COUNTER_NOINLINE void operator delete(void* memory, const nothrow_t&) noexcept { free(memory); }
+
+#endif
@@ -0,0 +1,808 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Microbenchmarks for the simulator's data structures and message encoding. Run the simulator with
+"--benchmark" to execute them, optionally followed by the population sizes to test
+(default 10000, 1000000 and 10000000 entries).
+
+Protocol path benchmarks (discovery, registration, routing and the agents' tables) are
+recorded in a benchReport as well as printed. Each result gives ns/op, heap allocations/op
+and operations/second, and the report can be written as JSON ("--json FILE") so runs of two
+versions can be compared.
+
+Benchmarks also check their results (benchCheck). A failed check is marked in the output and
+makes "--benchmark" exit with a non-zero status.
+*/
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <list>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "bindingTable.h"
+#include "concurrentBindingTable.h"
+#include "visitorTable.h"
+#include "timerWheel.h"
+#include "mobilityModel.h"
+#include "coverageIndex.h"
+#include "wireFormat.h"
+#include "packetBuffer.h"
+#include "allocationCounter.h"
+#include "metrics.h"
+
+using namespace std;
+
+// Stopwatch used to time each benchmark
+class benchTimer
+{
+	public:
+		// Constructor
+		benchTimer() : start(chrono::steady_clock::now()) {}
+
+		// Member Functions
+		double elapsedNs()
+		{
+			return (double) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+		}
+
+	private:
+		// Data Members
+		chrono::steady_clock::time_point start;  // Time the timer was created
+};
+
+// Checks failed so far in this run
+inline int& benchFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+// Prints note after the result being checked and counts a failure unless ok. Returns ok.
+inline bool benchCheck(bool ok, const char* note = " (CHECK FAILED)")
+{
+	if(ok) return true;
+	cout << note;
+	benchFailures()++;
+	return false;
+}
+
+// One measured operation at one population size
+struct benchResult
+{
+	string name;          // Operation measured
+	size_t population;    // Mobile nodes (or table entries) present; 0 if it does not apply
+	uint64_t operations;  // Operations timed
+	double nsPerOp;       // Wall time per operation
+	double allocsPerOp;   // Heap allocations per operation
+	double opsPerSecond;  // Throughput
+};
+
+// Results of a benchmark run, printed as a table and written as JSON
+class benchReport
+{
+	public:
+		// Member Functions
+		void add(const benchResult &result)
+		{
+			results.push_back(result);
+			cout << "| " << result.name;
+			for(size_t pad = result.name.length(); pad < 29; pad++) cout << " ";
+			cout << " | " << result.population;
+			for(size_t pad = to_string(result.population).length(); pad < 10; pad++) cout << " ";
+			cout << " | " << result.nsPerOp << " | " << result.allocsPerOp << " | " << result.opsPerSecond << " |" << endl;
+		}
+
+		// Writes {"schema": 1, "compiler": ..., "results": [{...}, ...]} with one object per result
+		void writeJSON(ostream &out) const
+		{
+			out << fixed;
+			out.precision(3);
+			out << "{\n  \"schema\": 1,\n  \"compiler\": \"" << compilerName() << "\",\n  \"results\": [";
+			for(size_t i = 0; i < results.size(); i++)
+			{
+				const benchResult &r = results[i];
+				out << (i == 0 ? "\n" : ",\n");
+				out << "    {\"name\": \"" << r.name << "\", \"population\": " << r.population << ", \"operations\": " << r.operations;
+				out << ", \"ns_per_op\": " << r.nsPerOp << ", \"allocs_per_op\": " << r.allocsPerOp << ", \"ops_per_second\": " << r.opsPerSecond << "}";
+			}
+			out << "\n  ]\n}\n";
+		}
+
+		const vector<benchResult>& all() const { return results; }
+
+	private:
+		// Member Functions
+		static const char* compilerName()
+		{
+#if defined(__clang__)
+			return "clang " __clang_version__;
+#elif defined(__GNUC__)
+			return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+			return "msvc";
+#else
+			return "unknown";
+#endif
+		}
+
+		// Data Members
+		vector<benchResult> results;  // In the order they were measured
+};
+
+/*
+Times operations calls of op(i) after a short warm-up and counts the heap allocations they
+make. op receives the call number, so it can pick a different mobile node on each call.
+*/
+template <class Operation>
+benchResult measureOperation(const char* name, size_t population, uint64_t operations, Operation op)
+{
+	uint64_t warmup = operations / 10 < 1000 ? operations / 10 : 1000;
+	for(uint64_t i = 0; i < warmup; i++) op(i);
+
+	uint64_t allocationsBefore = heapAllocations.load();
+	benchTimer timer;
+	for(uint64_t i = 0; i < operations; i++) op(i);
+	double ns = timer.elapsedNs();
+
+	benchResult result;
+	result.name = name;
+	result.population = population;
+	result.operations = operations;
+	result.nsPerOp = ns / operations;
+	result.allocsPerOp = (double) (heapAllocations.load() - allocationsBefore) / operations;
+	result.opsPerSecond = ns > 0 ? operations * 1e9 / ns : 0;
+	return result;
+}
+
+// Small xorshift generator so the benchmark loop does not measure rand()
+inline uint32_t benchRandom(uint32_t &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Unique home address for index i (10.0.0.0/8 holds 16M addresses)
+inline IPv4Addr benchAddress(uint32_t i) { return IPv4Addr(0x0A000000u | (i & 0xFFFFFF)); }
+
+/*
+Measures Mobility Binding Table insert, re-registration (update in place), lookup hit,
+lookup miss and deregistration cost for a table holding n bindings
+*/
+inline void benchmarkBindingTable(size_t n)
+{
+	const size_t lookups = 1000000;
+	uint32_t state = 2463534242u;
+	vector<IPv4Addr> homes;
+	homes.reserve(n);
+	for(size_t i = 0; i < n; i++) homes.push_back(benchAddress((uint32_t) i));
+	IPv4Addr coa(192, 168, 1, 1);
+
+	mobilityBindingTable table;
+
+	// Insert n new bindings (includes rehashing as the table grows)
+	benchTimer insertTimer;
+	for(size_t i = 0; i < n; i++) table.insert(homes[i], coa, 1800);
+	double insertNs = insertTimer.elapsedNs() / n;
+
+	// Re-register random mobile nodes (update in place)
+	benchTimer updateTimer;
+	for(size_t i = 0; i < lookups; i++) table.insert(homes[benchRandom(state) % n], coa, 900);
+	double updateNs = updateTimer.elapsedNs() / lookups;
+
+	// Look up random bound mobile nodes
+	size_t found = 0;
+	benchTimer hitTimer;
+	for(size_t i = 0; i < lookups; i++) found += table.find(homes[benchRandom(state) % n]) != NULL;
+	double hitNs = hitTimer.elapsedNs() / lookups;
+
+	// Look up addresses that are not bound
+	benchTimer missTimer;
+	for(size_t i = 0; i < lookups; i++) found += table.find(IPv4Addr(0xAC100000u | benchRandom(state) % 0xFFFFF)) != NULL;
+	double missNs = missTimer.elapsedNs() / lookups;
+
+	// Deregister every mobile node
+	benchTimer eraseTimer;
+	for(size_t i = 0; i < n; i++) table.erase(homes[i]);
+	double eraseNs = eraseTimer.elapsedNs() / n;
+
+	cout << "| " << n;
+	for(size_t pad = to_string(n).length(); pad < 10; pad++) cout << " ";
+	cout << " | " << insertNs << " | " << updateNs << " | " << hitNs << " | " << missNs << " | " << eraseNs << " |";
+	benchCheck(found == lookups && table.empty());
+	cout << endl;
+}
+
+/*
+Stress test of the concurrent binding table with about n bindings. A quarter of the mobile
+nodes stay bound throughout; each thread owns a share of the rest and, for every 15 lookups,
+re-registers one of the permanent ones (alternating between two care-of-addresses) and
+either registers or deregisters one of its own. The table starts small, so its shards grow
+while other threads probe them, and deregistrations shift probe chains under them. Prints
+lookups and updates per second over all threads, and checks that every lookup of a
+permanent binding found it whole, that no lookup found a torn binding, and that the table
+ends with the bindings the threads left.
+*/
+inline void benchmarkConcurrentBindingTable(size_t n)
+{
+	const double seconds = 0.2;
+	const unsigned threadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+	if(n == 0) return;
+	size_t permanent = n / 4 > 0 ? n / 4 : 1;
+	vector<IPv4Addr> homes;
+	homes.reserve(n + 64);
+	for(size_t i = 0; i < n + 64; i++) homes.push_back(benchAddress((uint32_t) i));
+	IPv4Addr coa[2] = { IPv4Addr(192, 168, 1, 1), IPv4Addr(192, 168, 2, 1) };
+
+	for(size_t c = 0; c < sizeof(threadCounts) / sizeof(threadCounts[0]); c++)
+	{
+		unsigned threads = threadCounts[c];
+		size_t owned = n > permanent + threads ? (n - permanent) / threads : 1;
+		concurrentBindingTable table(16);
+		for(size_t i = 0; i < permanent; i++) table.insert(homes[i], coa[0]);
+
+		atomic<bool> go(false), stop(false);
+		vector<uint64_t> lookups(threads), updates(threads), bad(threads), bound(threads);
+		vector<thread> workers;
+		for(unsigned w = 0; w < threads; w++)
+		{
+			workers.push_back(thread([&, w]()
+			{
+				uint32_t state = 2463534242u + 7919 * w;
+				uint64_t looked = 0, updated = 0, wrong = 0, held = 0;
+				vector<char> present(owned, 0);
+				while(!go.load(memory_order_acquire)) this_thread::yield();
+				while(!stop.load(memory_order_relaxed))
+				{
+					table.insert(homes[benchRandom(state) % permanent], coa[updated & 1]);
+					size_t k = benchRandom(state) % owned;
+					IPv4Addr home = homes[permanent + w + k * threads];
+					if(present[k])
+					{
+						if(!table.erase(home)) wrong++;
+						held--;
+					}
+					else
+					{
+						table.insert(home, coa[updated & 1]);
+						held++;
+					}
+					present[k] = !present[k];
+					updated += 2;
+					for(int j = 0; j < 15; j++)
+					{
+						IPv4Addr found;
+						if(j & 1)
+						{
+							// Another thread's binding may come and go, but is never torn
+							size_t other = permanent + benchRandom(state) % (owned * threads);
+							if(table.lookup(homes[other], found) && found != coa[0] && found != coa[1]) wrong++;
+						}
+						else if(!table.lookup(homes[benchRandom(state) % permanent], found) || (found != coa[0] && found != coa[1])) wrong++;
+					}
+					looked += 15;
+				}
+				lookups[w] = looked;
+				updates[w] = updated;
+				bad[w] = wrong;
+				bound[w] = held;
+			}));
+		}
+		benchTimer timer;
+		go.store(true, memory_order_release);
+		this_thread::sleep_for(chrono::duration<double>(seconds));
+		stop.store(true);
+		for(unsigned w = 0; w < threads; w++) workers[w].join();
+		double elapsed = timer.elapsedNs() / 1e9;
+
+		uint64_t looked = 0, updated = 0, wrong = 0, held = permanent;
+		for(unsigned w = 0; w < threads; w++)
+		{
+			looked += lookups[w];
+			updated += updates[w];
+			wrong += bad[w];
+			held += bound[w];
+		}
+		cout << "| " << threads;
+		for(size_t pad = to_string(threads).length(); pad < 7; pad++) cout << " ";
+		cout << " | " << n;
+		for(size_t pad = to_string(n).length(); pad < 10; pad++) cout << " ";
+		cout << " | " << looked / elapsed / 1e6 << " | " << updated / elapsed / 1e6 << " |";
+		benchCheck(wrong == 0 && table.size() == held);
+		cout << endl;
+	}
+}
+
+// Bytes currently allocated from the heap (0 where the C library cannot report it). glibc
+// before 2.33 only has mallinfo, whose int fields (read as unsigned) stop at 4 GB.
+inline size_t heapBytesInUse()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+	struct mallinfo info = mallinfo();
+	return (size_t) (unsigned int) info.uordblks + (size_t) (unsigned int) info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+/*
+Measures the foreign agent's Visitor List with n visitors: insert, re-registration (update in
+place), lookup by home address and by MAC address, and removal. Also reports the heap bytes
+per visitor of the visitor table and of the linked list of entries it replaced.
+*/
+inline void benchmarkVisitorList(size_t n)
+{
+	const size_t lookups = 1000000;
+	uint32_t state = 521288629u;
+	IPv4Addr HA(192, 168, 1, 1);
+
+	// Bytes per visitor held by the old list (one heap node per entry)
+	double listBytes;
+	{
+		size_t before = heapBytesInUse();
+		list<visitorEntry> old;
+		for(size_t i = 0; i < n; i++) old.push_front(visitorEntry(benchAddress((uint32_t) i), HA, MacAddr(0x020000000000ull | i), 1800));
+		listBytes = (double) (heapBytesInUse() - before) / n;
+	}
+
+	// Add n new visitors (includes building the indexes and growing them)
+	size_t before = heapBytesInUse();
+	visitorTable table;
+	benchTimer insertTimer;
+	for(size_t i = 0; i < n; i++) table.insert(benchAddress((uint32_t) i), HA, MacAddr(0x020000000000ull | i), 1800);
+	double insertNs = insertTimer.elapsedNs() / n;
+	double tableBytes = (double) (heapBytesInUse() - before) / n;
+
+	// Re-register random visitors (update in place)
+	benchTimer updateTimer;
+	for(size_t i = 0; i < lookups; i++)
+	{
+		uint32_t v = benchRandom(state) % n;
+		table.insert(benchAddress(v), HA, MacAddr(0x020000000000ull | v), 900);
+	}
+	double updateNs = updateTimer.elapsedNs() / lookups;
+
+	// Find random visitors by home address and by MAC address
+	size_t found = 0;
+	benchTimer homeTimer;
+	for(size_t i = 0; i < lookups; i++) found += table.find(benchAddress(benchRandom(state) % n)) != NULL;
+	double homeNs = homeTimer.elapsedNs() / lookups;
+
+	benchTimer macTimer;
+	for(size_t i = 0; i < lookups; i++) found += table.findByMAC(MacAddr(0x020000000000ull | benchRandom(state) % n)) != NULL;
+	double macNs = macTimer.elapsedNs() / lookups;
+
+	// Expire every visitor
+	benchTimer eraseTimer;
+	for(size_t i = 0; i < n; i++) table.erase(benchAddress((uint32_t) i));
+	double eraseNs = eraseTimer.elapsedNs() / n;
+
+	cout << "| " << n;
+	for(size_t pad = to_string(n).length(); pad < 10; pad++) cout << " ";
+	cout << " | " << insertNs << " | " << updateNs << " | " << homeNs << " | " << macNs << " | " << eraseNs;
+	cout << " | " << listBytes << " | " << tableBytes << " |";
+	benchCheck(found == 2 * lookups && table.empty());
+	cout << endl;
+}
+
+/*
+Measures lifetime timer cost with n live registrations: scheduling, re-registration (cancel
+and reschedule) and expiry of every timer as the clock runs past the longest lifetime
+*/
+inline void benchmarkTimerWheel(size_t n)
+{
+	uint32_t state = 88675123u;
+	vector<timerId> ids(n);
+	timerWheel wheel;
+
+	// Schedule n registration lifetimes between 1 and 65535 seconds
+	benchTimer scheduleTimer;
+	for(size_t i = 0; i < n; i++)
+		ids[i] = wheel.schedule(1 + benchRandom(state) % 65535, timerEvent(0, i));
+	double scheduleNs = scheduleTimer.elapsedNs() / n;
+
+	// Re-register every mobile node once
+	benchTimer rescheduleTimer;
+	for(size_t i = 0; i < n; i++)
+	{
+		wheel.cancel(ids[i]);
+		ids[i] = wheel.schedule(1 + benchRandom(state) % 65535, timerEvent(0, i));
+	}
+	double rescheduleNs = rescheduleTimer.elapsedNs() / n;
+
+	// Run the clock past every lifetime one second at a time
+	size_t expired = 0;
+	benchTimer expireTimer;
+	for(uint64_t t = 1; t <= 65536; t++) wheel.advance(t, [&expired](timerId, const timerEvent&) { expired++; });
+	double expireNs = expireTimer.elapsedNs() / n;
+
+	cout << "| " << n;
+	for(size_t pad = to_string(n).length(); pad < 10; pad++) cout << " ";
+	cout << " | " << scheduleNs << " | " << rescheduleNs << " | " << expireNs << " |";
+	benchCheck(expired == n && wheel.size() == 0);
+	cout << endl;
+}
+
+/*
+Measures the mobility models' step cost per node position update for n mobile nodes moving
+over 1000 foreign agents' coverage, one second per step
+*/
+inline void benchmarkMobility(size_t n)
+{
+	if(n == 0 || n > 0xFFFFFF) return;
+	const mobilityPattern patterns[3] = { RANDOM_WAYPOINT, MANHATTAN_GRID, COMMUTER };
+	size_t steps = 20000000 / n + 1;
+	randomService::local().seed(1);
+
+	cout << "| " << n;
+	for(size_t pad = to_string(n).length(); pad < 10; pad++) cout << " ";
+	bool ok = true;
+	for(int p = 0; p < 3; p++)
+	{
+		mobilitySettings settings;
+		settings.pattern = patterns[p];
+		settings.dwell = 600;
+		mobilityEngine engine;
+		engine.configure(settings, 1000);
+		for(size_t i = 0; i < n; i++) engine.add();
+
+		benchTimer stepTimer;
+		for(size_t s = 0; s < steps; s++) engine.step(1.0f);
+		double stepNs = stepTimer.elapsedNs() / (steps * n);
+
+		for(size_t i = 0; i < n; i += 997)
+		{
+			float px = engine.positionX((uint32_t) i), py = engine.positionY((uint32_t) i);
+			if(px < -1 || py < -1 || px > settings.width + 1 || py > settings.height + 1 || engine.agentOf((uint32_t) i) >= 1000) ok = false;
+		}
+		cout << " | " << stepNs << " (" << engine.stats().crossings * 3600.0 / steps / n << ")";
+	}
+	cout << " |";
+	benchCheck(ok);
+	cout << endl;
+}
+
+/*
+Measures finding the strongest agent in range of n random positions among agents foreign
+agents spread over the area: one position at a time through the coverage index, all of them
+in one batch query, and for comparison a scan over every agent (timed on up to 10000
+positions)
+*/
+inline void benchmarkCoverageIndex(size_t n, size_t agents)
+{
+	if(n == 0 || n > 0xFFFFFF) return;
+	const float side = 50000;
+	uint32_t state = 521288629u;
+	size_t perSide = 1;
+	while(perSide * perSide < agents) perSide++;
+	float spacing = side / perSide, range = 0.9f * spacing;
+	coverageIndex index;
+	index.configure(side, side, range);
+	for(size_t a = 0; a < agents; a++)
+		index.add(((a % perSide) + 0.25f + (benchRandom(state) % 1000) / 2000.0f) * spacing,
+		          ((a / perSide) + 0.25f + (benchRandom(state) % 1000) / 2000.0f) * spacing, range);
+	index.build();
+
+	vector<float> x(n), y(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		x[i] = (benchRandom(state) % 1000000) * side / 1000000;
+		y[i] = (benchRandom(state) % 1000000) * side / 1000000;
+	}
+	vector<uint32_t> single(n), batch(n);
+
+	benchTimer singleTimer;
+	for(size_t i = 0; i < n; i++) single[i] = index.best(x[i], y[i]);
+	double singleNs = singleTimer.elapsedNs() / n;
+
+	benchTimer batchTimer;
+	index.locate(x.data(), y.data(), n, batch.data());
+	double batchNs = batchTimer.elapsedNs() / n;
+
+	// Every agent, keeping the strongest in range (the same rule as the index)
+	size_t scanned = n < 10000 ? n : 10000, mismatches = 0;
+	benchTimer scanTimer;
+	for(size_t i = 0; i < scanned; i++)
+	{
+		uint32_t found = coverageIndex::NONE;
+		float strongest = 1.0f;
+		for(uint32_t a = 0; a < agents; a++)
+		{
+			float dx = x[i] - index.positionX(a), dy = y[i] - index.positionY(a);
+			float relative = (dx * dx + dy * dy) / (range * range);
+			if(relative <= strongest)
+			{
+				strongest = relative;
+				found = a;
+			}
+		}
+		mismatches += found != single[i];
+	}
+	double scanNs = scanTimer.elapsedNs() / scanned;
+	for(size_t i = 0; i < n; i++) mismatches += single[i] != batch[i];
+
+	cout << "| " << n;
+	for(size_t pad = to_string(n).length(); pad < 10; pad++) cout << " ";
+	cout << " | " << agents << " | " << index.meanCellAgents() << " | " << singleNs << " | " << batchNs << " | " << scanNs << " |";
+	benchCheck(mismatches == 0);
+	cout << endl;
+}
+
+/*
+Measures encode and decode rate of one message type. encode(out, capacity, i) writes message i
+and decode(data, length, i) checks that a buffer holds message i. Messages rotate through a
+set of buffer slots so decoding reads what was really encoded.
+*/
+template <class Encode, class Decode>
+void benchmarkMessage(const char* name, Encode encode, Decode decode)
+{
+	const size_t slots = 1024;
+	const size_t slotSize = 64;
+	const size_t messages = 2048 * slots;
+	static uint8_t buffer[slots * slotSize];
+
+	size_t bytes = 0;
+	benchTimer encodeTimer;
+	for(size_t i = 0; i < messages; i++) bytes += encode(&buffer[(i % slots) * slotSize], slotSize, (uint32_t) i);
+	double encodeSeconds = encodeTimer.elapsedNs() / 1e9;
+	size_t size = bytes / messages;
+
+	// Slot j now holds message messages - slots + j
+	size_t good = 0;
+	benchTimer decodeTimer;
+	for(size_t i = 0; i < messages; i++)
+		good += decode(&buffer[(i % slots) * slotSize], size, (uint32_t) (messages - slots + i % slots));
+	double decodeSeconds = decodeTimer.elapsedNs() / 1e9;
+
+	cout << "| " << name;
+	for(size_t pad = string(name).length(); pad < 22; pad++) cout << " ";
+	cout << " | " << size << " | " << messages / encodeSeconds / 1e6 << " | " << messages / decodeSeconds / 1e6 << " |";
+	benchCheck(good == messages);
+	cout << endl;
+}
+
+/*
+Measures encoding and zero-copy decoding of every Mobile IP message in its wire format
+*/
+inline void benchmarkWireFormat()
+{
+	IPv4Addr agent(192, 168, 1, 1);
+	IPv4Addr homeAgent(10, 0, 0, 1);
+	IPv4Addr correspondent(172, 16, 0, 1);
+
+	benchmarkMessage("Agent solicitation",
+		[](uint8_t* out, size_t capacity, uint32_t) { return encodeSolicitation(out, capacity); },
+		[](const uint8_t* data, size_t length, uint32_t) { return isSolicitation(data, length); });
+
+	benchmarkMessage("Agent advertisement",
+		[agent](uint8_t* out, size_t capacity, uint32_t i)
+		{
+			advertisementFields fields;
+			fields.agent = agent;
+			fields.sequence = (uint16_t) i;
+			fields.flags = ADVERTISE_REGISTRATION_REQUIRED | ADVERTISE_FOREIGN_AGENT;
+			return encodeAdvertisement(out, capacity, fields, &agent, &agent + 1);
+		},
+		[agent](const uint8_t* data, size_t length, uint32_t i)
+		{
+			advertisementView view;
+			return view.parse(data, length) && view.sequence() == (uint16_t) i && view.coaCount() == 1 && view.coa(0) == agent;
+		});
+
+	benchmarkMessage("Registration request",
+		[agent, homeAgent](uint8_t* out, size_t capacity, uint32_t i)
+		{
+			return encodeRegistrationRequest(out, capacity, 0, 1800, benchAddress(i), homeAgent, agent, i);
+		},
+		[agent](const uint8_t* data, size_t length, uint32_t i)
+		{
+			registrationView view;
+			return view.parse(data, length) && view.isRequest() && view.identification() == i &&
+			       view.homeAddress() == benchAddress(i) && view.careOfAddress() == agent;
+		});
+
+	benchmarkMessage("Registration reply",
+		[homeAgent](uint8_t* out, size_t capacity, uint32_t i)
+		{
+			return encodeRegistrationReply(out, capacity, REGISTRATION_ACCEPTED, 1800, benchAddress(i), homeAgent, i);
+		},
+		[](const uint8_t* data, size_t length, uint32_t i)
+		{
+			registrationView view;
+			return view.parse(data, length) && !view.isRequest() && view.identification() == i && view.homeAddress() == benchAddress(i);
+		});
+
+	benchmarkMessage("Datagram (IPv4/UDP)",
+		[correspondent](uint8_t* out, size_t capacity, uint32_t i)
+		{
+			return encodeDatagram(out, capacity, correspondent, benchAddress(i), i);
+		},
+		[](const uint8_t* data, size_t length, uint32_t i)
+		{
+			datagramView view;
+			return view.parse(data, length) && view.sequenceNumber() == i && view.destination() == benchAddress(i);
+		});
+}
+
+/*
+Measures one trip through an IP-in-IP tunnel (home agent encapsulates, foreign agent
+decapsulates) for an inner packet of the given size. The zero-copy datapath writes the
+outer header into the buffer's headroom. For comparison, the copying datapath builds each
+tunneled packet in a fresh buffer and copies the inner packet out again at the exit.
+*/
+inline void benchmarkTunnel(size_t packetBytes)
+{
+	const size_t packets = 4000000;
+	IPv4Addr correspondent(172, 16, 0, 1);
+	IPv4Addr mobile(10, 0, 0, 2);
+	IPv4Addr homeAgent(10, 0, 0, 1);
+	IPv4Addr careOf(192, 168, 1, 1);
+
+	// Inner packet: IPv4 header and payload
+	packetBuffer packet;
+	uint8_t* inner = packet.append(packetBytes);
+	for(size_t i = IPV4_HEADER_SIZE; i < packetBytes; i++) inner[i] = (uint8_t) i;
+	encodeIPv4Header(inner, packetBytes, correspondent, mobile, IP_PROTOCOL_UDP, packetBytes - IPV4_HEADER_SIZE, 1);
+
+	size_t good = 0;
+	benchTimer zeroCopyTimer;
+	for(size_t i = 0; i < packets; i++)
+	{
+		encapsulate(packet, homeAgent, careOf, (uint16_t) i);
+		good += decapsulate(packet);
+	}
+	double zeroCopyNs = zeroCopyTimer.elapsedNs() / packets;
+
+	static uint8_t tunneled[packetBuffer::capacity];
+	static uint8_t delivered[packetBuffer::capacity];
+	benchTimer copyTimer;
+	for(size_t i = 0; i < packets; i++)
+	{
+		memcpy(tunneled + IPV4_HEADER_SIZE, packet.data(), packet.length());
+		encodeIPv4Header(tunneled, IPV4_HEADER_SIZE, homeAgent, careOf, IP_PROTOCOL_IPIP, packet.length(), (uint16_t) i);
+		ipv4View outer;
+		ipv4View received;
+		if(outer.parse(tunneled, IPV4_HEADER_SIZE + packet.length()) && received.parse(outer.payload(), outer.payloadLength()))
+		{
+			memcpy(delivered, outer.payload(), received.totalLength());
+			good += delivered[packetBytes - 1] == inner[packetBytes - 1];
+		}
+	}
+	double copyNs = copyTimer.elapsedNs() / packets;
+
+	cout << "| " << packetBytes;
+	for(size_t pad = to_string(packetBytes).length(); pad < 6; pad++) cout << " ";
+	cout << " | " << zeroCopyNs << " | " << 1000.0 / zeroCopyNs << " | " << copyNs << " | " << 1000.0 / copyNs << " |";
+	benchCheck(good == 2 * packets && packet.length() == packetBytes);
+	cout << endl;
+}
+
+/*
+Measures the cost the always-on metrics add to a protocol phase: start() and record() for a
+phase, which time one call in protocolMetrics::wallSampling, and for comparison a phase
+timed on every call (two clock reads and two histogram records)
+*/
+inline void benchmarkMetrics()
+{
+	const size_t records = 10000000;
+	static latencyHistogram wall;
+	static latencyHistogram network;
+	uint32_t state = 362436069u;
+	protocolMetrics &metrics = protocolMetrics::instance();
+	uint64_t before = metrics.networkTime(PHASE_TUNNEL).count();
+
+	benchTimer phaseTimer;
+	for(size_t i = 0; i < records; i++) metrics.record(PHASE_TUNNEL, metrics.start(PHASE_TUNNEL), benchRandom(state) % 100000);
+	double phaseNs = phaseTimer.elapsedNs() / records;
+
+	benchTimer everyTimer;
+	for(size_t i = 0; i < records; i++)
+	{
+		uint64_t started = metricsClock();
+		wall.record(metricsClock() - started);
+		network.record(benchRandom(state) % 100000);
+	}
+	double everyNs = everyTimer.elapsedNs() / records;
+
+	benchTimer clockTimer;
+	uint64_t sum = 0;
+	for(size_t i = 0; i < records; i++) sum += metricsClock();
+	double clockNs = clockTimer.elapsedNs() / records;
+
+	cout << "| " << phaseNs << " | " << everyNs << " | " << clockNs << " | " << latencyHistogram::bucketCount * 8 / 1024 << " |";
+	benchCheck(metrics.networkTime(PHASE_TUNNEL).count() - before == records && wall.count() == records && sum != 0);
+	cout << endl;
+}
+
+inline void runBenchmarks(const vector<size_t> &sizes)
+{
+	cout.precision(1);
+	cout << fixed;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Mobility Binding Table (ns per operation)    " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Bindings   | insert | update | lookup hit | lookup miss | erase |" << endl;
+	for(size_t i = 0; i < sizes.size(); i++) benchmarkBindingTable(sizes[i]);
+	cout << endl;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Concurrent Binding Table (millions/sec)      " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Threads | Bindings   | lookups | updates |" << endl;
+	for(size_t i = 0; i < sizes.size(); i++) benchmarkConcurrentBindingTable(sizes[i]);
+	cout << endl;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Foreign Agent Visitor List (ns per operation)" << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Visitors   | insert | update | find home | find MAC | erase | list bytes/visitor | table bytes/visitor |" << endl;
+	for(size_t i = 0; i < sizes.size(); i++) benchmarkVisitorList(sizes[i]);
+	cout << endl;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Lifetime Timer Wheel (ns per timer)          " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Timers     | schedule | re-register | expire |" << endl;
+	for(size_t i = 0; i < sizes.size(); i++) benchmarkTimerWheel(sizes[i]);
+	cout << endl;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Mobility Models (ns per position update)     " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Nodes      | waypoint (crossings/hour) | Manhattan | commuter |" << endl;
+	for(size_t i = 0; i < sizes.size(); i++) benchmarkMobility(sizes[i]);
+	cout << endl;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Coverage Index (ns per position)             " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Positions  | agents | agents/cell | index | batch | scan |" << endl;
+	for(size_t i = 0; i < sizes.size(); i++)
+	{
+		benchmarkCoverageIndex(sizes[i], 1000);
+		benchmarkCoverageIndex(sizes[i], 100000);
+	}
+	cout << endl;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Wire Format (millions of messages/sec)       " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Message                | bytes | encode | decode |" << endl;
+	benchmarkWireFormat();
+	cout << endl;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            IP-in-IP Tunnel (encapsulate + decapsulate)  " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| bytes  | zero-copy ns/packet | Mpps | copying ns/packet | Mpps |" << endl;
+	benchmarkTunnel(64);
+	benchmarkTunnel(1500);
+	cout << endl;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Protocol Metrics (ns per timed phase)        " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| sampled phase | every call timed | clock read | KB per histogram |" << endl;
+	benchmarkMetrics();
+	cout << endl;
+}
+
+#endif
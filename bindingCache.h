@@ -0,0 +1,219 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Binding cache kept by a correspondent node for route optimization. It remembers the
+care-of-address of each mobile node the correspondent sends to, so direct routing can tunnel
+straight to the mobile node without first asking the home agent. Each entry carries the
+lifetime the home agent granted and is ignored once that runs out. The home agent keeps
+the cache current with binding updates when the mobile node moves, and removes entries
+with an invalidation when the binding ends.
+
+The cache holds at most a fixed number of entries. When it is full the least recently used
+entry is evicted. Entries sit in one array threaded on a doubly linked recency list, and an
+address index maps a home address to its row, so lookups, updates, evictions and
+invalidations all take constant time with no allocation once the cache is full.
+*/
+#ifndef BINDING_CACHE_H
+#define BINDING_CACHE_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+#include "addressIndex.h"
+
+using namespace std;
+
+// Cache activity since the cache was created
+struct bindingCacheStats
+{
+	bindingCacheStats() : hits(0), misses(0), updates(0), invalidations(0), expirations(0), evictions(0) {}
+
+	// Adds (sign 1) or takes away (sign -1) another set of counts, to total caches or to
+	// measure the activity between two readings
+	void add(const bindingCacheStats &other, int sign = 1)
+	{
+		hits += sign * other.hits;
+		misses += sign * other.misses;
+		updates += sign * other.updates;
+		invalidations += sign * other.invalidations;
+		expirations += sign * other.expirations;
+		evictions += sign * other.evictions;
+	}
+
+	uint64_t hits;           // Lookups answered from the cache (home agent queries avoided)
+	uint64_t misses;         // Lookups that had to query the home agent
+	uint64_t updates;        // Bindings added or refreshed
+	uint64_t invalidations;  // Entries removed by the home agent or a stale tunnel
+	uint64_t expirations;    // Entries found past their lifetime
+	uint64_t evictions;      // Least recently used entries dropped to make room
+};
+
+class bindingCache
+{
+	public:
+		// Constructor
+		bindingCache(size_t entries = 0) : limit(entries), head(NONE), tail(NONE), freeRows(NONE) {}
+
+		// Member Functions
+		size_t size() const { return index.size(); }
+		size_t capacity() const { return limit; }
+		const bindingCacheStats& stats() const { return counts; }
+
+		// Changes the entry limit (0 turns the cache off), evicting the least recently used
+		// entries that no longer fit
+		void resize(size_t entries)
+		{
+			limit = entries;
+			while(index.size() > limit) remove(tail, counts.evictions);
+		}
+
+		// Finds the care-of-address of a mobile node at time now (seconds). Counts a hit or a
+		// miss; an expired entry is removed and counts as a miss.
+		bool lookup(IPv4Addr home, uint64_t now, IPv4Addr &coa)
+		{
+			uint32_t row = limit == 0 ? addressIndex::NONE : index.find(home.toUint());
+			if(row != addressIndex::NONE && rows[row].expires <= now)
+			{
+				remove(row, counts.expirations);
+				row = addressIndex::NONE;
+			}
+			if(row == addressIndex::NONE)
+			{
+				counts.misses++;
+				return false;
+			}
+			moveToFront(row);
+			coa = rows[row].COA;
+			counts.hits++;
+			return true;
+		}
+
+		// Binding update: caches coa for home until now + lifetime seconds, evicting the least
+		// recently used entry if the cache is full
+		void update(IPv4Addr home, IPv4Addr coa, uint64_t now, uint64_t lifetime)
+		{
+			if(limit == 0) return;
+			counts.updates++;
+			uint32_t row = index.find(home.toUint());
+			if(row == addressIndex::NONE)
+			{
+				if(index.size() >= limit) remove(tail, counts.evictions);
+				row = allocateRow();
+				rows[row].homeAddress = home;
+				index.insert(home.toUint(), row);
+				rows[row].prev = NONE;
+				rows[row].next = head;
+				if(head != NONE) rows[head].prev = row;
+				head = row;
+				if(tail == NONE) tail = row;
+			}
+			else moveToFront(row);
+			rows[row].COA = coa;
+			rows[row].expires = now + lifetime;
+		}
+
+		// Drops the entry for home (binding ended or found stale). Returns false if none.
+		bool invalidate(IPv4Addr home)
+		{
+			uint32_t row = index.find(home.toUint());
+			if(row == addressIndex::NONE) return false;
+			remove(row, counts.invalidations);
+			return true;
+		}
+
+		// Snapshot support: the rows, recency list and index are saved and restored as blocks
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.value(limit);
+			out.value(head);
+			out.value(tail);
+			out.value(freeRows);
+			out.value(counts);
+			out.array(rows);
+			index.save(out);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.value(limit) || !in.value(head) || !in.value(tail) || !in.value(freeRows) || !in.value(counts) ||
+			   !in.array(rows) || !index.load(in))
+				return false;
+			bool inRange = (head == NONE || head < rows.size()) && (tail == NONE || tail < rows.size()) &&
+			               (freeRows == NONE || freeRows < rows.size());
+			if(!inRange || index.size() > rows.size()) return in.fail("binding cache is inconsistent");
+			return true;
+		}
+
+	private:
+		static const uint32_t NONE = 0xFFFFFFFF;
+
+		// Cached binding, linked into the recency list (free rows are chained through next)
+		struct cacheRow
+		{
+			IPv4Addr homeAddress;  // Mobile node's home address
+			IPv4Addr COA;          // Care-of-address from the home agent
+			uint64_t expires;      // Time (seconds) the binding lifetime runs out
+			uint32_t prev;         // More recently used row (NONE at the head)
+			uint32_t next;         // Less recently used row (NONE at the tail)
+		};
+
+		// Member Functions
+		uint32_t allocateRow()
+		{
+			if(freeRows == NONE)
+			{
+				rows.push_back(cacheRow());
+				return (uint32_t) rows.size() - 1;
+			}
+			uint32_t row = freeRows;
+			freeRows = rows[row].next;
+			return row;
+		}
+
+		void unlinkRow(uint32_t row)
+		{
+			cacheRow &r = rows[row];
+			if(r.prev != NONE) rows[r.prev].next = r.next;
+			else head = r.next;
+			if(r.next != NONE) rows[r.next].prev = r.prev;
+			else tail = r.prev;
+		}
+
+		void moveToFront(uint32_t row)
+		{
+			if(row == head) return;
+			unlinkRow(row);
+			rows[row].prev = NONE;
+			rows[row].next = head;
+			rows[head].prev = row;
+			head = row;
+		}
+
+		// Removes a row, counting why
+		void remove(uint32_t row, uint64_t &reason)
+		{
+			unlinkRow(row);
+			index.erase(rows[row].homeAddress.toUint());
+			rows[row].next = freeRows;
+			freeRows = row;
+			reason++;
+		}
+
+		// Data Members
+		size_t limit;              // Most entries held (0 disables the cache)
+		vector<cacheRow> rows;     // Entries and free rows
+		addressIndex index;        // Home address -> row
+		uint32_t head;             // Most recently used row
+		uint32_t tail;             // Least recently used row
+		uint32_t freeRows;         // First free row
+		bindingCacheStats counts;  // Activity counters
+};
+
+#endif
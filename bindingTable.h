@@ -0,0 +1,237 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Mobility Binding Table used by the home agent. Bindings are stored in an open-addressing
+hash table (linear probing) keyed on the mobile node's home address, so the home agent can
+find a care-of-address in constant time no matter how many mobile nodes it serves.
+Re-registrations update the existing binding in place and deregistrations delete it using
+backward-shift deletion, so the table never accumulates tombstones. A batch of
+registrations is applied in one pass: the table grows once for the whole batch and every
+slot the batch touches is prefetched before the first is written.
+*/
+#ifndef BINDING_TABLE_H
+#define BINDING_TABLE_H
+
+#include <vector>
+#include <stdint.h>
+#include "address.h"
+#include "timerWheel.h"
+#include "portability.h"
+
+using namespace std;
+
+// Mobility Binding Table entries
+class bindingEntry
+{
+	public:
+		// Constructors
+		bindingEntry() : lifetime(0), timer(0) {}
+		bindingEntry(IPv4Addr home, IPv4Addr careOfAddress, int time)
+			: homeAddress(home), COA(careOfAddress), lifetime(time), timer(0) {}
+
+		// Members
+		IPv4Addr homeAddress;  // Home address of a mobility node
+		IPv4Addr COA;          // Care-of-Address of a mobility node
+		int lifetime;          // Lifetime of the entry in seconds
+		IPv4Addr correspondent;// Correspondent caching this binding (unset if none)
+		timerId timer;         // Lifetime expiry timer (0 if none)
+};
+
+// One binding in a batch of registrations
+struct bindingRequest
+{
+	IPv4Addr homeAddress;  // Home address of a mobility node
+	IPv4Addr COA;          // Care-of-Address it registered
+	int lifetime;          // Lifetime granted in seconds
+};
+
+class mobilityBindingTable
+{
+	public:
+		// Constructor
+		mobilityBindingTable(size_t expected = 16) : count(0) { allocate(capacityFor(expected)); }
+
+		// Member Functions
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		size_t capacity() const { return slots.size(); }
+
+		void reserve(size_t expected)
+		{
+			size_t wanted = capacityFor(expected);
+			if(wanted > slots.size()) rehash(wanted);
+		}
+
+		// Inserts a new binding or updates the existing one in place and returns it. The
+		// pointer is valid until the next insert or erase.
+		bindingEntry* insert(IPv4Addr home, IPv4Addr coa, int time)
+		{
+			if((count + 1) * 10 > slots.size() * 7) rehash(slots.size() * 2);
+
+			size_t i = hashAddress(home.toUint()) & mask;
+			while(slots[i].used)
+			{
+				if(slots[i].entry.homeAddress == home)
+				{
+					slots[i].entry.COA = coa;
+					slots[i].entry.lifetime = time;
+					return &slots[i].entry;
+				}
+				i = (i + 1) & mask;
+			}
+
+			slots[i].used = true;
+			slots[i].entry = bindingEntry(home, coa, time);
+			count++;
+			return &slots[i].entry;
+		}
+
+		// Inserts or updates requestCount bindings, storing the entry for requests[i] in
+		// entries[i]. The pointers are valid until the next insert or erase.
+		void insertBatch(const bindingRequest* requests, size_t requestCount, bindingEntry** entries)
+		{
+			// Grow once, so no insert in the batch rehashes and moves the entries already returned
+			size_t wanted = capacityFor(count + requestCount);
+			if(wanted > slots.size()) rehash(wanted);
+			for(size_t i = 0; i < requestCount; i++) prefetch(&slots[hashAddress(requests[i].homeAddress.toUint()) & mask]);
+			for(size_t i = 0; i < requestCount; i++) entries[i] = insert(requests[i].homeAddress, requests[i].COA, requests[i].lifetime);
+		}
+
+		// Returns the binding for the home address, or NULL if the mobile node is not bound
+		bindingEntry* find(IPv4Addr home)
+		{
+			size_t i = hashAddress(home.toUint()) & mask;
+			while(slots[i].used)
+			{
+				if(slots[i].entry.homeAddress == home) return &slots[i].entry;
+				i = (i + 1) & mask;
+			}
+			return NULL;
+		}
+
+		const bindingEntry* find(IPv4Addr home) const
+		{
+			return const_cast<mobilityBindingTable*>(this)->find(home);
+		}
+
+		// Removes the binding for the home address. Returns false if it was not bound.
+		bool erase(IPv4Addr home)
+		{
+			size_t i = hashAddress(home.toUint()) & mask;
+			while(slots[i].used)
+			{
+				if(slots[i].entry.homeAddress == home)
+				{
+					removeSlot(i);
+					return true;
+				}
+				i = (i + 1) & mask;
+			}
+			return false;
+		}
+
+		void clear()
+		{
+			for(size_t i = 0; i < slots.size(); i++) slots[i] = slot();
+			count = 0;
+		}
+
+		// Calls visit(entry) for every binding in the table
+		template <class Visitor>
+		void forEach(Visitor visit) const
+		{
+			for(size_t i = 0; i < slots.size(); i++)
+				if(slots[i].used) visit(slots[i].entry);
+		}
+
+		// Snapshot support: the slot array is saved and restored as one block, so a restored
+		// table is used as is without rehashing
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.array(slots);
+			out.value(count);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.array(slots) || !in.value(count)) return false;
+			if(slots.size() < 16 || (slots.size() & (slots.size() - 1)) != 0 || count >= slots.size())
+				return in.fail("binding table is inconsistent");
+			mask = slots.size() - 1;
+			return true;
+		}
+
+	private:
+		// Hash table slot
+		struct slot
+		{
+			slot() : used(false) {}
+
+			bool used;           // Slot holds a binding
+			bindingEntry entry;  // Binding stored in this slot
+		};
+
+		// Member Functions
+		static size_t hashOf(const bindingEntry &entry) { return hashAddress(entry.homeAddress.toUint()); }
+
+		static size_t capacityFor(size_t expected)
+		{
+			size_t cap = 16;
+			while(cap * 7 < expected * 10) cap *= 2;
+			return cap;
+		}
+
+		void allocate(size_t cap)
+		{
+			slots.assign(cap, slot());
+			mask = cap - 1;
+		}
+
+		void rehash(size_t cap)
+		{
+			vector<slot> old;
+			old.swap(slots);
+			allocate(cap);
+			for(size_t i = 0; i < old.size(); i++)
+			{
+				if(!old[i].used) continue;
+				size_t j = hashOf(old[i].entry) & mask;
+				while(slots[j].used) j = (j + 1) & mask;
+				slots[j] = old[i];
+			}
+		}
+
+		// Backward-shift deletion: pull later entries of the probe run into the hole so
+		// lookups never need tombstones
+		void removeSlot(size_t hole)
+		{
+			size_t i = hole;
+			while(true)
+			{
+				i = (i + 1) & mask;
+				if(!slots[i].used) break;
+				size_t home = hashOf(slots[i].entry) & mask;
+				// Move the entry only if its home slot is not between the hole and i
+				if(((i - home) & mask) >= ((i - hole) & mask))
+				{
+					slots[hole] = slots[i];
+					hole = i;
+				}
+			}
+			slots[hole] = slot();
+			count--;
+		}
+
+		// Data Members
+		vector<slot> slots;  // Open-addressing slot array (power of two)
+		size_t mask;         // slots.size() - 1
+		size_t count;        // Number of bindings in the table
+};
+
+#endif
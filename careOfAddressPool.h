@@ -0,0 +1,140 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Pool of co-located care-of-addresses handed out by a foreign agent. The pool owns one
+contiguous, aligned block of addresses, so telling whether an address belongs to it is a
+range check. Each visitor that registers takes an address from the pool and keeps it until
+its registration expires, when the address goes back to the pool.
+
+Free addresses are chained in a free list threaded through an array with one slot per
+address, and a bitmap marks the addresses in use, so allocating and releasing both take
+constant time and never allocate once the pool is configured. Releasing an address that is
+not in use is ignored. When every address is taken, allocate fails and the foreign agent
+falls back to advertising its own address as the care-of-address.
+*/
+#ifndef CARE_OF_ADDRESS_POOL_H
+#define CARE_OF_ADDRESS_POOL_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+
+using namespace std;
+
+// Pool activity since the pool was configured
+struct careOfAddressStats
+{
+	careOfAddressStats() : assigned(0), released(0), exhausted(0) {}
+
+	// Adds (sign 1) or takes away (sign -1) another set of counts, to total pools or to
+	// measure the activity between two readings
+	void add(const careOfAddressStats &other, int sign = 1)
+	{
+		assigned += sign * other.assigned;
+		released += sign * other.released;
+		exhausted += sign * other.exhausted;
+	}
+
+	uint64_t assigned;   // Addresses handed out
+	uint64_t released;   // Addresses returned when a registration expired
+	uint64_t exhausted;  // Requests made while every address was taken
+};
+
+class careOfAddressPool
+{
+	public:
+		// Constructor
+		careOfAddressPool() : first(0), freeHead(NONE), inUse(0) {}
+
+		// Member Functions
+		// Takes over size addresses starting at base (0 turns the pool off)
+		void configure(IPv4Addr base, size_t size)
+		{
+			first = size == 0 ? 0 : base.toUint();
+			next.resize(size);
+			used.assign((size + 63) / 64, 0);
+			for(size_t i = 0; i < size; i++) next[i] = i + 1 < size ? (uint32_t) (i + 1) : NONE;
+			freeHead = size == 0 ? NONE : 0;
+			inUse = 0;
+		}
+
+		bool enabled() const { return !next.empty(); }
+		size_t size() const { return next.size(); }
+		size_t allocated() const { return inUse; }
+		const careOfAddressStats& stats() const { return counts; }
+
+		// True if address is in the pool's block, whether in use or not
+		bool owns(IPv4Addr address) const { return address.toUint() - first < next.size(); }
+
+		// Takes a free address. Returns false if every address is in use.
+		bool allocate(IPv4Addr &address)
+		{
+			if(freeHead == NONE)
+			{
+				if(enabled()) counts.exhausted++;
+				return false;
+			}
+			uint32_t slot = freeHead;
+			freeHead = next[slot];
+			used[slot / 64] |= (uint64_t) 1 << (slot % 64);
+			inUse++;
+			counts.assigned++;
+			address = IPv4Addr(first + slot);
+			return true;
+		}
+
+		// Returns an address to the pool. Returns false if it is not in the pool or not in use.
+		bool release(IPv4Addr address)
+		{
+			if(!owns(address)) return false;
+			uint32_t slot = address.toUint() - first;
+			uint64_t bit = (uint64_t) 1 << (slot % 64);
+			if((used[slot / 64] & bit) == 0) return false;
+			used[slot / 64] &= ~bit;
+			next[slot] = freeHead;
+			freeHead = slot;
+			inUse--;
+			counts.released++;
+			return true;
+		}
+
+		// Snapshot support: the free list and bitmap are saved and restored as blocks
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.value(first);
+			out.value(freeHead);
+			out.value(inUse);
+			out.value(counts);
+			out.array(next);
+			out.array(used);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.value(first) || !in.value(freeHead) || !in.value(inUse) || !in.value(counts) || !in.array(next) || !in.array(used))
+				return false;
+			if(used.size() != (next.size() + 63) / 64 || (freeHead != NONE && freeHead >= next.size()) || inUse > next.size())
+				return in.fail("care-of-address pool is inconsistent");
+			return true;
+		}
+
+	private:
+		static const uint32_t NONE = 0xFFFFFFFF;
+
+		// Data Members
+		uint32_t first;             // First address of the block
+		vector<uint32_t> next;      // Next free slot of each free slot
+		vector<uint64_t> used;      // One bit per address, set while it is in use
+		uint32_t freeHead;          // First free slot (NONE if the pool is exhausted)
+		size_t inUse;               // Addresses in use
+		careOfAddressStats counts;  // Activity counters
+};
+
+#endif
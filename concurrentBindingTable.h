@@ -0,0 +1,241 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Mobility Binding Table for home agents whose registrations and care-of-address lookups run
+on different threads. Lookups never take a lock, and updates to different parts of the table
+proceed in parallel.
+
+The table is split into shards by the high bits of the home address hash. Each shard is a
+small open-addressing table (linear probing, backward-shift deletion, like
+mobilityBindingTable) with its own writer lock and sequence counter (a seqlock). A writer
+takes the shard's lock, makes the sequence odd, changes the slots and makes it even again.
+A reader notes the sequence, probes the slots and retries if the sequence was odd or has
+moved on, so it never sees a probe chain half shifted by a deletion. Each slot holds the home
+address and care-of-address in one 64-bit atomic word, so a binding is always read whole.
+
+A shard that fills up grows into a new slot array published under its seqlock. A reader may
+still be probing the old array, so retired arrays are kept until the table is destroyed; their
+total size is less than the shard's current array.
+*/
+#ifndef CONCURRENT_BINDING_TABLE_H
+#define CONCURRENT_BINDING_TABLE_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+
+using namespace std;
+
+class concurrentBindingTable
+{
+	public:
+		// Constructor: room for about expected bindings in shardCount shards (a power of two)
+		concurrentBindingTable(size_t expected = 1024, size_t shardCount = 64)
+			: shardBits(0)
+		{
+			while(((size_t) 1 << shardBits) < shardCount) shardBits++;
+			shards.reset(new shard[(size_t) 1 << shardBits]);
+			size_t perShard = expected >> shardBits;
+			for(size_t i = 0; i < ((size_t) 1 << shardBits); i++) shards[i].grow(capacityFor(perShard));
+		}
+
+		// Member Functions
+		// Bindings in the table (exact when no writer is active)
+		size_t size() const
+		{
+			size_t total = 0;
+			for(size_t i = 0; i < ((size_t) 1 << shardBits); i++) total += shards[i].count.load(memory_order_relaxed);
+			return total;
+		}
+
+		// Finds the care-of-address bound to a home address without locking. Returns false if
+		// the mobile node is not bound.
+		bool lookup(IPv4Addr home, IPv4Addr &coa) const
+		{
+			size_t hash = hashAddress(home.toUint());
+			const shard &s = shards[shardOf(hash)];
+			for(int spins = 0; ; spins++)
+			{
+				uint32_t before = s.sequence.load(memory_order_acquire);
+				if((before & 1) == 0)
+				{
+					uint64_t found = s.find(home, hash);
+					atomic_thread_fence(memory_order_acquire);
+					if(s.sequence.load(memory_order_relaxed) == before)
+					{
+						if(found == 0) return false;
+						coa = IPv4Addr((uint32_t) found);
+						return true;
+					}
+				}
+				if(spins >= 64) this_thread::yield();
+			}
+		}
+
+		// Binds a home address to a care-of-address, adding the binding or updating it in place
+		void insert(IPv4Addr home, IPv4Addr coa)
+		{
+			size_t hash = hashAddress(home.toUint());
+			shard &s = shards[shardOf(hash)];
+			lock_guard<mutex> lock(s.writer);
+			s.beginWrite();
+			s.insert(home, coa, hash);
+			s.endWrite();
+		}
+
+		// Removes the binding for a home address. Returns false if it was not bound.
+		bool erase(IPv4Addr home)
+		{
+			size_t hash = hashAddress(home.toUint());
+			shard &s = shards[shardOf(hash)];
+			lock_guard<mutex> lock(s.writer);
+			s.beginWrite();
+			bool erased = s.erase(home, hash);
+			s.endWrite();
+			return erased;
+		}
+
+	private:
+		// Open-addressing slot array of one shard (power of two). A slot holds home << 32 | COA,
+		// or 0 if it is empty.
+		struct slotArray
+		{
+			slotArray(size_t capacity) : mask(capacity - 1), slots(new atomic<uint64_t>[capacity])
+			{
+				for(size_t i = 0; i < capacity; i++) slots[i].store(0, memory_order_relaxed);
+			}
+
+			size_t mask;                        // Capacity - 1
+			unique_ptr<atomic<uint64_t>[]> slots; // Bindings
+		};
+
+		// One shard, on its own cache lines so writers of different shards do not interfere
+		struct alignas(64) shard
+		{
+			shard() : sequence(0), current(NULL), count(0) {}
+
+			// Slot holding home in the current array (or 0). Readers call it between sequence reads.
+			uint64_t find(IPv4Addr home, size_t hash) const
+			{
+				const slotArray* a = current.load(memory_order_acquire);
+				for(size_t i = hash & a->mask; ; i = (i + 1) & a->mask)
+				{
+					uint64_t binding = a->slots[i].load(memory_order_relaxed);
+					if(binding == 0 || (uint32_t) (binding >> 32) == home.toUint()) return binding;
+				}
+			}
+
+			void beginWrite()
+			{
+				sequence.store(sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+				atomic_thread_fence(memory_order_release);
+			}
+
+			void endWrite() { sequence.store(sequence.load(memory_order_relaxed) + 1, memory_order_release); }
+
+			// The rest are called with the writer lock held, between beginWrite and endWrite
+			void insert(IPv4Addr home, IPv4Addr coa, size_t hash)
+			{
+				uint64_t binding = (uint64_t) home.toUint() << 32 | coa.toUint();
+				slotArray* a = current.load(memory_order_relaxed);
+				size_t i = hash & a->mask;
+				for(uint64_t held; (held = a->slots[i].load(memory_order_relaxed)) != 0; i = (i + 1) & a->mask)
+				{
+					if((uint32_t) (held >> 32) == home.toUint())
+					{
+						a->slots[i].store(binding, memory_order_relaxed);
+						return;
+					}
+				}
+				size_t n = count.load(memory_order_relaxed) + 1;
+				if(n * 10 > (a->mask + 1) * 7)
+				{
+					grow((a->mask + 1) * 2);
+					a = current.load(memory_order_relaxed);
+					for(i = hash & a->mask; a->slots[i].load(memory_order_relaxed) != 0; i = (i + 1) & a->mask);
+				}
+				a->slots[i].store(binding, memory_order_relaxed);
+				count.store(n, memory_order_relaxed);
+			}
+
+			bool erase(IPv4Addr home, size_t hash)
+			{
+				slotArray* a = current.load(memory_order_relaxed);
+				size_t hole = hash & a->mask;
+				for(uint64_t held; ; hole = (hole + 1) & a->mask)
+				{
+					held = a->slots[hole].load(memory_order_relaxed);
+					if(held == 0) return false;
+					if((uint32_t) (held >> 32) == home.toUint()) break;
+				}
+
+				// Backward-shift deletion: pull later entries of the probe run into the hole
+				for(size_t i = hole; ; )
+				{
+					i = (i + 1) & a->mask;
+					uint64_t held = a->slots[i].load(memory_order_relaxed);
+					if(held == 0) break;
+					size_t wanted = hashAddress(held >> 32) & a->mask;
+					if(((i - wanted) & a->mask) >= ((i - hole) & a->mask))
+					{
+						a->slots[hole].store(held, memory_order_relaxed);
+						hole = i;
+					}
+				}
+				a->slots[hole].store(0, memory_order_relaxed);
+				count.store(count.load(memory_order_relaxed) - 1, memory_order_relaxed);
+				return true;
+			}
+
+			// Moves the bindings to a new array of the given capacity and retires the old one
+			void grow(size_t capacity)
+			{
+				slotArray* bigger = new slotArray(capacity);
+				slotArray* old = current.load(memory_order_relaxed);
+				if(old != NULL)
+				{
+					for(size_t i = 0; i <= old->mask; i++)
+					{
+						uint64_t binding = old->slots[i].load(memory_order_relaxed);
+						if(binding == 0) continue;
+						size_t j = hashAddress(binding >> 32) & bigger->mask;
+						while(bigger->slots[j].load(memory_order_relaxed) != 0) j = (j + 1) & bigger->mask;
+						bigger->slots[j].store(binding, memory_order_relaxed);
+					}
+				}
+				arrays.push_back(unique_ptr<slotArray>(bigger));
+				current.store(bigger, memory_order_release);
+			}
+
+			atomic<uint32_t> sequence;            // Odd while a writer is changing the shard
+			atomic<slotArray*> current;           // Array readers probe
+			atomic<size_t> count;                 // Bindings in the shard
+			mutex writer;                         // Held by the shard's writer
+			vector<unique_ptr<slotArray> > arrays;// Current and retired arrays (freed with the table)
+		};
+
+		// Member Functions
+		size_t shardOf(size_t hash) const { return shardBits == 0 ? 0 : (size_t) ((uint64_t) hash >> (64 - shardBits)); }
+
+		static size_t capacityFor(size_t expected)
+		{
+			size_t cap = 16;
+			while(cap * 7 < expected * 10) cap *= 2;
+			return cap;
+		}
+
+		// Data Members
+		int shardBits;                 // Log2 of the shard count
+		unique_ptr<shard[]> shards;    // Shards by the top bits of the hash
+};
+
+#endif
@@ -0,0 +1,266 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Spatial index of the agents' radio coverage. Each agent sits at a point and is heard by mobile
+nodes within its range. The index answers which agents a position is in range of, and which
+of them is the strongest (the nearest relative to its range), without scanning every agent.
+
+The area is divided into a uniform grid of square cells about one range across, and each cell
+lists the agents whose coverage disc touches it, so a position only has to check the agents
+of its own cell: a handful, however many agents there are. The lists are stored back to back
+in one array with an offset per cell (compressed sparse rows), and each list entry carries a
+copy of its agent's position and range, so a lookup reads one offset and a cache line or two
+of entries. Agents are added first and the index is built once; positions outside the area
+use the nearest cell on its edge.
+
+A batch query finds the cell of every position first, then prefetches each position's cell
+list a few positions ahead of scanning it, so a large batch of queries overlaps its cache
+misses instead of waiting on each in turn.
+*/
+#ifndef COVERAGE_INDEX_H
+#define COVERAGE_INDEX_H
+
+#include <vector>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "portability.h"
+
+using namespace std;
+
+// Agent listed under a cell, with what a lookup needs to know about it
+struct coverageEntry
+{
+	float x, y;      // Agent position
+	float range2;    // Square of its range
+	uint32_t agent;  // Agent number
+};
+
+class coverageIndex
+{
+	public:
+		// Agent number meaning "no agent in range"
+		static const uint32_t NONE = 0xFFFFFFFF;
+
+		// Constructor
+		coverageIndex() : width(0), height(0), cellSize(1), columns(1), rows(1), cellStart(2, 0) {}
+
+		// Member Functions
+		// Empties the index and sets the area it covers and the size of its cells
+		void configure(float areaWidth, float areaHeight, float cell)
+		{
+			width = areaWidth;
+			height = areaHeight;
+			cellSize = cell > 0 ? cell : 1;
+			columns = (uint32_t) ceilf(width / cellSize);
+			rows = (uint32_t) ceilf(height / cellSize);
+			if(columns < 1) columns = 1;
+			if(rows < 1) rows = 1;
+			agentX.clear();
+			agentY.clear();
+			range2.clear();
+			cellEntries.clear();
+			cellStart.assign((size_t) columns * rows + 1, 0);
+		}
+
+		// Adds an agent at (x, y) heard up to range (> 0) away. Returns its number (agents are
+		// numbered in the order they are added). Call build() once every agent is added.
+		uint32_t add(float x, float y, float range)
+		{
+			agentX.push_back(x);
+			agentY.push_back(y);
+			range2.push_back(range * range);
+			return (uint32_t) (agentX.size() - 1);
+		}
+
+		// Lists every agent under each cell its coverage touches
+		void build()
+		{
+			size_t cells = (size_t) columns * rows;
+			vector<uint32_t> count(cells + 1, 0);
+			for(int pass = 0; pass < 2; pass++)
+			{
+				for(uint32_t a = 0; a < agentX.size(); a++)
+				{
+					float range = sqrtf(range2[a]);
+					uint32_t firstX = clampColumn(agentX[a] - range), lastX = clampColumn(agentX[a] + range);
+					uint32_t firstY = clampRow(agentY[a] - range), lastY = clampRow(agentY[a] + range);
+					for(uint32_t cy = firstY; cy <= lastY; cy++)
+					{
+						for(uint32_t cx = firstX; cx <= lastX; cx++)
+						{
+							if(!touches(a, cx, cy)) continue;
+							size_t c = (size_t) cy * columns + cx;
+							if(pass == 0) count[c + 1]++;
+							else
+							{
+								coverageEntry &entry = cellEntries[cellStart[c] + count[c]++];
+								entry.x = agentX[a];
+								entry.y = agentY[a];
+								entry.range2 = range2[a];
+								entry.agent = a;
+							}
+						}
+					}
+				}
+				if(pass == 0)
+				{
+					// Offsets of each cell's list, then reuse count as each list's fill level
+					for(size_t c = 0; c < cells; c++) count[c + 1] += count[c];
+					cellStart = count;
+					cellEntries.resize(cellStart[cells]);
+					count.assign(cells + 1, 0);
+				}
+			}
+		}
+
+		size_t size() const { return agentX.size(); }
+		float positionX(uint32_t agent) const { return agentX[agent]; }
+		float positionY(uint32_t agent) const { return agentY[agent]; }
+		float range(uint32_t agent) const { return sqrtf(range2[agent]); }
+
+		// Mean agents listed per cell (the work of one query)
+		double meanCellAgents() const { return (double) cellEntries.size() / ((size_t) columns * rows); }
+
+		// True if (x, y) is within agent's range
+		bool inRange(uint32_t agent, float x, float y) const { return distance2(agent, x, y) <= range2[agent]; }
+
+		// Strongest agent in range of (x, y), or NONE if no agent is in range
+		uint32_t best(float x, float y) const { return bestInCell(cellOf(x, y), x, y); }
+
+		// Calls heard(agent) for every agent in range of (x, y). Returns how many there are.
+		template <class Heard>
+		size_t forEachInRange(float x, float y, Heard heard) const
+		{
+			size_t c = cellOf(x, y), found = 0;
+			for(uint32_t k = cellStart[c]; k < cellStart[c + 1]; k++)
+			{
+				const coverageEntry &entry = cellEntries[k];
+				float dx = x - entry.x, dy = y - entry.y;
+				if(dx * dx + dy * dy > entry.range2) continue;
+				heard(entry.agent);
+				found++;
+			}
+			return found;
+		}
+
+		// Agents in range of (x, y)
+		size_t countInRange(float x, float y) const { return forEachInRange(x, y, [](uint32_t) {}); }
+
+		// Batch query: the strongest agent in range of each of n positions (NONE where none is)
+		void locate(const float* x, const float* y, size_t n, uint32_t* best) const
+		{
+			// Cells first, written where the answers will go
+			for(size_t i = 0; i < n; i++) best[i] = cellOf(x[i], y[i]);
+
+			// Then each cell's agents, with the cell lists a few positions ahead prefetched
+			const size_t ahead = 8;
+			for(size_t i = 0; i < n; i++)
+			{
+				if(i + ahead < n) prefetch(cellEntries.data() + cellStart[best[i + ahead]]);
+				best[i] = bestInCell(best[i], x[i], y[i]);
+			}
+		}
+
+		// Snapshot support: the agents and the built grid are saved as blocks
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.value(width);
+			out.value(height);
+			out.value(cellSize);
+			out.value(columns);
+			out.value(rows);
+			out.array(agentX);
+			out.array(agentY);
+			out.array(range2);
+			out.array(cellStart);
+			out.array(cellEntries);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.value(width) || !in.value(height) || !in.value(cellSize) || !in.value(columns) || !in.value(rows) ||
+			   !in.array(agentX) || !in.array(agentY) || !in.array(range2) || !in.array(cellStart) || !in.array(cellEntries))
+				return false;
+			if(columns < 1 || rows < 1 || cellStart.size() != (size_t) columns * rows + 1 || agentY.size() != agentX.size() ||
+			   range2.size() != agentX.size() || cellStart.back() != cellEntries.size())
+				return in.fail("coverage index is inconsistent");
+			for(size_t c = 0; c + 1 < cellStart.size(); c++)
+				if(cellStart[c] > cellStart[c + 1]) return in.fail("coverage index is inconsistent");
+			for(size_t k = 0; k < cellEntries.size(); k++)
+				if(cellEntries[k].agent >= agentX.size()) return in.fail("coverage index is inconsistent");
+			return true;
+		}
+
+	private:
+		// Member Functions
+		uint32_t clampColumn(float x) const
+		{
+			float c = x / cellSize;
+			return c < 0 ? 0 : (c >= columns - 1 ? columns - 1 : (uint32_t) c);
+		}
+
+		uint32_t clampRow(float y) const
+		{
+			float r = y / cellSize;
+			return r < 0 ? 0 : (r >= rows - 1 ? rows - 1 : (uint32_t) r);
+		}
+
+		uint32_t cellOf(float x, float y) const { return clampRow(y) * columns + clampColumn(x); }
+
+		float distance2(uint32_t agent, float x, float y) const
+		{
+			float dx = x - agentX[agent], dy = y - agentY[agent];
+			return dx * dx + dy * dy;
+		}
+
+		// True if agent's coverage disc reaches cell (cx, cy). Edge cells stretch to infinity,
+		// since positions outside the area use them.
+		bool touches(uint32_t agent, uint32_t cx, uint32_t cy) const
+		{
+			float left = cx == 0 ? -INFINITY : cx * cellSize, right = cx == columns - 1 ? INFINITY : (cx + 1) * cellSize;
+			float bottom = cy == 0 ? -INFINITY : cy * cellSize, top = cy == rows - 1 ? INFINITY : (cy + 1) * cellSize;
+			float nx = agentX[agent] < left ? left : (agentX[agent] > right ? right : agentX[agent]);
+			float ny = agentY[agent] < bottom ? bottom : (agentY[agent] > top ? top : agentY[agent]);
+			return distance2(agent, nx, ny) <= range2[agent];
+		}
+
+		// Strongest agent of cell c in range of (x, y): the one with the smallest distance
+		// relative to its range (compared as d1 / r1 <= d2 / r2, multiplied out)
+		uint32_t bestInCell(size_t c, float x, float y) const
+		{
+			uint32_t found = NONE;
+			float bestDistance2 = 1.0f, bestRange2 = 1.0f;
+			for(uint32_t k = cellStart[c]; k < cellStart[c + 1]; k++)
+			{
+				const coverageEntry &entry = cellEntries[k];
+				float dx = x - entry.x, dy = y - entry.y;
+				float d2 = dx * dx + dy * dy;
+				if(d2 <= entry.range2 && d2 * bestRange2 <= bestDistance2 * entry.range2)
+				{
+					bestDistance2 = d2;
+					bestRange2 = entry.range2;
+					found = entry.agent;
+				}
+			}
+			return found;
+		}
+
+		// Data Members
+		float width, height;         // Area the grid covers
+		float cellSize;              // Side of one cell
+		uint32_t columns, rows;      // Grid size
+		vector<float> agentX;        // Position of each agent
+		vector<float> agentY;
+		vector<float> range2;        // Square of each agent's range
+		vector<uint32_t> cellStart;  // Offset of each cell's list in cellEntries (one extra at the end)
+		vector<coverageEntry> cellEntries; // Agents whose coverage touches each cell, cell by cell
+};
+
+#endif
@@ -0,0 +1,206 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Discrete-event scheduler that drives the simulation in virtual time. Events are kept in a
+pairing heap ordered by time (ties are broken by insertion order so runs are repeatable),
+which gives O(1) scheduling and O(log n) amortized removal of the next event. Heap nodes come
+from an index-linked pool, so once the pool has grown the scheduler does not allocate.
+
+Virtual time is counted in microseconds and has no relation to wall time: the clock jumps
+straight to the next event, so hours of network time can be simulated in seconds.
+*/
+#ifndef EVENT_SCHEDULER_H
+#define EVENT_SCHEDULER_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+// Virtual time in microseconds
+typedef uint64_t simTime;
+const simTime MICROSECOND = 1;
+const simTime MILLISECOND = 1000;
+const simTime SECOND = 1000000;
+
+// Event handed to the simulation when its time comes
+struct simEvent
+{
+	simEvent() : type(0), target(0), key(0) {}
+	simEvent(int t, uint32_t e, uint64_t k) : type(t), target(e), key(k) {}
+
+	int type;         // What happens (meaning defined by the caller)
+	uint32_t target;  // Handle of the entity the event applies to
+	uint64_t key;     // Extra event data
+};
+
+class eventScheduler
+{
+	public:
+		// Constructor
+		eventScheduler() : current(0), root(NIL), freeList(NIL), sequence(0), count(0), dispatched(0) {}
+
+		// Member Functions
+		simTime now() const { return current; }
+		bool empty() const { return root == NIL; }
+		size_t size() const { return count; }
+		uint64_t processed() const { return dispatched; }
+		simTime nextTime() const { return nodes[root].time; }
+
+		void reserve(size_t events) { nodes.reserve(events); }
+
+		// Schedules an event. Events in the past run at the current time.
+		void schedule(simTime time, const simEvent &event)
+		{
+			uint32_t index = allocateNode();
+			heapNode &node = nodes[index];
+			node.time = time < current ? current : time;
+			node.sequence = sequence++;
+			node.event = event;
+			node.child = NIL;
+			node.sibling = NIL;
+			root = root == NIL ? index : meld(root, index);
+			count++;
+		}
+
+		void scheduleAfter(simTime delay, const simEvent &event) { schedule(current + delay, event); }
+
+		// Removes the next event and moves the clock to its time
+		simEvent pop()
+		{
+			uint32_t top = root;
+			current = nodes[top].time;
+			simEvent event = nodes[top].event;
+			root = mergePairs(nodes[top].child);
+			nodes[top].sibling = freeList;
+			freeList = top;
+			count--;
+			dispatched++;
+			return event;
+		}
+
+		// Snapshot support: the heap node pool is saved and restored as one block, so pending
+		// events come back in the same order
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.array(nodes);
+			out.value(current);
+			out.value(root);
+			out.value(freeList);
+			out.value(sequence);
+			out.value(count);
+			out.value(dispatched);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.array(nodes) || !in.value(current) || !in.value(root) || !in.value(freeList) || !in.value(sequence) ||
+			   !in.value(count) || !in.value(dispatched))
+				return false;
+			if(count > nodes.size() || (root != NIL && root >= nodes.size()) || (freeList != NIL && freeList >= nodes.size()))
+				return in.fail("event queue is inconsistent");
+			return true;
+		}
+
+	private:
+		static const uint32_t NIL = 0xFFFFFFFF;
+
+		// Pairing heap node
+		struct heapNode
+		{
+			simTime time;       // Time the event happens
+			uint64_t sequence;  // Insertion order (tie breaker)
+			simEvent event;     // Event data
+			uint32_t child;     // First child
+			uint32_t sibling;   // Next sibling (or next free node)
+		};
+
+		// Member Functions
+		bool before(uint32_t a, uint32_t b) const
+		{
+			if(nodes[a].time != nodes[b].time) return nodes[a].time < nodes[b].time;
+			return nodes[a].sequence < nodes[b].sequence;
+		}
+
+		uint32_t allocateNode()
+		{
+			if(freeList == NIL)
+			{
+				nodes.push_back(heapNode());
+				return (uint32_t) (nodes.size() - 1);
+			}
+			uint32_t index = freeList;
+			freeList = nodes[index].sibling;
+			return index;
+		}
+
+		// Makes the later of two heap roots the first child of the earlier one
+		uint32_t meld(uint32_t a, uint32_t b)
+		{
+			if(before(b, a))
+			{
+				uint32_t t = a;
+				a = b;
+				b = t;
+			}
+			nodes[b].sibling = nodes[a].child;
+			nodes[a].child = b;
+			return a;
+		}
+
+		// Standard two-pass merge of a sibling list, done iteratively: meld pairs left to
+		// right, then meld the results right to left
+		uint32_t mergePairs(uint32_t first)
+		{
+			if(first == NIL) return NIL;
+
+			uint32_t paired = NIL;  // Melded pairs, linked in reverse order
+			while(first != NIL)
+			{
+				uint32_t a = first;
+				uint32_t b = nodes[a].sibling;
+				if(b == NIL)
+				{
+					nodes[a].sibling = paired;
+					paired = a;
+					break;
+				}
+				first = nodes[b].sibling;
+				nodes[a].sibling = NIL;
+				nodes[b].sibling = NIL;
+				uint32_t m = meld(a, b);
+				nodes[m].sibling = paired;
+				paired = m;
+			}
+
+			uint32_t result = paired;
+			paired = nodes[paired].sibling;
+			nodes[result].sibling = NIL;
+			while(paired != NIL)
+			{
+				uint32_t next = nodes[paired].sibling;
+				nodes[paired].sibling = NIL;
+				result = meld(result, paired);
+				paired = next;
+			}
+			return result;
+		}
+
+		// Data Members
+		vector<heapNode> nodes;  // Node pool
+		simTime current;         // Virtual clock
+		uint32_t root;           // Earliest event
+		uint32_t freeList;       // First released node
+		uint64_t sequence;       // Next insertion number
+		size_t count;            // Pending events
+		uint64_t dispatched;     // Events removed so far
+};
+
+#endif
@@ -0,0 +1,464 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Streaming export of simulator records as CSV or JSON Lines. An export table is one output
+file with fixed columns: binding-table rows, visitor rows or per-event protocol records.
+
+The simulation thread formats each row straight into a 64 KB chunk. Full chunks are handed to
+a background writer thread, which writes them to the file. Each table owns a fixed pool of
+chunks, so memory stays bounded however many rows are exported. The simulation only waits
+if every chunk is still queued for the writer, and such waits are counted. With compression
+on, the writer feeds the chunks to the system's gzip, so compression runs in parallel with
+the simulation and no compression library is needed to build the simulator.
+*/
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <vector>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+
+using namespace std;
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+enum exportFormat { EXPORT_CSV, EXPORT_JSON_LINES };
+
+class exportTable
+{
+	public:
+		// Chunk geometry: chunkCount chunks of chunkSize bytes per table. A row never
+		// exceeds maxRow bytes.
+		static const size_t chunkSize = 64 * 1024;
+		static const size_t chunkCount = 16;
+		static const size_t maxRow = 1024;
+
+		// Constructor
+		exportTable() : format(EXPORT_CSV), columns(0), fd(-1), child(-1), current(0), used(0), fullHead(0), fullCount(0),
+			closing(false), failure(0), rowCount(0), byteCount(0), waitCount(0), column(0), cursor(NULL) {}
+		~exportTable() { string ignored; close(ignored); }
+
+		// Member Functions
+		// Creates fileName (piped through gzip if compress is set) and starts the writer.
+		// CSV files begin with a header line naming the columns.
+		bool open(const string &fileName, exportFormat fileFormat, bool compress, const char* const* columnNames, size_t columnCount, string &error)
+		{
+			name = fileName;
+			format = fileFormat;
+			names = columnNames;
+			columns = columnCount;
+			if(!openOutput(compress, error)) return false;
+
+			storage.assign(chunkCount * chunkSize, 0);
+			lengths.assign(chunkCount, 0);
+			full.assign(chunkCount, 0);
+			freeChunks.clear();
+			for(size_t i = chunkCount - 1; i > 0; i--) freeChunks.push_back(i);
+			current = 0;
+			used = 0;
+			writer = thread(&exportTable::drain, this);
+
+			if(format == EXPORT_CSV)
+			{
+				char* out = space();
+				for(size_t i = 0; i < columns; i++)
+				{
+					if(i > 0) *out++ = ',';
+					out = copyText(out, names[i]);
+				}
+				*out++ = '\n';
+				used = (size_t) (out - (storage.data() + current * chunkSize));
+			}
+			return true;
+		}
+
+		bool isOpen() const { return fd >= 0; }
+
+		// Row building: begin(), then one field per column in column order, then end()
+		exportTable& begin()
+		{
+			cursor = space();
+			column = 0;
+			if(format == EXPORT_JSON_LINES) *cursor++ = '{';
+			return *this;
+		}
+
+		exportTable& field(uint64_t value)
+		{
+			separator();
+			cursor = writeNumber(cursor, value);
+			return *this;
+		}
+
+		exportTable& field(int64_t value)
+		{
+			separator();
+			if(value < 0)
+			{
+				*cursor++ = '-';
+				cursor = writeNumber(cursor, (uint64_t) -value);
+			}
+			else cursor = writeNumber(cursor, (uint64_t) value);
+			return *this;
+		}
+
+		exportTable& field(IPv4Addr address)
+		{
+			separator();
+			quote();
+			if(address.isSet()) cursor += address.format(cursor);
+			quote();
+			return *this;
+		}
+
+		exportTable& field(MacAddr address)
+		{
+			separator();
+			quote();
+			if(address.isSet()) cursor += address.format(cursor);
+			quote();
+			return *this;
+		}
+
+		// Text fields are short fixed words (such as event names) and are cut at 64 characters
+		exportTable& field(const char* text)
+		{
+			separator();
+			quote();
+			size_t length = strnlen(text, 64);
+			memcpy(cursor, text, length);
+			cursor += length;
+			quote();
+			return *this;
+		}
+
+		void end()
+		{
+			if(format == EXPORT_JSON_LINES) *cursor++ = '}';
+			*cursor++ = '\n';
+			used = (size_t) (cursor - (storage.data() + current * chunkSize));
+			rowCount++;
+		}
+
+		// Writes out everything still buffered, stops the writer and closes the file. Returns
+		// false with error set if any write failed (or gzip reported an error).
+		bool close(string &error)
+		{
+			if(fd < 0) return true;
+			if(used > 0) submit(false);
+			{
+				lock_guard<mutex> lock(guard);
+				closing = true;
+			}
+			ready.notify_one();
+			writer.join();
+
+			int err = failure;
+			if(::close(fd) != 0 && err == 0) err = errno;
+			fd = -1;
+			if(child > 0)
+			{
+				int status = 0;
+				if(::waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+					if(err == 0) err = EIO;
+				child = -1;
+			}
+			storage.clear();
+			storage.shrink_to_fit();
+			if(err == 0) return true;
+			error = "Could not write " + name + ": " + strerror(err);
+			return false;
+		}
+
+		// Totals
+		uint64_t rows() const { return rowCount; }
+		uint64_t bytes() const { return byteCount; }
+		uint64_t waits() const { return waitCount; }
+
+	private:
+		// Member Functions
+		// Returns room for one row in the current chunk, handing the chunk to the writer first
+		// if it is nearly full
+		char* space()
+		{
+			if(chunkSize - used < maxRow) submit(true);
+			return storage.data() + current * chunkSize + used;
+		}
+
+		// Queues the current chunk for the writer and, if another is needed, takes a free one
+		// (waiting only if every chunk is queued)
+		void submit(bool takeAnother)
+		{
+			unique_lock<mutex> lock(guard);
+			lengths[current] = used;
+			byteCount += used;
+			full[(fullHead + fullCount) % chunkCount] = current;
+			fullCount++;
+			ready.notify_one();
+			used = 0;
+			if(!takeAnother) return;
+			if(freeChunks.empty())
+			{
+				waitCount++;
+				released.wait(lock, [this]() { return !freeChunks.empty(); });
+			}
+			current = freeChunks.back();
+			freeChunks.pop_back();
+		}
+
+		// Writer thread
+		void drain()
+		{
+			unique_lock<mutex> lock(guard);
+			while(true)
+			{
+				ready.wait(lock, [this]() { return fullCount > 0 || closing; });
+				if(fullCount == 0) break;
+				size_t chunk = full[fullHead];
+				fullHead = (fullHead + 1) % chunkCount;
+				fullCount--;
+				lock.unlock();
+
+				// After a failed write the rest is discarded; close() reports the error
+				if(failure == 0) failure = writeAll(storage.data() + chunk * chunkSize, lengths[chunk]);
+
+				lock.lock();
+				freeChunks.push_back(chunk);
+				released.notify_one();
+			}
+		}
+
+		int writeAll(const char* data, size_t length)
+		{
+			while(length > 0)
+			{
+				ssize_t written = ::write(fd, data, length);
+				if(written < 0)
+				{
+					if(errno == EINTR) continue;
+					return errno;
+				}
+				data += written;
+				length -= (size_t) written;
+			}
+			return 0;
+		}
+
+		// Opens the file, or starts "gzip -c" writing to the file and opens a pipe into it
+		bool openOutput(bool compress, string &error)
+		{
+			if(!compress)
+			{
+				fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+				if(fd >= 0) return true;
+				error = "Could not create " + name + ": " + strerror(errno);
+				return false;
+			}
+
+			// A gzip that dies early must surface as a write error, not kill the simulator
+			::signal(SIGPIPE, SIG_IGN);
+			// Both ends are close-on-exec, so a gzip started for another table does not hold this
+			// pipe open and keep this gzip from seeing the end of its input
+			int ends[2];
+			if(::pipe(ends) != 0 || ::fcntl(ends[0], F_SETFD, FD_CLOEXEC) != 0 || ::fcntl(ends[1], F_SETFD, FD_CLOEXEC) != 0)
+			{
+				error = string("Could not start gzip: ") + strerror(errno);
+				return false;
+			}
+			posix_spawn_file_actions_t actions;
+			posix_spawn_file_actions_init(&actions);
+			posix_spawn_file_actions_adddup2(&actions, ends[0], 0);
+			posix_spawn_file_actions_addclose(&actions, ends[0]);
+			posix_spawn_file_actions_addclose(&actions, ends[1]);
+			posix_spawn_file_actions_addopen(&actions, 1, name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			char gzip[] = "gzip";
+			char toStdout[] = "-c";
+			char* arguments[] = { gzip, toStdout, NULL };
+			int result = posix_spawnp(&child, "gzip", &actions, NULL, arguments, environ);
+			posix_spawn_file_actions_destroy(&actions);
+			::close(ends[0]);
+			if(result != 0)
+			{
+				::close(ends[1]);
+				child = -1;
+				error = string("Could not start gzip: ") + strerror(result);
+				return false;
+			}
+			fd = ends[1];
+			return true;
+		}
+
+		void separator()
+		{
+			if(column > 0) *cursor++ = ',';
+			if(format == EXPORT_JSON_LINES)
+			{
+				*cursor++ = '"';
+				cursor = copyText(cursor, names[column]);
+				*cursor++ = '"';
+				*cursor++ = ':';
+			}
+			column++;
+		}
+
+		// JSON text values are quoted; CSV values are written bare
+		void quote() { if(format == EXPORT_JSON_LINES) *cursor++ = '"'; }
+
+		static char* copyText(char* out, const char* text)
+		{
+			size_t length = strlen(text);
+			memcpy(out, text, length);
+			return out + length;
+		}
+
+		static char* writeNumber(char* out, uint64_t value)
+		{
+			char digits[20];
+			int count = 0;
+			do
+			{
+				digits[count++] = (char) ('0' + value % 10);
+				value /= 10;
+			} while(value > 0);
+			while(count > 0) *out++ = digits[--count];
+			return out;
+		}
+
+		// Data Members
+		string name;                   // Output file name
+		exportFormat format;           // CSV or JSON Lines
+		const char* const* names;      // Column names
+		size_t columns;                // Number of columns
+		int fd;                        // Output file, or pipe into gzip
+		pid_t child;                   // gzip process (-1 if not compressing)
+		vector<char> storage;          // Chunk pool (chunkCount * chunkSize bytes)
+		vector<size_t> lengths;        // Bytes used in each queued chunk
+		size_t current;                // Chunk being filled
+		size_t used;                   // Bytes used in the current chunk
+		vector<size_t> full;           // Chunks queued for the writer (ring)
+		size_t fullHead;               // First queued chunk in the ring
+		size_t fullCount;              // Chunks queued
+		vector<size_t> freeChunks;     // Chunks ready to be filled
+		mutex guard;                   // Protects the queues
+		condition_variable ready;      // Signals the writer
+		condition_variable released;   // Signals a free chunk
+		bool closing;                  // No more chunks will be queued
+		int failure;                   // errno of the first failed write (0 if none)
+		thread writer;                 // Background writer
+		uint64_t rowCount;             // Rows exported
+		uint64_t byteCount;            // Bytes handed to the writer (before compression)
+		uint64_t waitCount;            // Times the simulation waited for a free chunk
+		size_t column;                 // Fields written in the current row
+		char* cursor;                  // Write position in the current row
+};
+
+#else
+
+// Without POSIX files and processes, tables cannot be opened and rows are dropped
+enum exportFormat { EXPORT_CSV, EXPORT_JSON_LINES };
+
+class exportTable
+{
+	public:
+		// Member Functions
+		bool open(const string&, exportFormat, bool, const char* const*, size_t, string &error)
+		{
+			error = "Export needs a POSIX system (background writer, gzip)";
+			return false;
+		}
+		bool isOpen() const { return false; }
+		exportTable& begin() { return *this; }
+		template <class T> exportTable& field(T) { return *this; }
+		void end() {}
+		bool close(string&) { return true; }
+		uint64_t rows() const { return 0; }
+		uint64_t bytes() const { return 0; }
+		uint64_t waits() const { return 0; }
+};
+
+#endif
+
+/*
+The three tables a simulation exports, written as PREFIX.events, PREFIX.bindings and
+PREFIX.visitors (.csv or .jsonl, plus .gz when compressed). Times are in microseconds of
+network time.
+*/
+class recordExporter
+{
+	public:
+		// Member Functions
+		bool open(const string &prefix, exportFormat format, bool compress, string &error)
+		{
+			static const char* const eventColumns[] = { "time_us", "event", "mobile_node", "home_agent", "foreign_agent" };
+			static const char* const bindingColumns[] = { "time_us", "home_agent", "home_address", "care_of_address", "lifetime" };
+			static const char* const visitorColumns[] = { "time_us", "foreign_agent", "home_address", "home_agent", "mac", "lifetime" };
+			string suffix = string(format == EXPORT_CSV ? ".csv" : ".jsonl") + (compress ? ".gz" : "");
+			return events.open(prefix + ".events" + suffix, format, compress, eventColumns, 5, error) &&
+			       bindings.open(prefix + ".bindings" + suffix, format, compress, bindingColumns, 5, error) &&
+			       visitors.open(prefix + ".visitors" + suffix, format, compress, visitorColumns, 6, error);
+		}
+
+		// One protocol step (or timer) for a mobile node
+		void event(uint64_t time, const char* name, IPv4Addr mobile, IPv4Addr HA, IPv4Addr FA)
+		{
+			events.begin().field(time).field(name).field(mobile).field(HA).field(FA).end();
+		}
+
+		// One Mobility Binding Table entry of a home agent
+		void binding(uint64_t time, IPv4Addr HA, IPv4Addr home, IPv4Addr coa, int64_t lifetime)
+		{
+			bindings.begin().field(time).field(HA).field(home).field(coa).field(lifetime).end();
+		}
+
+		// One Visitor List entry of a foreign agent
+		void visitor(uint64_t time, IPv4Addr FA, IPv4Addr home, IPv4Addr HA, MacAddr MAC, int64_t lifetime)
+		{
+			visitors.begin().field(time).field(FA).field(home).field(HA).field(MAC).field(lifetime).end();
+		}
+
+		// Flushes and closes all three files, keeping the first error
+		bool close(string &error)
+		{
+			string problems[3];
+			bool closed[3] = { events.close(problems[0]), bindings.close(problems[1]), visitors.close(problems[2]) };
+			for(int i = 0; i < 3; i++)
+			{
+				if(closed[i]) continue;
+				error = problems[i];
+				return false;
+			}
+			return true;
+		}
+
+		// Totals over the three tables
+		uint64_t rows() const { return events.rows() + bindings.rows() + visitors.rows(); }
+		uint64_t bytes() const { return events.bytes() + bindings.bytes() + visitors.bytes(); }
+		uint64_t waits() const { return events.waits() + bindings.waits() + visitors.waits(); }
+
+	private:
+		// Data Members
+		exportTable events;    // Per-event protocol records
+		exportTable bindings;  // Binding-table rows
+		exportTable visitors;  // Visitor rows
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Preallocated pool of packet rings for smooth handoff. When a mobile node's link to its foreign
+agent is lost, the foreign agent takes a ring from the pool and holds the datagrams that keep
+arriving for it until the new foreign agent reports the new care-of-address. Then the held
+datagrams are flushed there and the ring is returned to the pool.
+
+All rings are carved out of one block allocated when the pool is configured, and free rings
+are chained in a free list, so acquiring, filling and releasing rings never allocates however
+many mobile nodes hand off at once. A full ring keeps its oldest datagrams and refuses new
+ones. With every ring taken, a departing mobile node gets none and its datagrams are lost.
+*/
+#ifndef HANDOFF_BUFFER_H
+#define HANDOFF_BUFFER_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "eventScheduler.h"
+#include "packetBuffer.h"
+
+using namespace std;
+
+class handoffBufferPool
+{
+	public:
+		// Returned by acquire when every ring is taken
+		static const uint32_t NONE = 0xFFFFFFFF;
+
+		// Constructor
+		handoffBufferPool() : depth(0), slotBytes(0), freeRings(NONE), inUse(0), clock(NULL) {}
+
+		// Member Functions
+		// Preallocates rings rings of ringDepth datagrams of up to packetBytes each (0 rings or
+		// depth turns buffering off). Held datagrams are stamped with the clock's time.
+		void configure(size_t rings, size_t ringDepth, size_t packetBytes)
+		{
+			depth = ringDepth;
+			slotBytes = packetBytes;
+			size_t count = depth == 0 ? 0 : rings;
+			storage.assign(count * depth * slotBytes, 0);
+			slots.assign(count * depth, heldPacket());
+			ringList.assign(count, ring());
+			freeRings = NONE;
+			for(size_t i = count; i-- > 0;)
+			{
+				ringList[i].next = freeRings;
+				freeRings = (uint32_t) i;
+			}
+			inUse = 0;
+		}
+
+		void attachClock(const eventScheduler* events) { clock = events; }
+
+		bool enabled() const { return !ringList.empty(); }
+		size_t ringsInUse() const { return inUse; }
+		size_t ringCount() const { return ringList.size(); }
+		size_t ringDepth() const { return depth; }
+
+		// Takes a free ring (NONE if every ring is taken)
+		uint32_t acquire()
+		{
+			if(freeRings == NONE) return NONE;
+			uint32_t id = freeRings;
+			freeRings = ringList[id].next;
+			ringList[id].head = 0;
+			ringList[id].count = 0;
+			ringList[id].next = NONE;
+			inUse++;
+			return id;
+		}
+
+		// Returns a ring to the pool, discarding anything still held. Returns the datagrams discarded.
+		size_t release(uint32_t id)
+		{
+			size_t discarded = ringList[id].count;
+			ringList[id].count = 0;
+			ringList[id].next = freeRings;
+			freeRings = id;
+			inUse--;
+			return discarded;
+		}
+
+		// Copies the packet into the ring. Returns false if the ring is full or the packet is
+		// larger than a slot.
+		bool hold(uint32_t id, const packetBuffer &packet)
+		{
+			ring &r = ringList[id];
+			if(r.count == depth || packet.length() > slotBytes) return false;
+			size_t slot = id * depth + (r.head + r.count) % depth;
+			memcpy(&storage[slot * slotBytes], packet.data(), packet.length());
+			slots[slot].length = (uint32_t) packet.length();
+			slots[slot].arrived = clock != NULL ? clock->now() : 0;
+			r.count++;
+			return true;
+		}
+
+		// Calls flush(packet, arrived) for each held datagram, oldest first, and empties the
+		// ring. packet is reused between calls.
+		template <class Flush>
+		size_t drain(uint32_t id, Flush flush)
+		{
+			ring &r = ringList[id];
+			size_t drained = r.count;
+			packetBuffer packet;
+			for(; r.count > 0; r.count--, r.head = (r.head + 1) % depth)
+			{
+				size_t slot = id * depth + r.head;
+				packet.reset();
+				memcpy(packet.append(slots[slot].length), &storage[slot * slotBytes], slots[slot].length);
+				flush(packet, slots[slot].arrived);
+			}
+			r.head = 0;
+			return drained;
+		}
+
+		// Snapshot support: the rings and their contents are saved and restored as blocks
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.value(depth);
+			out.value(slotBytes);
+			out.value(freeRings);
+			out.value(inUse);
+			out.array(storage);
+			out.array(slots);
+			out.array(ringList);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.value(depth) || !in.value(slotBytes) || !in.value(freeRings) || !in.value(inUse) ||
+			   !in.array(storage) || !in.array(slots) || !in.array(ringList))
+				return false;
+			if(slots.size() != ringList.size() * depth || storage.size() != slots.size() * slotBytes ||
+			   (freeRings != NONE && freeRings >= ringList.size()) || inUse > ringList.size())
+				return in.fail("handoff buffer pool is inconsistent");
+			return true;
+		}
+
+	private:
+		// One held datagram
+		struct heldPacket
+		{
+			heldPacket() : length(0), arrived(0) {}
+
+			uint32_t length;   // Bytes of the datagram
+			simTime arrived;   // When it reached the foreign agent
+		};
+
+		// One mobile node's ring (free rings are chained through next)
+		struct ring
+		{
+			ring() : head(0), count(0), next(NONE) {}
+
+			uint32_t head;   // Slot of the oldest datagram
+			uint32_t count;  // Datagrams held
+			uint32_t next;   // Next free ring
+		};
+
+		// Data Members
+		size_t depth;               // Datagrams per ring
+		size_t slotBytes;           // Largest datagram a slot holds
+		vector<uint8_t> storage;    // Datagram bytes of every slot
+		vector<heldPacket> slots;   // Length and arrival time of every slot
+		vector<ring> ringList;      // Rings by id
+		uint32_t freeRings;         // First free ring
+		size_t inUse;               // Rings taken
+		const eventScheduler* clock;// Time source for arrivals (NULL stamps 0; not saved)
+};
+
+#endif
@@ -0,0 +1,335 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Asynchronous logging for the simulator's narration. Protocol code writes to the stream
+returned by narrate(subsystem, level) exactly as it would write to cout. Each finished line
+(endl) becomes one record in a lock-free bounded ring buffer, and a background writer thread
+drains the ring to the terminal or a log file. The protocol code therefore never waits on
+console or file I/O. If the ring is full the record is dropped and counted instead of
+blocking. The writer reports drops.
+
+Messages are filtered by severity level and by subsystem before any formatting happens.
+Disabled messages go to a stream in the failed state, so each << costs only a state check.
+Code that prints large blocks (such as whole tables) should test logEnabled() first and skip
+the work. Setting the level to LOG_SILENT turns off all narration for benchmark runs.
+*/
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <iostream>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+using namespace std;
+
+// Severity levels, lowest first
+enum logLevel { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_SILENT };
+
+// Parts of the simulator that narrate
+enum logSubsystem { LOG_SIMULATION, LOG_DISCOVERY, LOG_REGISTRATION, LOG_ROUTING, LOG_TABLES, LOG_TIMERS, LOG_SUBSYSTEMS };
+
+/*
+Bounded multi-producer ring of fixed-size text records (Vyukov's sequence-numbered queue).
+Producers and the consumer claim cells with a single compare-and-swap and never lock.
+*/
+class logRing
+{
+	public:
+		// Longest text held by one record; longer lines are split over several records
+		static const size_t recordText = 244;
+
+		// Constructor
+		logRing(size_t capacity) : cells(new cell[capacity]), mask(capacity - 1), enqueuePos(0), dequeuePos(0)
+		{
+			for(size_t i = 0; i < capacity; i++) cells[i].sequence.store(i, memory_order_relaxed);
+		}
+
+		~logRing() { delete[] cells; }
+
+		// Member Functions
+		// Copies a record into the ring. Returns false if the ring is full.
+		bool push(const char* text, size_t length)
+		{
+			size_t pos = enqueuePos.load(memory_order_relaxed);
+			cell* c;
+			while(true)
+			{
+				c = &cells[pos & mask];
+				size_t sequence = c->sequence.load(memory_order_acquire);
+				intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+				if(diff == 0)
+				{
+					if(enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+				}
+				else if(diff < 0) return false;
+				else pos = enqueuePos.load(memory_order_relaxed);
+			}
+			c->length = (uint16_t) length;
+			memcpy(c->text, text, length);
+			c->sequence.store(pos + 1, memory_order_release);
+			return true;
+		}
+
+		// Removes the oldest record into text. Returns its length, or -1 if the ring is empty.
+		int pop(char* text)
+		{
+			size_t pos = dequeuePos.load(memory_order_relaxed);
+			cell* c;
+			while(true)
+			{
+				c = &cells[pos & mask];
+				size_t sequence = c->sequence.load(memory_order_acquire);
+				intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+				if(diff == 0)
+				{
+					if(dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+				}
+				else if(diff < 0) return -1;
+				else pos = dequeuePos.load(memory_order_relaxed);
+			}
+			int length = c->length;
+			memcpy(text, c->text, c->length);
+			c->sequence.store(pos + mask + 1, memory_order_release);
+			return length;
+		}
+
+	private:
+		// Ring cell
+		struct cell
+		{
+			atomic<size_t> sequence;  // Turn number of the cell
+			uint16_t length;          // Bytes of text
+			char text[recordText];    // Record text
+		};
+
+		// Data Members
+		cell* cells;                 // Ring storage (power of two cells)
+		size_t mask;                 // Capacity - 1
+		atomic<size_t> enqueuePos;   // Next cell to fill
+		atomic<size_t> dequeuePos;   // Next cell to drain
+};
+
+class logger
+{
+	public:
+		// Member Functions
+		static logger& instance()
+		{
+			static logger log;
+			return log;
+		}
+
+		bool enabled(logSubsystem subsystem, logLevel level) const
+		{
+			return level >= threshold[subsystem];
+		}
+
+		// Sets the lowest level shown for one subsystem, or for all of them
+		void setLevel(logLevel level)
+		{
+			for(int i = 0; i < LOG_SUBSYSTEMS; i++) threshold[i] = level;
+		}
+
+		void setLevel(logSubsystem subsystem, logLevel level) { threshold[subsystem] = level; }
+
+		// Sends narration to a file instead of the terminal. Returns false if it cannot be opened.
+		bool openFile(const char* fileName)
+		{
+			flush();
+			file.open(fileName);
+			if(!file.is_open()) return false;
+
+			// The writer thread is already running; it picks up the file with its next batch
+			sink.store(&file, memory_order_release);
+			return true;
+		}
+
+		// Queues one record. Never blocks; counts the record as dropped if the ring is full.
+		void write(const char* text, size_t length)
+		{
+			if(ring.push(text, length)) committed.fetch_add(1, memory_order_release);
+			else dropped.fetch_add(1, memory_order_relaxed);
+		}
+
+		// Waits until the writer has drained every queued record (used before prompting)
+		void flush()
+		{
+			uint64_t target = committed.load(memory_order_acquire);
+			while(written.load(memory_order_acquire) < target) this_thread::yield();
+		}
+
+	private:
+		// Constructor
+		logger() : ring(8192), sink(&cout), running(true), committed(0), written(0), dropped(0)
+		{
+			setLevel(LOG_INFO);
+			writer = thread(&logger::drain, this);
+		}
+
+		// Destructor: write out everything still queued before the program exits
+		~logger()
+		{
+			flush();
+			running.store(false);
+			writer.join();
+		}
+
+		logger(const logger&);
+		logger& operator=(const logger&);
+
+		// Writer thread
+		void drain()
+		{
+			char text[logRing::recordText];
+			uint64_t reportedDrops = 0;
+			while(true)
+			{
+				int length;
+				uint64_t batch = 0;
+				ostream* out = sink.load(memory_order_acquire);
+				while((length = ring.pop(text)) >= 0)
+				{
+					out->write(text, length);
+					batch++;
+				}
+
+				uint64_t drops = dropped.load(memory_order_relaxed);
+				if(drops != reportedDrops)
+				{
+					*out << "[log: " << drops - reportedDrops << " messages dropped]" << '\n';
+					reportedDrops = drops;
+				}
+
+				if(batch > 0)
+				{
+					out->flush();
+					written.fetch_add(batch, memory_order_release);
+				}
+				else if(!running.load()) break;
+				else this_thread::sleep_for(chrono::microseconds(200));
+			}
+			sink.load(memory_order_acquire)->flush();
+		}
+
+		// Data Members
+		logRing ring;                        // Records waiting for the writer
+		logLevel threshold[LOG_SUBSYSTEMS];  // Lowest level shown per subsystem
+		atomic<ostream*> sink;               // Terminal or log file (set by openFile while the writer runs)
+		ofstream file;                       // Log file, if one was opened
+		atomic<bool> running;                // Cleared to stop the writer
+		atomic<uint64_t> committed;          // Records queued so far
+		atomic<uint64_t> written;            // Records written so far
+		atomic<uint64_t> dropped;            // Records lost to a full ring
+		thread writer;                       // Background writer
+};
+
+/*
+Stream buffer that collects one line at a time and hands it to the logger. A line is
+committed when the stream is flushed (endl) or the buffer fills up.
+*/
+class logLineBuffer : public streambuf
+{
+	public:
+		// Constructor
+		logLineBuffer() { setp(line, line + logRing::recordText); }
+
+	protected:
+		// Buffer full: commit what is there and continue the line in a new record
+		int overflow(int c)
+		{
+			commit();
+			if(c != EOF)
+			{
+				*pptr() = (char) c;
+				pbump(1);
+			}
+			return c == EOF ? 0 : c;
+		}
+
+		int sync()
+		{
+			commit();
+			return 0;
+		}
+
+	private:
+		void commit()
+		{
+			if(pptr() > pbase()) logger::instance().write(pbase(), (size_t) (pptr() - pbase()));
+			setp(line, line + logRing::recordText);
+		}
+
+		// Data Members
+		char line[logRing::recordText];  // Line being built
+};
+
+// Stream used for enabled narration on this thread
+inline ostream& logStream()
+{
+	thread_local logLineBuffer buffer;
+	thread_local ostream stream(&buffer);
+	return stream;
+}
+
+// Stream in the failed state, used for disabled narration
+inline ostream& nullStream()
+{
+	thread_local ostream stream(NULL);
+	return stream;
+}
+
+inline bool logEnabled(logSubsystem subsystem, logLevel level = LOG_INFO)
+{
+	return logger::instance().enabled(subsystem, level);
+}
+
+// Returns the stream to narrate to for this subsystem and level
+inline ostream& narrate(logSubsystem subsystem, logLevel level = LOG_INFO)
+{
+	return logEnabled(subsystem, level) ? logStream() : nullStream();
+}
+
+inline void logFlush() { logger::instance().flush(); }
+
+// Reads a level name (debug, info, warning, error, silent)
+inline bool parseLogLevel(const string &name, logLevel &level)
+{
+	const char* names[] = { "debug", "info", "warning", "error", "silent" };
+	for(int i = 0; i <= LOG_SILENT; i++)
+	{
+		if(name == names[i])
+		{
+			level = (logLevel) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Reads a subsystem name (simulation, discovery, registration, routing, tables, timers)
+inline bool parseLogSubsystem(const string &name, logSubsystem &subsystem)
+{
+	const char* names[] = { "simulation", "discovery", "registration", "routing", "tables", "timers" };
+	for(int i = 0; i < LOG_SUBSYSTEMS; i++)
+	{
+		if(name == names[i])
+		{
+			subsystem = (logSubsystem) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif
@@ -14,65 +14,128 @@ Abstract: Mobile IP allows mobile devices to keep their same IP address when the
 // Header Files
 #include <iostream>
 #include <string>
-#include <list>
 #include <stdlib.h>
 #include <thread>
 #include <chrono>
 #include <fstream>
+#include <sstream>
+#include "address.h"
+#include "wireFormat.h"
+#include "packetBuffer.h"
+#include "timerWheel.h"
+#include "eventScheduler.h"
+#include "bindingTable.h"
+#include "bindingCache.h"
+#include "handoffBuffer.h"
+#include "careOfAddressPool.h"
+#include "registrationRelay.h"
+#include "randomStream.h"
+#include "mobilityModel.h"
+#include "addressIndex.h"
+#include "visitorTable.h"
+#include "benchmark.h"
+#include "allocationCounter.h"
+#include "logger.h"
+#include "registrationServer.h"
+#include "snapshot.h"
+#include "exporter.h"
+#include "metrics.h"
+#include "portability.h"
 
 using namespace std;
 
 // Global Variables
 const int sleepTime = 0;	// Sets amount of time between each simulator display message
+const simTime linkDelay = 5 * MILLISECOND;		// One-way delay of a message between two entities
+const simTime roundDuration = 60 * SECOND;		// Network time simulated by each interactive round
 
 // Enumerations
 enum ICMP_t { ADVERTISEMENT, SOLICITATION }; // advertisement is type 9, solicitation is type 10
 enum registration_t { REQUEST, REPLY };		 // registration message type
 enum routing_t { INDIRECT, DIRECT };     	 // datagram routing methods
 enum network { HOME, FOREIGN };			     // home network or foreign network
+enum expiry_t { BINDING_EXPIRY, VISITOR_EXPIRY, REREGISTRATION }; // lifetime timer types
+enum anchor_t { NO_ANCHOR, ANCHOR_CHAIN, ANCHOR_COMPRESSED }; // foreign anchor forwarding for direct routing
+enum event_t { DISCOVERY_EVENT, REGISTRATION_EVENT, ROUTING_EVENT, BINDING_UPDATE_EVENT, HANDOFF_EVENT, BUFFER_FLUSH_EVENT,
+              REGISTRATION_RELAY_EVENT, MOBILITY_EVENT }; // simulation event types
+
+// Timer key naming an agent and one of its mobile nodes
+inline uint64_t agentKey(IPv4Addr agent, IPv4Addr home) { return ((uint64_t) agent.toUint() << 32) | home.toUint(); }
 
 // Classes 
 /*
 The ICMP class is used during the agent discovery portion of mobile IP. Advertisements from
 home agents and foreign agents, along with the solicitation message from mobile nodes are
-ICMP messages
+ICMP messages. Advertised care-of-addresses are kept in a fixed array inside the message,
+filled from the back so the most recently inserted address comes first, so building an
+advertisement never allocates.
 */
 class ICMP
 {
 	public:
+		// As many care-of-addresses as the advertisement extension's length byte can describe
+		static const size_t maxCOAs = 62;
+
 		// Constructor
-		ICMP( ICMP_t t, string i, bool home, bool foreign, bool registration )
-			: type(t), IP(i), H(home), F(foreign), R(registration) {}
+		ICMP( ICMP_t t, IPv4Addr i, bool home, bool foreign, bool registration )
+			: type(t), IP(i), H(home), F(foreign), R(registration), firstCOA(maxCOAs) {}
+
+		// Builds the advertisement carried by a decoded agent advertisement
+		explicit ICMP( const advertisementView &view )
+			: type(ADVERTISEMENT), IP(view.routerCount() > 0 ? view.router(0) : IPv4Addr()),
+			  H(view.homeAgent()), F(view.foreignAgent()), R(view.registrationRequired()), firstCOA(maxCOAs)
+		{
+			for(size_t i = view.coaCount() < maxCOAs ? view.coaCount() : maxCOAs; i > 0; i--) insertCOA(view.coa(i - 1));
+		}
 
 		// Member Functions
-		void insertCOA(string careOfAddress)
+		// Adds a care-of-address in front of the others. Returns false if the message is full.
+		bool insertCOA(IPv4Addr careOfAddress)
+		{
+			if(firstCOA == 0) return false;
+			COA[--firstCOA] = careOfAddress;
+			return true;
+		}
+
+		// Takes the first care-of-address (unset if none are left)
+		IPv4Addr getCOA()
 		{
-			COA.push_front(careOfAddress);
+			return firstCOA < maxCOAs ? COA[firstCOA++] : IPv4Addr();
 		}
 
-		string getCOA()
+		size_t coaCount() const { return maxCOAs - firstCOA; }
+
+		// Writes the message in its ICMP wire format and returns its size (0 if it does not fit)
+		size_t encode(uint8_t* out, size_t capacity, uint16_t sequence = 0) const
 		{
-			string address = COA.front();
-			COA.pop_front();
-			return address;
+			if(type == SOLICITATION) return encodeSolicitation(out, capacity);
+			advertisementFields fields;
+			fields.agent = IP;
+			fields.sequence = sequence;
+			fields.flags = (uint8_t) ((R ? ADVERTISE_REGISTRATION_REQUIRED : 0) | (H ? ADVERTISE_HOME_AGENT : 0) |
+			                          (F ? ADVERTISE_FOREIGN_AGENT : 0));
+			return encodeAdvertisement(out, capacity, fields, COA + firstCOA, COA + maxCOAs);
 		}
 
 		void printICMP()
 		{
-			cout << "ICMP: Type(";
-			if(type == ADVERTISEMENT) cout << "9/ADVERTISEMENT";
-			else cout << "10/SOLICITATION";
-			cout << "), IP(" << IP << "), H(" << H << "), F(" << F << "), R(" << R << ")" << endl << endl;
+			ostream &out = narrate(LOG_DISCOVERY);
+
+			out << "ICMP: Type(";
+			if(type == ADVERTISEMENT) out << "9/ADVERTISEMENT";
+			else out << "10/SOLICITATION";
+			out << "), IP(" << IP << "), H(" << H << "), F(" << F << "), R(" << R << ")" << endl << endl;
 		}
 
 	private:
 		// Data members
 		ICMP_t type;		// ADVERTISEMENT or SOLICITATION
-		string IP;			// IP address
+		IPv4Addr IP;		// IP address
 		bool H;				// Home agent bit
 		bool F;				// Foreign agent bit
 		bool R;				// Registration required bit
-		list<string> COA;	// List of available Care-of-Addresses in foreign network
+		IPv4Addr COA[maxCOAs];	// Available Care-of-Addresses in foreign network (from firstCOA on)
+		size_t firstCOA;	// First Care-of-Address in use
 };
 
 /*
@@ -84,36 +147,51 @@ class registrationMessage
 {
    public:
 	    // Constructor
-		registrationMessage( registration_t type, string c, string h, string m, int l, int i )
+		registrationMessage( registration_t type, IPv4Addr c, IPv4Addr h, IPv4Addr m, int l, uint64_t i )
 			: registerType(type), COA(c), HAAddress(h), MNAddress(m), lifeTime(l), id(i) {}
 
+		// Builds the message carried by a decoded registration request or reply
+		explicit registrationMessage( const registrationView &view )
+			: registerType(view.isRequest() ? REQUEST : REPLY), COA(view.careOfAddress()), HAAddress(view.homeAgent()),
+			  MNAddress(view.homeAddress()), lifeTime(view.lifetime()), id(view.identification()) {}
+
 		// Member Functions
 		registration_t getRegisterType() { return registerType; }
-		string getCOA(){ return COA; }
-		string getHAAddress(){ return HAAddress; }
-		string getMNAddress(){ return MNAddress; }
+		IPv4Addr getCOA(){ return COA; }
+		IPv4Addr getHAAddress(){ return HAAddress; }
+		IPv4Addr getMNAddress(){ return MNAddress; }
 		int getLifetime(){ return lifeTime; }
-		int getID(){ return id; }
+		uint64_t getID(){ return id; }
+
+		// Writes the message as the UDP payload sent to or from port 434 and returns its size
+		size_t encode(uint8_t* out, size_t capacity) const
+		{
+			if(registerType == REQUEST)
+				return encodeRegistrationRequest(out, capacity, 0, (uint16_t) lifeTime, MNAddress, HAAddress, COA, id);
+			return encodeRegistrationReply(out, capacity, REGISTRATION_ACCEPTED, (uint16_t) lifeTime, MNAddress, HAAddress, id);
+		}
 
 		void printRegistration(bool encapsulation)
 		{			
-			cout << "Registration(";
-			if(registerType == REQUEST) cout << "Request): ";
-			else cout << "Reply): ";			
-			if(COA != "") cout << "COA(" << COA << "), ";
-			cout << "HA(" << HAAddress << "), MA(" << MNAddress << "), Lifetime(" << lifeTime << "), ID(" << id << ")";			
-			if(encapsulation) cout << ", [Encapsulation Format]";	
-			cout << endl << endl << endl;
+			ostream &out = narrate(LOG_REGISTRATION);
+
+			out << "Registration(";
+			if(registerType == REQUEST) out << "Request): ";
+			else out << "Reply): ";			
+			if(COA.isSet()) out << "COA(" << COA << "), ";
+			out << "HA(" << HAAddress << "), MA(" << MNAddress << "), Lifetime(" << lifeTime << "), ID(" << id << ")";			
+			if(encapsulation) out << ", [Encapsulation Format]";	
+			out << endl << endl << endl;
 		}
 
    private:
 	   // Data Members
    	   registration_t registerType; // REQUEST or REPLY
-	   string COA;					// Care-of-Address of mobile node in foreign network
-	   string HAAddress;			// Home agent address
-	   string MNAddress;			// Mobile node permanent address
+	   IPv4Addr COA;				// Care-of-Address of mobile node in foreign network
+	   IPv4Addr HAAddress;			// Home agent address
+	   IPv4Addr MNAddress;			// Mobile node permanent address
 	   int lifeTime;				// Lifetime of requested registration
-	   int id;						// 64-bit ID of message (Acts like sequence number to match REQUEST/REPLY)
+	   uint64_t id;					// 64-bit ID of message (Acts like sequence number to match REQUEST/REPLY)
 };
 
 /*
@@ -124,36 +202,88 @@ class mobileNode
 {
    public:
       // Constructor
-      mobileNode(string internetProtocol, string MACAddress) : IP (internetProtocol), MAC(MACAddress), COA("N/A") {}
+      mobileNode(IPv4Addr internetProtocol, MacAddr MACAddress, randomStream choices = randomStream())
+         : IP (internetProtocol), MAC(MACAddress), timers(NULL), reregistrationTimer(0), registrationDue(false), random(choices) {}
       
       // Member Functions
-      string getIP() { return IP; }
-      string getMAC() { return MAC; }
-	  void setCOA(string careOfAddress) { COA = careOfAddress; }
-	  string getCOA() { return COA; }
+      IPv4Addr getIP() { return IP; }
+      MacAddr getMAC() { return MAC; }
+	  void setCOA(IPv4Addr careOfAddress) { COA = careOfAddress; }
+	  IPv4Addr getCOA() { return COA; }
+	  void attachTimers(timerWheel* wheel) { timers = wheel; }
+	  bool isRegistrationDue() { return registrationDue; }
+	  void setRegistrationDue(bool due) { registrationDue = due; }
+	  randomStream& getRandom() { return random; }
+
+	  void scheduleReregistration(int lifetime)
+	  {
+		 // Re-register once 90% of the granted lifetime has passed, before the binding expires
+		 registrationDue = false;
+		 if(timers == NULL) return;
+		 timers->cancel(reregistrationTimer);
+		 uint64_t lead = (uint64_t) lifetime / 10 + 1;
+		 uint64_t deadline = timers->now() + ((uint64_t) lifetime > lead ? (uint64_t) lifetime - lead : 0);
+		 reregistrationTimer = timers->schedule(deadline, timerEvent(REREGISTRATION, IP.toUint()));
+	  }
       
    private:
       // Members
-      string IP;   // This is the permanent IP of the MN's home address 
-      string MAC;
-	  string COA;  // Care-of-Address/current location of mobile node
+      IPv4Addr IP;   // This is the permanent IP of the MN's home address 
+      MacAddr MAC;
+	  IPv4Addr COA;  // Care-of-Address/current location of mobile node (unset until registered)
+	  timerWheel* timers;          // Lifetime timers (NULL if lifetimes are not tracked)
+	  timerId reregistrationTimer; // Fires before the current registration expires
+	  bool registrationDue;        // Registration lifetime is about to run out
+	  randomStream random;         // Lifetimes, IDs, sequence numbers and moves of this mobile node
 };
 
 /*
-Correspondent node in this simulator is the entity communicating with the mobile node.
+Correspondent node in this simulator is the entity communicating with the mobile node. For
+direct routing it keeps a binding cache of the mobile nodes' care-of-addresses, filled by the
+home agent's answers and binding updates, so it does not have to query the home agent before
+every datagram. The cache is off (size 0) unless a scenario turns it on.
 */
 class correspondentNode
 {
 	public: 
 		// Constructor
-		correspondentNode(string internetProtocol) { IP = internetProtocol; }
+		correspondentNode(IPv4Addr internetProtocol) : timers(NULL) { IP = internetProtocol; }
 
 		// Member Functions
-		string getIP()  { return IP; }
+		IPv4Addr getIP()  { return IP; }
+		void attachTimers(timerWheel* wheel) { timers = wheel; }
+		void setCacheSize(size_t entries) { cache.resize(entries); }
+		bool cacheEnabled() { return cache.capacity() > 0; }
+		const bindingCacheStats& cacheStats() { return cache.stats(); }
+
+		// Cached care-of-address of a mobile node, if its binding has not run out
+		bool lookupBinding(IPv4Addr home, IPv4Addr &coa) { return cache.lookup(home, now(), coa); }
+
+		// Binding update from the home agent, valid for lifetime more seconds
+		void updateBinding(IPv4Addr home, IPv4Addr coa, int lifetime) { cache.update(home, coa, now(), (uint64_t) lifetime); }
+
+		// Binding invalidation from the home agent, or a tunnel that found the mobile node gone
+		bool invalidateBinding(IPv4Addr home) { return cache.invalidate(home); }
+
+		// Snapshot support: the address followed by the binding cache
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.value(IP);
+			cache.save(out);
+		}
+
+		template <class Reader>
+		bool load(Reader &in) { return in.value(IP) && cache.load(in); }
 
 	private:
+		// Member Functions
+		uint64_t now() { return timers != NULL ? timers->now() : 0; }
+
 		// Members
-		string IP;  // IP for the web server, etc.
+		IPv4Addr IP;         // IP for the web server, etc.
+		bindingCache cache;  // Care-of-addresses learned from home agents (LRU, size-bounded)
+		timerWheel* timers;  // Clock for binding lifetimes (NULL if lifetimes are not tracked)
 };
 
 /*
@@ -165,44 +295,133 @@ class homeAgent
 {
    public:
       // Constructor
-      homeAgent(string MN) { HAAddress = MN.replace(MN.find_last_of("."), 4, "." + to_string(rand() % 254 + 1)); }
+      homeAgent(IPv4Addr MN) : timers(NULL)
+      {
+         // Any host of the mobile node's /24 other than the mobile node itself
+         uint32_t host = threadRandom().between(1, 253);
+         if(host >= (MN.toUint() & 0xFF) && (MN.toUint() & 0xFF) != 0) host++;
+         HAAddress = IPv4Addr((MN.toUint() & 0xFFFFFF00) | host);
+      }
+      homeAgent() : timers(NULL) {}  // Filled in by load()
       
       // Member Functions
-      string getHA() { return HAAddress; }
+      IPv4Addr getHA() { return HAAddress; }
+      void attachTimers(timerWheel* wheel) { timers = wheel; }
+
+      void addEntry(IPv4Addr home, IPv4Addr coa, int time)
+      {
+         // Add new binding entry to Mobility Binding Table, or update the existing
+         // binding in place if the mobile node is re-registering
+         bindingEntry* entry = bindingTable.insert(home, coa, time);
+
+         // Restart the binding's lifetime
+         if(timers != NULL)
+         {
+            timers->cancel(entry->timer);
+            entry->timer = timers->schedule(timers->now() + (uint64_t) time, timerEvent(BINDING_EXPIRY, agentKey(HAAddress, home)));
+         }
+      }
+
+      void addEntries(const bindingRequest* requests, size_t count)
+      {
+         // Batched registration: add or update every binding in one pass over the Mobility
+         // Binding Table, then restart each binding's lifetime
+         batchEntries.resize(count);
+         bindingTable.insertBatch(requests, count, batchEntries.data());
+         if(timers == NULL) return;
+         for(size_t i = 0; i < count; i++)
+         {
+            timers->cancel(batchEntries[i]->timer);
+            batchEntries[i]->timer = timers->schedule(timers->now() + (uint64_t) requests[i].lifetime,
+               timerEvent(BINDING_EXPIRY, agentKey(HAAddress, requests[i].homeAddress)));
+         }
+      }
+
+      bool removeEntry(IPv4Addr home)
+      {
+         // Deregistration: remove mobile node's binding from Mobility Binding Table
+         bindingEntry* entry = bindingTable.find(home);
+         if(entry == NULL) return false;
+         if(timers != NULL) timers->cancel(entry->timer);
+         return bindingTable.erase(home);
+      }
+
+      bool expireEntry(IPv4Addr home)
+      {
+         // Lifetime ran out: remove binding from Mobility Binding Table
+         if(!bindingTable.erase(home)) return false;
+         narrate(LOG_TIMERS) << "Home Agent: Binding for Mobile Node " << home << " expired, removed from Mobility Binding Table" << endl;
+         return true;
+      }
+
+      bool lookupCOA(IPv4Addr home, IPv4Addr &coa)
+      {
+         // Find mobile node's care-of-address in Mobility Binding Table
+         const bindingEntry* entry = bindingTable.find(home);
+         if(entry == NULL) return false;
+         coa = entry->COA;
+         return true;
+      }
+
+      bool queryBinding(IPv4Addr home, IPv4Addr correspondent, IPv4Addr &coa, int &lifetime)
+      {
+         // Answer a correspondent's query and remember it, so binding updates are sent to it
+         // when the mobile node moves or the binding ends
+         bindingEntry* entry = bindingTable.find(home);
+         if(entry == NULL) return false;
+         entry->correspondent = correspondent;
+         coa = entry->COA;
+         lifetime = remainingLifetime(entry->lifetime, entry->timer);
+         return true;
+      }
+
+      IPv4Addr subscriberOf(IPv4Addr home)
+      {
+         // Correspondent caching the mobile node's binding (unset if none)
+         const bindingEntry* entry = bindingTable.find(home);
+         return entry != NULL ? entry->correspondent : IPv4Addr();
+      }
+
+      size_t bindingCount() { return bindingTable.size(); }
 
-      void addEntry(string home, string coa, int time)
+      // Snapshot support: the address followed by the Mobility Binding Table
+      template <class Writer>
+      void save(Writer &out) const
       {
-         // Add new binding entry to Mobility Binding Table
-         bindingEntry temp(home, coa, time);
-         bindingTable.push_front(temp);
+         out.value(HAAddress);
+         bindingTable.save(out);
       }
 
+      template <class Reader>
+      bool load(Reader &in) { return in.value(HAAddress) && bindingTable.load(in); }
+
       void printEntries()
       {
+         if(!logEnabled(LOG_TABLES)) return;
+         ostream &out = narrate(LOG_TABLES);
+
          // Print Binding Table title
-         cout << "-----------------------------------------------------";
-         cout << endl;
-         cout << "               Mobility Binding Table                ";
-         cout << endl;
-         cout << "-----------------------------------------------------";
-         cout << endl;
-         cout << "|  Home Address   | Care-of-Address | Lifetime(sec) |";
-         cout << endl;
-         cout << "-----------------------------------------------------";
-         cout << endl;
+         out << "-----------------------------------------------------";
+         out << endl;
+         out << "               Mobility Binding Table                ";
+         out << endl;
+         out << "-----------------------------------------------------";
+         out << endl;
+         out << "|  Home Address   | Care-of-Address | Lifetime(sec) |";
+         out << endl;
+         out << "-----------------------------------------------------";
+         out << endl;
                   
          // Iterate through Mobility Binding Table and print each entry
-         std::list<bindingEntry>::const_iterator iterator;
-         for(iterator = bindingTable.begin(); 
-                              iterator != bindingTable.end(); ++iterator)
+         bindingTable.forEach([this, &out](const bindingEntry &entry)
          {
-             cout << "| " << (*iterator).homeAddress;
-             printSpaceAndBar((*iterator).homeAddress);
-             cout << (*iterator).COA;
-             printSpaceAndBar((*iterator).COA);
-             printLifeTime((*iterator).lifetime);
-             cout << " |" << endl;             
-         }
+             out << "| " << entry.homeAddress;
+             printSpaceAndBar(out, entry.homeAddress);
+             out << entry.COA;
+             printSpaceAndBar(out, entry.COA);
+             printLifeTime(out, remainingLifetime(entry.lifetime, entry.timer));
+             out << " |" << endl;             
+         });
       }
 
       void outputEntries(ofstream &fout)
@@ -214,39 +433,39 @@ class homeAgent
 		 if(bindingTable.empty()) fout << "\t <NO ENTRIES>" << endl;
 
          // Iterate through Mobility Binding Table and print each entry
-         std::list<bindingEntry>::const_iterator iterator;
-         for(iterator = bindingTable.begin(); 
-                              iterator != bindingTable.end(); ++iterator)
+         bindingTable.forEach([this, &fout](const bindingEntry &entry)
          {
-             fout << "\t <MN: " << (*iterator).homeAddress;
-             fout << ", COA: " << (*iterator).COA;
-             fout << ", Lifetime: " << (*iterator).lifetime << ">" << endl;
-         }
+             fout << "\t <MN: " << entry.homeAddress;
+             fout << ", COA: " << entry.COA;
+             fout << ", Lifetime: " << remainingLifetime(entry.lifetime, entry.timer) << ">" << endl;
+         });
       }
 
-   private:
-      // Mobility Binding Table entries
-      class bindingEntry
+      void exportEntries(recordExporter &out, simTime time)
       {
-         public:
-            // Constructor
-            bindingEntry(string home, string careOfAddress, int time)
-                  :homeAddress(home), COA(careOfAddress), lifetime(time) {}
-          
-            // Members
-            string homeAddress;  // Home address of a mobility node
-            string COA;          // Care-of-Address of a mobility node
-            int lifetime;        // Lifetime of the entry in seconds
-      };
+         // Stream every binding as one row
+         bindingTable.forEach([this, &out, time](const bindingEntry &entry)
+         {
+             out.binding(time, HAAddress, entry.homeAddress, entry.COA, remainingLifetime(entry.lifetime, entry.timer));
+         });
+      }
 
+   private:
       // Member Functions
-      void printSpaceAndBar(string IP)
+      void printSpaceAndBar(ostream &out, IPv4Addr IP)
       {
-		for (unsigned i = 0; i < (15 - IP.length()); i++) cout << " ";
-		cout << " | ";
+		for (unsigned i = 0; i < (IPv4Addr::maxLength - IP.length()); i++) out << " ";
+		out << " | ";
       }
        
-      void printLifeTime(int val)
+      int remainingLifetime(int lifetime, timerId timer)
+      {
+         // Seconds left on the entry's lifetime, or the granted lifetime if untracked
+         if(timers == NULL) return lifetime;
+         return (int) timers->remaining(timer);
+      }
+
+      void printLifeTime(ostream &out, int val)
       {
 		int leftSpace = 6;
 		int rightSpace = 6;
@@ -261,14 +480,16 @@ class homeAgent
 			v /= 10;
  		}
 
-		for (int i = 0; i < leftSpace; i++)	cout << " ";
-		cout << val;
- 		for (int i = 0; i < rightSpace; i++) cout << " ";
+		for (int i = 0; i < leftSpace; i++)	out << " ";
+		out << val;
+ 		for (int i = 0; i < rightSpace; i++) out << " ";
 	 }
 
       // Data Members
-      string HAAddress;                // Home Agent address
-      list<bindingEntry> bindingTable; // Mobility Binding Table     
+      IPv4Addr HAAddress;                // Home Agent address
+      mobilityBindingTable bindingTable; // Mobility Binding Table (hashed on home address)
+      timerWheel* timers;                // Lifetime timers (NULL if lifetimes are not tracked)
+      vector<bindingEntry*> batchEntries;// Entries of the batch being applied (scratch, not saved)
 };
 
 /*
@@ -280,47 +501,170 @@ class foreignAgent
 {
    public:
       // Constructor
-      foreignAgent(string FA) { FAAddress = FA; }
+      foreignAgent(IPv4Addr FA) : timers(NULL), buffers(NULL) { FAAddress = FA; }
          
       // Member Functions
-      string getFA() { return FAAddress; }         
+      IPv4Addr getFA() { return FAAddress; }         
+      void attachTimers(timerWheel* wheel) { timers = wheel; }
+      void attachBuffers(handoffBufferPool* pool) { buffers = pool; }
+
+      void addEntry(IPv4Addr home, IPv4Addr HA, MacAddr MAC, int time)
+      {
+         // Add new visitor entry to Visitor List, or update the existing entry in
+         // place if the mobile node is re-registering (or has come back)
+         forgetDeparture(home);
+         visitorEntry* entry = visitorList.insert(home, HA, MAC, time);
+
+         // Restart the entry's lifetime
+         if(timers != NULL)
+         {
+            timers->cancel(entry->timer);
+            entry->timer = timers->schedule(timers->now() + (uint64_t) time, timerEvent(VISITOR_EXPIRY, agentKey(FAAddress, home)));
+         }
+      }
+
+      bool expireEntry(IPv4Addr home, timerId timer)
+      {
+         // Lifetime ran out: remove the visitor entry owning this timer and return its
+         // care-of-address to the pool
+         const visitorEntry* entry = visitorList.find(home);
+         if(entry == NULL || entry->timer != timer) return false;
+         forgetDeparture(home);
+         releaseCOA(home);
+         visitorList.erase(home);
+         narrate(LOG_TIMERS) << "Foreign Agent: Visitor entry for Mobile Node " << home << " expired, removed from Visitor List" << endl;
+         return true;
+      }
+
+      // Co-located care-of-addresses: the agent hands out addresses from a block of size
+      // addresses starting at base (size 0 keeps using its own address for every visitor)
+      void setCOAPool(IPv4Addr base, size_t size) { coaPool.configure(base, size); }
+      const careOfAddressPool& getCOAPool() { return coaPool; }
+
+      // Care-of-address for a registering mobile node: the one it already holds here, a free
+      // one from the pool, or the agent's own address if the pool is off or exhausted. The
+      // address stays the visitor's until its entry expires.
+      IPv4Addr assignCOA(IPv4Addr home)
+      {
+         uint32_t owner = coaOwners.size() > 0 ? coaOwners.find(home.toUint()) : addressIndex::NONE;
+         if(owner != addressIndex::NONE) return IPv4Addr(owner);
+         IPv4Addr coa;
+         if(!coaPool.allocate(coa)) return FAAddress;
+         coaOwners.insert(home.toUint(), coa.toUint());
+         return coa;
+      }
+
+      // True if the agent answers for this address: its own or one from its pool
+      bool servesAddress(IPv4Addr address) { return address == FAAddress || coaPool.owns(address); }
+
+      // Forwarding pointers to where departed visitors went, for anchored direct routing. At
+      // most limit pointers are kept (0 keeps none); the least recently used is dropped first.
+      void setForwardingLimit(size_t limit) { forwardingPointers.resize(limit); }
+      size_t forwardingPointerCount() { return forwardingPointers.size(); }
+
+      void addForwardingPointer(IPv4Addr home, IPv4Addr next, uint64_t lifetime)
+      {
+         forwardingPointers.update(home, next, timers != NULL ? timers->now() : 0, lifetime);
+      }
+
+      bool removeForwardingPointer(IPv4Addr home) { return forwardingPointers.invalidate(home); }
+
+      // Care-of-address a datagram for the mobile node is forwarded to, if the pointer has not run out
+      bool nextHop(IPv4Addr home, IPv4Addr &next)
+      {
+         return forwardingPointers.lookup(home, timers != NULL ? timers->now() : 0, next);
+      }
+
+      // Smooth handoff: when a visitor's link is lost the foreign agent marks it as departed and,
+      // if the buffer pool has a ring free, holds the datagrams that still arrive for it until
+      // the new foreign agent reports the new care-of-address
+      void visitorLeft(IPv4Addr home)
+      {
+         if(visitorList.find(home) == NULL || departures.contains(home.toUint())) return;
+         uint32_t ring = buffers != NULL ? buffers->acquire() : handoffBufferPool::NONE;
+         departures.insert(home.toUint(), ring == handoffBufferPool::NONE ? NO_RING : ring);
+      }
+
+      bool hasLeft(IPv4Addr home) { return departures.size() > 0 && departures.contains(home.toUint()); }
+
+      // Holds a datagram for a departed visitor. Returns false if it has no ring or the ring is full.
+      bool holdDatagram(IPv4Addr home, const packetBuffer &packet)
+      {
+         uint32_t ring = departures.find(home.toUint());
+         return ring != addressIndex::NONE && ring != NO_RING && buffers->hold(ring, packet);
+      }
+
+      // Hands each datagram held for a departed visitor to flush(packet, arrived), oldest first,
+      // and returns its ring to the pool. Datagrams arriving later are lost.
+      template <class Flush>
+      size_t flushHeld(IPv4Addr home, Flush flush)
+      {
+         uint32_t ring = departures.find(home.toUint());
+         if(ring == addressIndex::NONE || ring == NO_RING) return 0;
+         departures.insert(home.toUint(), NO_RING);
+         size_t flushed = buffers->drain(ring, flush);
+         buffers->release(ring);
+         return flushed;
+      }
+
+      // Finds the visitor with this home address (NULL if none)
+      const visitorEntry* findVisitor(IPv4Addr home) { return visitorList.find(home); }
+
+      // Finds the visitor using this link-layer address (NULL if none)
+      const visitorEntry* findVisitorByMAC(MacAddr MAC) { return visitorList.findByMAC(MAC); }
+
+      size_t visitorCount() { return visitorList.size(); }
+
+      // Snapshot support: the address followed by the Visitor List, forwarding pointers,
+      // departures and care-of-address pool
+      template <class Writer>
+      void save(Writer &out) const
+      {
+         out.value(FAAddress);
+         visitorList.save(out);
+         forwardingPointers.save(out);
+         departures.save(out);
+         coaPool.save(out);
+         coaOwners.save(out);
+      }
 
-      void addEntry(string home, string HA, string MAC, int time)
+      template <class Reader>
+      bool load(Reader &in)
       {
-         // Add new binding entry to Mobility Binding Table
-         visitorEntry temp(home, HA, MAC, time);
-         visitorList.push_front(temp);
+         return in.value(FAAddress) && visitorList.load(in) && forwardingPointers.load(in) && departures.load(in) &&
+                coaPool.load(in) && coaOwners.load(in);
       }
 
       void printEntries()
       {
+         if(!logEnabled(LOG_TABLES)) return;
+         ostream &out = narrate(LOG_TABLES);
+
          // Print Binding Table title
-         cout << "-------------------------------------------------------------------------";
-         cout << endl;
-         cout << "                              Visitor List                               ";
-         cout << endl;
-         cout << "-------------------------------------------------------------------------";
-         cout << endl;
-         cout << "|  Home Address   |   Home Agent    |   Media Address   | Lifetime(sec) |";
-         cout << endl;
-         cout << "|                 |     Address     |                   |               |";
-         cout << endl;
-         cout << "-------------------------------------------------------------------------";
-         cout << endl;
+         out << "-------------------------------------------------------------------------";
+         out << endl;
+         out << "                              Visitor List                               ";
+         out << endl;
+         out << "-------------------------------------------------------------------------";
+         out << endl;
+         out << "|  Home Address   |   Home Agent    |   Media Address   | Lifetime(sec) |";
+         out << endl;
+         out << "|                 |     Address     |                   |               |";
+         out << endl;
+         out << "-------------------------------------------------------------------------";
+         out << endl;
                   
-         // Iterate through Mobility Binding Table and print each entry
-         std::list<visitorEntry>::const_iterator iterator;
-         for(iterator = visitorList.begin(); 
-                              iterator != visitorList.end(); ++iterator)
+         // Iterate through Visitor List and print each entry
+         visitorList.forEach([this, &out](const visitorEntry &entry)
          {
-             cout << "| " << (*iterator).homeAddress;
-             printSpaceAndBar((*iterator).homeAddress);
-             cout << (*iterator).HAAddress;
-             printSpaceAndBar((*iterator).HAAddress);
-             cout << (*iterator).mediaAddress << " | ";
-             printLifeTime((*iterator).lifetime);
-             cout << " |" << endl;
-         }
+             out << "| " << entry.homeAddress;
+             printSpaceAndBar(out, entry.homeAddress);
+             out << entry.HAAddress;
+             printSpaceAndBar(out, entry.HAAddress);
+             out << entry.mediaAddress << " | ";
+             printLifeTime(out, remainingLifetime(entry.lifetime, entry.timer));
+             out << " |" << endl;
+         });
       }
 
       void outputEntries(ofstream &fout)
@@ -331,43 +675,64 @@ class foreignAgent
 		 // If binding table empty, display message
 		 if(visitorList.empty()) fout << "\t <NO ENTRIES>" << endl;
 
-         // Iterate through Mobility Binding Table and print each entry
-         std::list<visitorEntry>::const_iterator iterator;
-         for(iterator = visitorList.begin(); 
-                              iterator != visitorList.end(); ++iterator)
+         // Iterate through Visitor List and print each entry
+         visitorList.forEach([this, &fout](const visitorEntry &entry)
          {
-             fout << "\t <MN: " << (*iterator).homeAddress;
-             fout << ", HA: " << (*iterator).HAAddress;
-			 fout << ", MAC: " << (*iterator).mediaAddress;
-             fout << ", Lifetime: " << (*iterator).lifetime << ">" << endl;
-         }
+             fout << "\t <MN: " << entry.homeAddress;
+             fout << ", HA: " << entry.HAAddress;
+			 fout << ", MAC: " << entry.mediaAddress;
+             fout << ", Lifetime: " << remainingLifetime(entry.lifetime, entry.timer) << ">" << endl;
+         });
       }
 
-   private:
-      // Visitor List entries
-      class visitorEntry
+      void exportEntries(recordExporter &out, simTime time)
       {
-         public:
-            // Constructor
-            visitorEntry(string home, string HA, string MAC, int time)
-                  :homeAddress(home), HAAddress(HA), mediaAddress(MAC),
-                                                          lifetime(time){}
-                                                          
-            // Members
-            string homeAddress;  // Home address of a mobility node
-            string HAAddress;    // Home agent address
-            string mediaAddress; // MAC address
-            int lifetime;        // Lifetime of the entry in seconds
-      };
-      
+         // Stream every visitor entry as one row
+         visitorList.forEach([this, &out, time](const visitorEntry &entry)
+         {
+             out.visitor(time, FAAddress, entry.homeAddress, entry.HAAddress, entry.mediaAddress, remainingLifetime(entry.lifetime, entry.timer));
+         });
+      }
+
+   private:
+      // Departed visitor with no ring
+      static const uint32_t NO_RING = 0xFFFFFFFE;
+
       // Member Functions
-      void printSpaceAndBar(string IP)
+      void printSpaceAndBar(ostream &out, IPv4Addr IP)
       {
-		for (unsigned i = 0; i < (15 - IP.length()); i++) cout << " ";
-		cout << " | ";
+		for (unsigned i = 0; i < (IPv4Addr::maxLength - IP.length()); i++) out << " ";
+		out << " | ";
       }
       
-      void printLifeTime(int val)
+      int remainingLifetime(int lifetime, timerId timer)
+      {
+         // Seconds left on the entry's lifetime, or the granted lifetime if untracked
+         if(timers == NULL) return lifetime;
+         return (int) timers->remaining(timer);
+      }
+
+      void releaseCOA(IPv4Addr home)
+      {
+         uint32_t owner = coaOwners.size() > 0 ? coaOwners.find(home.toUint()) : addressIndex::NONE;
+         if(owner == addressIndex::NONE) return;
+         coaOwners.erase(home.toUint());
+         coaPool.release(IPv4Addr(owner));
+      }
+
+      void forgetDeparture(IPv4Addr home)
+      {
+         // Visitor came back or its entry ran out: anything still held for it is lost
+         uint32_t ring = departures.find(home.toUint());
+         if(ring == addressIndex::NONE) return;
+         departures.erase(home.toUint());
+         if(ring == NO_RING) return;
+         size_t discarded = buffers->release(ring);
+         protocolMetrics::instance().count(COUNT_HANDOFF_LOST, discarded);
+         protocolMetrics::instance().count(COUNT_DATAGRAMS_DROPPED, discarded);
+      }
+
+      void printLifeTime(ostream &out, int val)
       {
 		int leftSpace = 6;
 		int rightSpace = 6;
@@ -382,14 +747,20 @@ class foreignAgent
 			v /= 10;
  		}
 
-		for (int i = 0; i < leftSpace; i++)	cout << " ";
-		cout << val;
- 		for (int i = 0; i < rightSpace; i++) cout << " ";
+		for (int i = 0; i < leftSpace; i++)	out << " ";
+		out << val;
+ 		for (int i = 0; i < rightSpace; i++) out << " ";
 	  }
       
       // Data Members
-      string FAAddress;               // Foreign Agent address
-      list<visitorEntry> visitorList; // Visitor List           
+      IPv4Addr FAAddress;             // Foreign Agent address
+      visitorTable visitorList;       // Visitor List (indexed on home address and MAC)
+      bindingCache forwardingPointers;// Home address -> care-of-address departed visitors moved to
+      addressIndex departures;        // Home address of departed visitors -> buffer ring (or NO_RING)
+      careOfAddressPool coaPool;      // Co-located care-of-addresses handed to visitors
+      addressIndex coaOwners;         // Home address -> care-of-address from the pool
+      timerWheel* timers;             // Lifetime timers (NULL if lifetimes are not tracked)
+      handoffBufferPool* buffers;     // Rings for departed visitors' datagrams (NULL buffers none)
 };
 
 /*
@@ -405,164 +776,1923 @@ class datagram
 {
    public:
       // Constructor
-      datagram(string src, string dest, int i)
+      datagram(IPv4Addr src, IPv4Addr dest, int i)
                : source(src), destination(dest), sequenceNumber(i) {}
+
+      // Builds the datagram carried by a decoded IPv4/UDP packet
+      explicit datagram(const datagramView &view)
+               : source(view.source()), destination(view.destination()), sequenceNumber((int) view.sequenceNumber()) {}
                
       // Member Functions
-      string getSrc() { return source; }
-      string getDest() { return destination; }
+      IPv4Addr getSrc() { return source; }
+      IPv4Addr getDest() { return destination; }
+
+      // Writes the datagram as an IPv4/UDP packet and returns its size (0 if it does not fit)
+      size_t encode(uint8_t* out, size_t capacity) const
+      {
+         return encodeDatagram(out, capacity, source, destination, (uint32_t) sequenceNumber);
+      }
 
-      void print(bool encapsulated, string encapDestination) 
+      void print(bool encapsulated, IPv4Addr encapDestination) 
 	  {
-		  if(encapsulated) cout << "[ENCAPSULATED Destination(" << encapDestination << ")] ";
-		  cout << "Datagram(" << sequenceNumber << "): Source(" << source;
-		  cout << "), Destination(" << destination << ")" << endl << endl << endl;
+		  ostream &out = narrate(LOG_ROUTING);
+
+		  if(encapsulated) out << "[ENCAPSULATED Destination(" << encapDestination << ")] ";
+		  out << "Datagram(" << sequenceNumber << "): Source(" << source;
+		  out << "), Destination(" << destination << ")" << endl << endl << endl;
 	  }	
 
    private:
       // Members
-      string source;		   // Source address
-      string destination;      // Destination address
+      IPv4Addr source;		   // Source address
+      IPv4Addr destination;    // Destination address
       int sequenceNumber;	   // Identification number of the datagram      
 };
 
-// Function Prototype Declarations
-void Sleep(int);
-string generateIP();
-string generateMAC();
-void configuration(ICMP_t&, routing_t&, network&);
-void displayInformation(mobileNode, homeAgent, foreignAgent);
-void agentDiscovery(mobileNode, homeAgent, foreignAgent, network, ICMP_t);
-void registerMN(mobileNode&, homeAgent&, foreignAgent&);
-void indirectRouting(mobileNode, homeAgent, foreignAgent, correspondentNode);
-void directRouting(mobileNode, homeAgent, foreignAgent, correspondentNode);
-void outputDatabase(mobileNode, homeAgent, foreignAgent, correspondentNode);
+/*
+The topology is the registry of every simulated entity. Mobile nodes, home agents, foreign
+agents and correspondent nodes are each kept in one contiguous array and referred to by
+handle (their index), which stays valid as the arrays grow. Every address is indexed, so
+discovery, registration and datagrams can be routed to the right entity by address. Each
+mobile node also records its home agent, the foreign agent it is visiting (NONE while it is at
+home) and the correspondent node it talks to. For anchored direct routing it also records the
+session's anchor foreign agent and the handoffs made since the anchor was chosen, and for any
+handoff the foreign agent it left. Foreign agents with a care-of-address pool each own one
+aligned block of addresses of the same size, indexed by its first address, so the agent
+answering for any care-of-address is found with one lookup.
+*/
+class topology
+{
+   public:
+      // Handle meaning "no entity"
+      static const uint32_t NONE = 0xFFFFFFFF;
 
-// Main Simulation
-int main()
+      // Constructor
+      topology(timerWheel* wheel = NULL, handoffBufferPool* pool = NULL) : timers(wheel), buffers(pool), coaPoolSize(0), coaBlockBits(0) {}
+
+      // Member Functions
+      void reserve(size_t mobiles, size_t homes, size_t foreigns, size_t correspondents)
+      {
+         mobileNodes.reserve(mobiles);
+         links.reserve(mobiles);
+         homeAgents.reserve(homes);
+         foreignAgents.reserve(foreigns);
+         correspondentNodes.reserve(correspondents);
+         mobileIndex.reserve(mobiles);
+         homeIndex.reserve(homes);
+         foreignIndex.reserve(foreigns);
+         correspondentIndex.reserve(correspondents);
+      }
+
+      bool addressInUse(IPv4Addr address)
+      {
+         uint64_t key = address.toUint();
+         return key == 0 || mobileIndex.contains(key) || homeIndex.contains(key) ||
+                foreignIndex.contains(key) || correspondentIndex.contains(key) ||
+                (coaBlockBits > 0 && coaBlocks.contains(blockOf(address).toUint()));
+      }
+
+      // Care-of-address pools: every foreign agent given a block gets size addresses, in a
+      // block aligned to the next power of two. Set before the first block is handed out.
+      void setCOAPoolSize(size_t size)
+      {
+         coaPoolSize = size;
+         coaBlockBits = 0;
+         while(size > 0 && ((size_t) 1 << coaBlockBits) < size) coaBlockBits++;
+         if(size > 0 && coaBlockBits == 0) coaBlockBits = 1;
+      }
+
+      // First address of the block containing address
+      IPv4Addr blockOf(IPv4Addr address) { return IPv4Addr(address.toUint() & ~(((uint32_t) 1 << coaBlockBits) - 1)); }
+
+      // True if the block starting at base overlaps another block or any entity's address
+      bool blockInUse(IPv4Addr base)
+      {
+         if(base.toUint() == 0 || coaBlocks.contains(base.toUint())) return true;
+         for(uint32_t i = 0; i < ((uint32_t) 1 << coaBlockBits); i++)
+            if(addressInUse(IPv4Addr(base.toUint() + i))) return true;
+         return false;
+      }
+
+      // Hands the block starting at base to a foreign agent as its care-of-address pool
+      void setCOABlock(uint32_t foreign, IPv4Addr base)
+      {
+         coaBlocks.insert(base.toUint(), foreign);
+         foreignAgents[foreign].setCOAPool(base, coaPoolSize);
+      }
+
+      // Adds a home agent on the mobile node home network that contains homeNetwork
+      uint32_t addHomeAgent(IPv4Addr homeNetwork)
+      {
+         homeAgent agent(homeNetwork);
+         while(addressInUse(agent.getHA()) || agent.getHA() == homeNetwork) agent = homeAgent(homeNetwork);
+         agent.attachTimers(timers);
+         homeIndex.insert(agent.getHA().toUint(), (uint32_t) homeAgents.size());
+         homeAgents.push_back(agent);
+         return (uint32_t) (homeAgents.size() - 1);
+      }
+
+      uint32_t addForeignAgent(IPv4Addr address)
+      {
+         foreignAgent agent(address);
+         agent.attachTimers(timers);
+         agent.attachBuffers(buffers);
+         foreignIndex.insert(address.toUint(), (uint32_t) foreignAgents.size());
+         foreignAgents.push_back(agent);
+         return (uint32_t) (foreignAgents.size() - 1);
+      }
+
+      uint32_t addCorrespondent(IPv4Addr address)
+      {
+         correspondentNode node(address);
+         node.attachTimers(timers);
+         correspondentIndex.insert(address.toUint(), (uint32_t) correspondentNodes.size());
+         correspondentNodes.push_back(node);
+         return (uint32_t) (correspondentNodes.size() - 1);
+      }
+
+      // Adds a mobile node served by the given home agent, starting in its home network
+      uint32_t addMobileNode(IPv4Addr address, MacAddr MAC, uint32_t home, uint32_t correspondent)
+      {
+         mobileNode node(address, MAC, randomService::local().entityStream(mobileNodes.size()));
+         node.attachTimers(timers);
+         mobileIndex.insert(address.toUint(), (uint32_t) mobileNodes.size());
+         mobileNodes.push_back(node);
+         links.push_back(mobileLinks(home, correspondent));
+         return (uint32_t) (mobileNodes.size() - 1);
+      }
+
+      size_t mobileNodeCount() { return mobileNodes.size(); }
+      size_t homeAgentCount() { return homeAgents.size(); }
+      size_t foreignAgentCount() { return foreignAgents.size(); }
+      size_t correspondentCount() { return correspondentNodes.size(); }
+
+      mobileNode& getMobileNode(uint32_t handle) { return mobileNodes[handle]; }
+      homeAgent& getHomeAgent(uint32_t handle) { return homeAgents[handle]; }
+      foreignAgent& getForeignAgent(uint32_t handle) { return foreignAgents[handle]; }
+      correspondentNode& getCorrespondent(uint32_t handle) { return correspondentNodes[handle]; }
+
+      // Address lookups (NONE if no such entity)
+      uint32_t findMobileNode(IPv4Addr address) { return mobileIndex.find(address.toUint()); }
+      uint32_t findHomeAgent(IPv4Addr address) { return homeIndex.find(address.toUint()); }
+      uint32_t findCorrespondent(IPv4Addr address) { return correspondentIndex.find(address.toUint()); }
+
+      // Foreign agent at this address or owning it as a care-of-address
+      uint32_t findForeignAgent(IPv4Addr address)
+      {
+         uint32_t agent = foreignIndex.find(address.toUint());
+         if(agent != NONE || coaBlockBits == 0) return agent;
+         agent = coaBlocks.find(blockOf(address).toUint());
+         return agent != NONE && foreignAgents[agent].servesAddress(address) ? agent : NONE;
+      }
+
+      // Mobile node relationships
+      uint32_t homeAgentOf(uint32_t mobile) { return links[mobile].homeAgent; }
+      uint32_t foreignAgentOf(uint32_t mobile) { return links[mobile].foreignAgent; }
+      uint32_t correspondentOf(uint32_t mobile) { return links[mobile].correspondent; }
+      bool isAway(uint32_t mobile) { return links[mobile].foreignAgent != NONE; }
+
+      // Moves a mobile node into a foreign network (NONE returns it home)
+      void moveTo(uint32_t mobile, uint32_t foreign)
+      {
+         links[mobile].previousForeignAgent = links[mobile].foreignAgent;
+         links[mobile].foreignAgent = foreign;
+         links[mobile].handoffPending = links[mobile].previousForeignAgent != NONE;
+      }
+
+      // Handoffs: the foreign agent left on the last handoff (NONE if none), whether the mobile
+      // node has yet to register after it, and for anchored direct routing the session's anchor
+      // foreign agent (NONE until the correspondent learns it) and the handoffs since then
+      uint32_t previousForeignAgentOf(uint32_t mobile) { return links[mobile].previousForeignAgent; }
+      bool handoffPending(uint32_t mobile) { return links[mobile].handoffPending; }
+      uint32_t anchorOf(uint32_t mobile) { return links[mobile].anchor; }
+      uint32_t handoffsOf(uint32_t mobile) { return links[mobile].handoffs; }
+
+      void setAnchor(uint32_t mobile, uint32_t foreign)
+      {
+         links[mobile].anchor = foreign;
+         links[mobile].handoffs = 0;
+      }
+
+      void completeHandoff(uint32_t mobile)
+      {
+         links[mobile].handoffPending = false;
+         if(links[mobile].anchor != NONE) links[mobile].handoffs++;
+      }
+
+      // Snapshot support: the entity arrays, relationships and address indexes are saved as
+      // blocks. Mobile nodes are saved as raw records; their timer wheel pointer is
+      // meaningless in the file and restored entities are attached to this topology's wheel.
+      template <class Writer>
+      void save(Writer &out) const
+      {
+         out.array(mobileNodes);
+         out.array(links);
+         out.value(correspondentNodes.size());
+         for(size_t i = 0; i < correspondentNodes.size(); i++) correspondentNodes[i].save(out);
+         out.value(homeAgents.size());
+         for(size_t i = 0; i < homeAgents.size(); i++) homeAgents[i].save(out);
+         out.value(foreignAgents.size());
+         for(size_t i = 0; i < foreignAgents.size(); i++) foreignAgents[i].save(out);
+         mobileIndex.save(out);
+         homeIndex.save(out);
+         foreignIndex.save(out);
+         correspondentIndex.save(out);
+         out.value(coaPoolSize);
+         out.value(coaBlockBits);
+         coaBlocks.save(out);
+      }
+
+      template <class Reader>
+      bool load(Reader &in)
+      {
+         size_t correspondents, homes, foreigns;
+         if(!in.array(mobileNodes) || !in.array(links) || !in.value(correspondents)) return false;
+         if(links.size() != mobileNodes.size()) return in.fail("mobile node relationships are inconsistent");
+         correspondentNodes.clear();
+         correspondentNodes.resize(correspondents, correspondentNode(IPv4Addr()));
+         for(size_t i = 0; i < correspondents; i++)
+         {
+            if(!correspondentNodes[i].load(in)) return false;
+            correspondentNodes[i].attachTimers(timers);
+         }
+         if(!in.value(homes)) return false;
+         homeAgents.clear();
+         homeAgents.resize(homes);
+         for(size_t i = 0; i < homes; i++)
+         {
+            if(!homeAgents[i].load(in)) return false;
+            homeAgents[i].attachTimers(timers);
+         }
+         if(!in.value(foreigns)) return false;
+         foreignAgents.clear();
+         foreignAgents.resize(foreigns, foreignAgent(IPv4Addr()));
+         for(size_t i = 0; i < foreigns; i++)
+         {
+            if(!foreignAgents[i].load(in)) return false;
+            foreignAgents[i].attachTimers(timers);
+            foreignAgents[i].attachBuffers(buffers);
+         }
+         for(size_t i = 0; i < mobileNodes.size(); i++) mobileNodes[i].attachTimers(timers);
+         return mobileIndex.load(in) && homeIndex.load(in) && foreignIndex.load(in) && correspondentIndex.load(in) &&
+                in.value(coaPoolSize) && in.value(coaBlockBits) && coaBlocks.load(in);
+      }
+
+   private:
+      // Relationships of one mobile node
+      struct mobileLinks
+      {
+         mobileLinks(uint32_t h, uint32_t c) : homeAgent(h), foreignAgent(NONE), correspondent(c), anchor(NONE),
+            previousForeignAgent(NONE), handoffs(0), handoffPending(false) {}
+
+         uint32_t homeAgent;             // Home agent serving the mobile node
+         uint32_t foreignAgent;          // Foreign agent being visited (NONE when at home)
+         uint32_t correspondent;         // Correspondent node sending to the mobile node
+         uint32_t anchor;                // Anchor foreign agent of the session (NONE if none)
+         uint32_t previousForeignAgent;  // Foreign agent left on the last handoff (NONE if none)
+         uint32_t handoffs;              // Handoffs since the anchor was chosen
+         bool handoffPending;            // Not registered since the last handoff
+      };
+
+      // Data Members
+      timerWheel* timers;                          // Lifetime timers given to every entity
+      handoffBufferPool* buffers;                  // Smooth handoff rings given to foreign agents
+      vector<mobileNode> mobileNodes;              // Mobile nodes by handle
+      vector<mobileLinks> links;                   // Relationships by mobile node handle
+      vector<homeAgent> homeAgents;                // Home agents by handle
+      vector<foreignAgent> foreignAgents;          // Foreign agents by handle
+      vector<correspondentNode> correspondentNodes;// Correspondent nodes by handle
+      addressIndex mobileIndex;                    // Mobile node home address -> handle
+      addressIndex homeIndex;                      // Home agent address -> handle
+      addressIndex foreignIndex;                   // Foreign agent address -> handle
+      addressIndex correspondentIndex;             // Correspondent address -> handle
+      size_t coaPoolSize;                          // Care-of-addresses per foreign agent pool
+      uint32_t coaBlockBits;                       // Log2 of the pool block size (0 if no pools)
+      addressIndex coaBlocks;                      // First address of a pool block -> foreign agent
+};
+
+/*
+Tunnel hops and forwarding cost of anchored direct routing datagrams, grouped by the handoffs
+the mobile node has made since its session's anchor was chosen: 0 to 7 handoffs each have a
+group, then 8-15, 16-31, 32-63 and 64 or more.
+*/
+struct forwardingStats
 {
-	// Seed time
-	srand((unsigned int) time(NULL));
+   static const int groups = 12;
 
-    // Initialize objects
-    mobileNode MN(generateIP(), generateMAC());
-	homeAgent HA(MN.getIP());
-    foreignAgent FA(generateIP());
-    correspondentNode CN(generateIP());
-	char selection;
-	bool keepRunning = true;
-	ICMP_t agentMethod;
-	routing_t routingMethod;
-	network networkSelection;
+   forwardingStats()
+   {
+      for(int g = 0; g < groups; g++) datagrams[g] = dropped[g] = hops[g] = maxHops[g] = wallTicks[g] = 0;
+   }
 
-	// Display information
-	cout << endl << "----------------------INITIAL INFORMATION------------------------" << endl << endl;
-	cout << "Mobile Node IP: " << MN.getIP() << endl << endl;
-	cout << "Home Agent address: " << HA.getHA() << endl;
-	HA.printEntries();
-	cout << endl;
-	cout << "Foreign Agent address: " << FA.getFA() << endl;
-	FA.printEntries();
-	cout << endl;
-	cout << "----------------------INITIAL INFORMATION------------------------" << endl << endl << endl;
+   static int groupOf(uint32_t handoffs)
+   {
+      if(handoffs < 8) return (int) handoffs;
+      int group = 8 + highestBit(handoffs) - 3;
+      return group < groups ? group : groups - 1;
+   }
 
-	// Display configuration prompt
-	configuration(agentMethod, routingMethod, networkSelection);
+   static string groupName(int group)
+   {
+      if(group < 8) return to_string(group);
+      if(group == groups - 1) return to_string(1 << (group - 5)) + "+";
+      return to_string(1 << (group - 5)) + "-" + to_string((1 << (group - 4)) - 1);
+   }
 
-    // Display Main Menu
-	do {
+   // Records one datagram sent after the given number of handoffs (tunnelHops is 0 if it was dropped)
+   void record(uint32_t handoffs, uint64_t tunnelHops, uint64_t ticks)
+   {
+      int g = groupOf(handoffs);
+      datagrams[g]++;
+      if(tunnelHops == 0) dropped[g]++;
+      hops[g] += tunnelHops;
+      if(tunnelHops > maxHops[g]) maxHops[g] = tunnelHops;
+      wallTicks[g] += ticks;
+   }
+
+   void add(const forwardingStats &other)
+   {
+      for(int g = 0; g < groups; g++)
+      {
+         datagrams[g] += other.datagrams[g];
+         dropped[g] += other.dropped[g];
+         hops[g] += other.hops[g];
+         if(other.maxHops[g] > maxHops[g]) maxHops[g] = other.maxHops[g];
+         wallTicks[g] += other.wallTicks[g];
+      }
+   }
+
+   uint64_t datagrams[groups];  // Datagrams sent
+   uint64_t dropped[groups];    // Datagrams dropped on the way
+   uint64_t hops[groups];       // Tunnel hops of the delivered datagrams
+   uint64_t maxHops[groups];    // Most tunnel hops of one datagram
+   uint64_t wallTicks[groups];  // Wall time spent routing (metricsClock ticks)
+};
+
+/*
+The simulation holds the topology together with the discrete-event scheduler that drives it.
+Agent discovery, registration and datagram routing run as events in virtual time for each
+mobile node, and registration lifetimes are tracked by a timer wheel (one tick per second)
+that advances with the virtual clock. The whole simulation can be written to a binary
+snapshot and restored later (see snapshot.h), pending events and timers included. While it
+runs, each protocol step can be streamed to an exporter (see exporter.h). Foreign agents hold
+datagrams for visitors that have just left in rings from a shared pool (see handoffBuffer.h).
+A mobility model can move the mobile nodes over an area the foreign agents cover, so handoffs
+follow from movement (see mobilityModel.h).
+*/
+class simulation
+{
+   public:
+      // Constructor
+      simulation() : net(&lifetimeTimers, &handoffBuffers), agentMethod(ADVERTISEMENT), routingMethod(INDIRECT), datagramInterval(0),
+         handoffInterval(0), anchorMode(NO_ANCHOR), forwardingLifetime(0), mobilityStep(0), exporter(NULL) { handoffBuffers.attachClock(&events); }
+
+      // Member Functions
+      // Snapshot support: settings, lifetime timers, pending events, held datagrams, queued
+      // registrations, the mobility model and the whole topology
+      template <class Writer>
+      void save(Writer &out) const
+      {
+         out.value(agentMethod);
+         out.value(routingMethod);
+         out.value(datagramInterval);
+         out.value(handoffInterval);
+         out.value(anchorMode);
+         out.value(forwardingLifetime);
+         out.value(mobilityStep);
+         lifetimeTimers.save(out);
+         events.save(out);
+         handoffBuffers.save(out);
+         relay.save(out);
+         mobility.save(out);
+         net.save(out);
+      }
+
+      template <class Reader>
+      bool load(Reader &in)
+      {
+         return in.value(agentMethod) && in.value(routingMethod) && in.value(datagramInterval) && in.value(handoffInterval) &&
+                in.value(anchorMode) && in.value(forwardingLifetime) && in.value(mobilityStep) && lifetimeTimers.load(in) &&
+                events.load(in) && handoffBuffers.load(in) && relay.load(in) && mobility.load(in) && net.load(in);
+      }
+
+      // Members
+      timerWheel lifetimeTimers;   // Registration lifetimes
+      handoffBufferPool handoffBuffers; // Rings holding datagrams for departed visitors
+      registrationRelay relay;     // Registration requests queued at foreign agents for batching
+      mobilityEngine mobility;     // Mobile node movement over the foreign agents' radio coverage
+      topology net;                // Every simulated entity
+      ICMP_t agentMethod;          // ADVERTISEMENT or SOLICITATION
+      routing_t routingMethod;     // INDIRECT or DIRECT
+      simTime datagramInterval;    // Time between correspondent datagrams (0 sends one per session)
+      simTime handoffInterval;     // Time between each mobile node's moves to another foreign network (0 never moves)
+      anchor_t anchorMode;         // Direct routing through a foreign anchor (NO_ANCHOR queries the home agent)
+      simTime forwardingLifetime;  // Life of a compressed chain's forwarding pointers at intermediate foreign agents
+      simTime mobilityStep;        // Time between mobility model steps (0 when nodes do not move)
+      eventScheduler events;       // Pending protocol events
+      recordExporter* exporter;    // Receives event records (NULL exports nothing; not saved)
+      forwardingStats forwarding;  // Anchored routing hops and cost (not saved)
+};
+
+/*
+Settings for one headless simulation run. Scenario files describe any number of runs as
+blocks of "key value" lines:
+
+	# Lines starting with '#' are comments
+	scenario office-handoff
+	network foreign               (home or foreign)
+	discovery solicitation        (advertisement or solicitation)
+	routing direct                (indirect or direct)
+	duration 7200                 (seconds of network time)
+	datagram-interval 0.5         (seconds between correspondent datagrams)
+	seed 42                       (master random seed, omit for a time-based seed)
+	mobile-nodes 100000           (population of each entity type)
+	home-agents 10
+	foreign-agents 500
+	correspondents 1000
+	handoff-interval 300          (seconds between each mobile node's moves to another
+	                               foreign network, 0 never moves)
+	binding-cache 1024            (care-of-addresses each correspondent caches for direct
+	                               routing, 0 always queries the home agent)
+	anchor compressed             (none, chain or compressed: direct routing through the
+	                               session's first foreign agent)
+	forwarding-lifetime 10        (seconds a compressed chain's forwarding pointers live at
+	                               the foreign agents in between)
+	handoff-buffer 16             (datagrams a foreign agent holds for a visitor that has
+	                               left until its new care-of-address arrives, 0 drops them)
+	handoff-buffer-pool 1024      (rings preallocated for held datagrams, shared by every
+	                               foreign agent)
+	coa-pool 4096                 (co-located care-of-addresses each foreign agent hands
+	                               out, up to 65536, 0 uses the agent's own address)
+	registration-batch 64         (registration requests a foreign agent relays to a home
+	                               agent in one message, 0 relays each on its own)
+	registration-batch-wait 0.05  (seconds a request waits for its batch to fill)
+	mobility waypoint             (none, waypoint, manhattan or commuter: mobile nodes move
+	                               over an area the foreign agents cover and hand off when
+	                               they cross into another agent's coverage)
+	mobility-step 1               (seconds between position updates)
+	area 5000                     (meters on each side of the square area)
+	speed-min 1                   (meters per second, each leg's speed is picked between
+	speed-max 15                   the two)
+	pause 30                      (seconds a waypoint node waits at each waypoint)
+	street-spacing 100            (meters between the streets of the Manhattan grid)
+	dwell 28800                   (seconds a commuter stays at home or at work, on average)
+	range 300                     (meters each foreign agent's advertisements reach, omit to
+	                               overlap the neighboring agents' coverage a little)
+	save-snapshot run1.snap       (write the simulation state to a file when the run ends)
+	load-snapshot run0.snap       (start from a saved state instead of a new topology)
+	export run1                   (stream records to run1.events.csv, run1.bindings.csv
+	                               and run1.visitors.csv)
+	export-format json            (csv or json, JSON Lines files end in .jsonl)
+	export-compression gzip       (none or gzip, compressed files end in .gz)
+	export-interval 600           (seconds between binding and visitor dumps, 0 dumps
+	                               only at the end)
+	end
+
+Mobile nodes are spread round-robin over the home agents and correspondents. In a foreign
+network scenario each mobile node starts out visiting a random foreign agent. A scenario that
+loads a snapshot keeps the snapshot's topology, settings and clock and ignores the
+population and protocol keys; duration is counted from the snapshot's time. An exported run
+writes one event row per discovery, registration, datagram and timer, and dumps every
+binding and visitor entry at each export interval and at the end. With a binding cache the
+home agent sends a binding update to the caching correspondent after every registration, and
+an invalidation when the binding expires. With an anchor the correspondent queries the home
+agent once per session and tunnels every datagram to the anchor, which follows forwarding
+pointers to the mobile node: a chain adds a hop per handoff, while a compressed chain points
+the anchor straight at the current foreign agent. With a handoff buffer the foreign agent a
+mobile node has left holds its datagrams until the new foreign agent reports the move, then
+sends them on. With a care-of-address pool every visitor registers with an address of its
+own, which goes back to the pool when its visitor entry expires; a visitor that finds the
+pool empty falls back to the agent's address. With registration batching a foreign agent
+queues the requests for each home agent and relays them together once the batch is full or
+its first request has waited long enough; the home agent applies the batch in one pass. With a
+mobility model the foreign agents are spread evenly over the area and each mobile node starts
+out visiting the strongest agent in range; it hands off when it moves out of its agent's
+range, to the strongest agent it hears there.
+
+Keys that are left out keep the defaults below.
+*/
+class scenarioConfig
+{
+   public:
+      // Constructor
+      scenarioConfig() : name("default"), networkSelection(FOREIGN), agentMethod(ADVERTISEMENT),
+         routingMethod(INDIRECT), duration(3600 * SECOND), datagramInterval(SECOND), seed(0),
+         mobileNodes(1), homeAgents(1), foreignAgents(1), correspondents(1), handoffInterval(0), bindingCacheSize(0),
+         anchorMode(NO_ANCHOR), forwardingLifetime(10 * SECOND), handoffBufferDepth(0), handoffBufferRings(1024), coaPoolSize(0), registrationBatch(0), registrationBatchWait(50 * MILLISECOND), mobilityStep(SECOND), exportFileFormat(EXPORT_CSV), exportCompressed(false), exportInterval(0) {}
+
+      // Members
+      string name;               // Scenario name used in error messages and the summary
+      network networkSelection;  // HOME or FOREIGN
+      ICMP_t agentMethod;        // ADVERTISEMENT or SOLICITATION
+      routing_t routingMethod;   // INDIRECT or DIRECT
+      simTime duration;          // Network time to simulate
+      simTime datagramInterval;  // Time between correspondent datagrams
+      uint64_t seed;             // Master random seed (0 seeds from the clock)
+      size_t mobileNodes;        // Population of each entity type
+      size_t homeAgents;
+      size_t foreignAgents;
+      size_t correspondents;
+      simTime handoffInterval;   // Time between each mobile node's handoffs (0 never moves)
+      size_t bindingCacheSize;   // Entries in each correspondent's binding cache (0 disables it)
+      anchor_t anchorMode;       // NO_ANCHOR, ANCHOR_CHAIN or ANCHOR_COMPRESSED
+      simTime forwardingLifetime;// Life of forwarding pointers left behind by a compressed chain
+      size_t handoffBufferDepth; // Datagrams held per departed visitor (0 disables buffering)
+      size_t handoffBufferRings; // Rings in the handoff buffer pool
+      size_t coaPoolSize;        // Care-of-addresses per foreign agent (0 uses the agent's address)
+      size_t registrationBatch;  // Requests per registration relay message (0 relays each alone)
+      simTime registrationBatchWait; // Longest a request waits for its batch
+      mobilitySettings mobility; // Mobility model and area (MOBILITY_NONE keeps nodes still)
+      simTime mobilityStep;      // Time between position updates
+      string loadSnapshot;       // Snapshot to start from ("" builds a new topology)
+      string saveSnapshot;       // Snapshot to write at the end ("" writes none)
+      string exportPrefix;       // Prefix of the export files ("" exports nothing)
+      exportFormat exportFileFormat; // EXPORT_CSV or EXPORT_JSON_LINES
+      bool exportCompressed;     // gzip the export files
+      simTime exportInterval;    // Time between table dumps (0 dumps only at the end)
+};
+
+/*
+Reads scenario blocks one at a time from a stream, so a file holding thousands of scenarios is
+never loaded into memory at once.
+*/
+class scenarioReader
+{
+   public:
+      // Constructor
+      scenarioReader(istream &in) : input(in), lineNumber(0) {}
+
+      // Member Functions
+      int getLine() { return lineNumber; }
+
+      // Reads the next scenario. Returns false at the end of the stream. If the block is
+      // malformed, error describes the problem and the rest of the block is skipped.
+      bool next(scenarioConfig &config, string &error)
+      {
+         string line, key, value;
+         bool inBlock = false;
+         config = scenarioConfig();
+         error = "";
+
+         while(getline(input, line))
+         {
+            lineNumber++;
+            istringstream fields(line);
+            if(!(fields >> key) || key[0] == '#') continue;
+            value = "";
+            fields >> value;
+
+            if(!inBlock)
+            {
+               if(key != "scenario")
+               {
+                  error = "expected 'scenario', found '" + key + "'";
+                  return true;
+               }
+               inBlock = true;
+               if(value != "") config.name = value;
+            }
+            else if(key == "end")
+            {
+               return true;
+            }
+            else if(error == "" && !setOption(config, key, value))
+            {
+               error = "bad setting '" + line + "' in scenario " + config.name;
+            }
+         }
+
+         if(inBlock && error == "") error = "missing 'end' for scenario " + config.name;
+         return inBlock;
+      }
+
+   private:
+      // Member Functions
+      bool setOption(scenarioConfig &config, const string &key, const string &value)
+      {
+         if(value == "") return false;
+         char c = (char) tolower(value[0]);
+         if(key == "network")
+         {
+            if(c == 'h') config.networkSelection = HOME;
+            else if(c == 'f') config.networkSelection = FOREIGN;
+            else return false;
+         }
+         else if(key == "discovery")
+         {
+            if(c == 'a') config.agentMethod = ADVERTISEMENT;
+            else if(c == 's') config.agentMethod = SOLICITATION;
+            else return false;
+         }
+         else if(key == "routing")
+         {
+            if(c == 'i') config.routingMethod = INDIRECT;
+            else if(c == 'd') config.routingMethod = DIRECT;
+            else return false;
+         }
+         else if(key == "duration") return parseSeconds(value, config.duration);
+         else if(key == "datagram-interval") return parseSeconds(value, config.datagramInterval);
+         else if(key == "seed") config.seed = (uint64_t) strtoull(value.c_str(), NULL, 10);
+         else if(key == "mobile-nodes") return parseCount(value, config.mobileNodes);
+         else if(key == "home-agents") return parseCount(value, config.homeAgents);
+         else if(key == "foreign-agents") return parseCount(value, config.foreignAgents);
+         else if(key == "correspondents") return parseCount(value, config.correspondents);
+         else if(key == "handoff-interval") return parseSeconds(value, config.handoffInterval);
+         else if(key == "binding-cache") return parseCount(value, config.bindingCacheSize, 0);
+         else if(key == "anchor")
+         {
+            if(c == 'n') config.anchorMode = NO_ANCHOR;
+            else if(c == 'c' && value.length() > 1 && tolower(value[1]) == 'h') config.anchorMode = ANCHOR_CHAIN;
+            else if(c == 'c') config.anchorMode = ANCHOR_COMPRESSED;
+            else return false;
+         }
+         else if(key == "forwarding-lifetime") return parseSeconds(value, config.forwardingLifetime);
+         else if(key == "handoff-buffer") return parseCount(value, config.handoffBufferDepth, 0);
+         else if(key == "handoff-buffer-pool") return parseCount(value, config.handoffBufferRings);
+         else if(key == "coa-pool") return parseCount(value, config.coaPoolSize, 0) && config.coaPoolSize <= 65536;
+         else if(key == "registration-batch") return parseCount(value, config.registrationBatch, 0);
+         else if(key == "registration-batch-wait") return parseSeconds(value, config.registrationBatchWait);
+         else if(key == "mobility")
+         {
+            if(c == 'n') config.mobility.pattern = MOBILITY_NONE;
+            else if(c == 'w' || c == 'r') config.mobility.pattern = RANDOM_WAYPOINT;
+            else if(c == 'm') config.mobility.pattern = MANHATTAN_GRID;
+            else if(c == 'c') config.mobility.pattern = COMMUTER;
+            else return false;
+         }
+         else if(key == "mobility-step") return parseSeconds(value, config.mobilityStep) && config.mobilityStep > 0;
+         else if(key == "area")
+         {
+            if(!parseMeasure(value, config.mobility.width)) return false;
+            config.mobility.height = config.mobility.width;
+         }
+         else if(key == "speed-min") return parseMeasure(value, config.mobility.minSpeed);
+         else if(key == "speed-max") return parseMeasure(value, config.mobility.maxSpeed);
+         else if(key == "pause") return parseMeasure(value, config.mobility.pause, true);
+         else if(key == "street-spacing") return parseMeasure(value, config.mobility.streetSpacing);
+         else if(key == "dwell") return parseMeasure(value, config.mobility.dwell, true);
+         else if(key == "range") return parseMeasure(value, config.mobility.range);
+         else if(key == "load-snapshot") config.loadSnapshot = value;
+         else if(key == "save-snapshot") config.saveSnapshot = value;
+         else if(key == "export") config.exportPrefix = value;
+         else if(key == "export-format")
+         {
+            if(c == 'c') config.exportFileFormat = EXPORT_CSV;
+            else if(c == 'j') config.exportFileFormat = EXPORT_JSON_LINES;
+            else return false;
+         }
+         else if(key == "export-compression")
+         {
+            if(c == 'n') config.exportCompressed = false;
+            else if(c == 'g') config.exportCompressed = true;
+            else return false;
+         }
+         else if(key == "export-interval") return parseSeconds(value, config.exportInterval);
+         else return false;
+         return true;
+      }
+
+      static bool parseCount(const string &value, size_t &out, unsigned long long minimum = 1)
+      {
+         char* end;
+         unsigned long long count = strtoull(value.c_str(), &end, 10);
+         if(*end != '\0' || count < minimum || count >= topology::NONE) return false;
+         out = (size_t) count;
+         return true;
+      }
+
+      static bool parseSeconds(const string &value, simTime &out)
+      {
+         char* end;
+         double seconds = strtod(value.c_str(), &end);
+         if(*end != '\0' || seconds < 0) return false;
+         out = (simTime) (seconds * SECOND);
+         return true;
+      }
+
+      // Distance, speed or time of a mobility model (positive, or 0 if zero is allowed)
+      static bool parseMeasure(const string &value, float &out, bool zero = false)
+      {
+         char* end;
+         double measure = strtod(value.c_str(), &end);
+         if(*end != '\0' || measure < 0 || (measure == 0 && !zero)) return false;
+         out = (float) measure;
+         return true;
+      }
+
+      // Data Members
+      istream &input;  // Scenario file
+      int lineNumber;  // Last line read
+};
+
+// Datagrams delivered and dropped, and those reaching a foreign agent after the mobile node
+// left it, read from the protocol counters
+struct datagramStats
+{
+   datagramStats() : delivered(0), dropped(0), held(0), lost(0), flushed(0), flushDelay(0) {}
+
+   // Counters so far; a run's own counts are a later reading less an earlier one
+   static datagramStats read()
+   {
+      protocolMetrics &metrics = protocolMetrics::instance();
+      datagramStats stats;
+      stats.delivered = metrics.counter(COUNT_DATAGRAMS_DELIVERED);
+      stats.dropped = metrics.counter(COUNT_DATAGRAMS_DROPPED);
+      stats.held = metrics.counter(COUNT_HANDOFF_HELD);
+      stats.lost = metrics.counter(COUNT_HANDOFF_LOST);
+      stats.flushed = metrics.networkTime(PHASE_HANDOFF_BUFFER).count();
+      stats.flushDelay = metrics.networkTime(PHASE_HANDOFF_BUFFER).valueSum();
+      return stats;
+   }
+
+   // Adds (sign 1) or takes away (sign -1) another set of counts
+   void add(const datagramStats &other, int sign = 1)
+   {
+      delivered += sign * other.delivered;
+      dropped += sign * other.dropped;
+      held += sign * other.held;
+      lost += sign * other.lost;
+      flushed += sign * other.flushed;
+      flushDelay += sign * other.flushDelay;
+   }
+
+   uint64_t delivered;  // Datagrams handed to mobile nodes
+   uint64_t dropped;    // Datagrams dropped anywhere
+   uint64_t held;       // Datagrams held for a mobile node that had left
+   uint64_t lost;       // Datagrams for a mobile node that had left that could not be held
+   uint64_t flushed;    // Held datagrams delivered after the handoff
+   uint64_t flushDelay; // Network time those waited, in total
+};
+
+// Totals of one or more headless runs
+struct scenarioResult
+{
+   scenarioResult() : events(0), networkTime(0), mobileNodes(0), bindings(0), restored(0), saved(0),
+      restoreSeconds(0), saveSeconds(0), exportedRows(0), exportedBytes(0), exportWaits(0), coaInUse(0), coaPoolSize(0) {}
+
+   uint64_t events;        // Events processed
+   simTime networkTime;    // Network time simulated
+   size_t mobileNodes;     // Mobile nodes simulated
+   size_t bindings;        // Bindings left at the home agents
+   int restored;           // Snapshots loaded
+   int saved;              // Snapshots written
+   double restoreSeconds;  // Wall time spent loading snapshots
+   double saveSeconds;     // Wall time spent writing snapshots
+   uint64_t exportedRows;  // Rows streamed to export files
+   uint64_t exportedBytes; // Bytes of those rows (before compression)
+   uint64_t exportWaits;   // Times the simulation waited for the export writers
+   bindingCacheStats cache;// Correspondent binding cache activity
+   forwardingStats forwarding; // Anchored routing hops and cost
+   careOfAddressStats coa; // Care-of-address pool activity
+   size_t coaInUse;        // Care-of-addresses held by visitors at the end
+   size_t coaPoolSize;     // Care-of-addresses in every pool
+   registrationRelayStats relay; // Batched registration relay activity
+   mobilityStats mobility; // Mobility model activity
+   datagramStats datagrams;// Datagram delivery and loss
+   vector<pair<string, datagramStats> > runs; // Datagram delivery and loss of each scenario, by name
+};
+
+// Function Prototype Declarations
+void Sleep(int);
+IPv4Addr generateIP();
+MacAddr generateMAC();
+void configuration(ICMP_t&, routing_t&, network&);
+void displayInformation(ostream&, mobileNode&, homeAgent&, foreignAgent&);
+void agentDiscovery(mobileNode&, homeAgent&, foreignAgent&, network, ICMP_t);
+void registerMN(mobileNode&, homeAgent&, foreignAgent&);
+void indirectRouting(mobileNode&, homeAgent&, foreignAgent&, correspondentNode&, topology* = NULL);
+void directRouting(mobileNode&, homeAgent&, foreignAgent&, correspondentNode&, topology* = NULL);
+void moveToNewForeignNetwork(mobileNode&, homeAgent&, foreignAgent&, correspondentNode&);
+void anchoredRouting(simulation&, uint32_t);
+void updateForwarding(simulation&, uint32_t);
+bool tunnelDatagram(packetBuffer&, IPv4Addr, IPv4Addr);
+bool detunnelDatagram(packetBuffer&, IPv4Addr);
+bool deliverToVisitor(packetBuffer&, foreignAgent&);
+bool holdForDeparted(packetBuffer&, foreignAgent&, IPv4Addr);
+void printPacket(const packetBuffer&);
+void outputDatabase(mobileNode&, homeAgent&, foreignAgent&, correspondentNode&);
+void benchmarkRoutingAllocations();
+void benchmarkProtocol(const vector<size_t>&, benchReport&);
+void benchmarkRegistrationBatching(const vector<size_t>&, benchReport&);
+void benchmarkHandoffBuffering();
+IPv4Addr generateUniqueIP(topology&);
+IPv4Addr generateCOABlock(topology&);
+void startSession(simulation&, uint32_t);
+void registrationDone(simulation&, uint32_t, uint64_t);
+void queueRegistration(simulation&, uint32_t, uint64_t);
+void relayRegistrations(simulation&, uint32_t, uint32_t, bool);
+void handoff(simulation&, uint32_t, uint32_t);
+void moveMobileNodes(simulation&);
+void runSimulation(simulation&, simTime);
+void dispatchEvent(simulation&, const simEvent&);
+void handleTimer(simulation&, timerId, const timerEvent&);
+bool runScenario(const scenarioConfig&, scenarioResult&, string&);
+bool saveSnapshot(const simulation&, const string&, string&);
+bool loadSnapshot(simulation&, const string&, string&);
+void exportTables(simulation&, simTime);
+int runScenarioFile(const char*);
+void printSummary(const scenarioResult&, double, int, int);
+int configureLogging(int, char*[], bool&);
+int configureMetrics(int, char*[], metricsDumper&);
+size_t serveRegistration(homeAgent&, const uint8_t*, size_t, uint8_t*, size_t);
+int runRegistrationServer(uint16_t);
+int runRegistrationLoadTest(size_t, size_t, uint16_t);
+
+// Main Simulation
+int main(int argc, char* argv[])
+{
+	// Logging options come off the command line first; headless modes are silent unless
+	// logging was asked for
+	bool logConfigured = false;
+	argc = configureLogging(argc, argv, logConfigured);
+	if(argc < 0) return 1;
+
+	// Metrics are always recorded; --metrics dumps them while the program runs
+	metricsDumper dumper;
+	argc = configureMetrics(argc, argv, dumper);
+	if(argc < 0) return 1;
+	if(argc > 1 && !logConfigured && string(argv[1]).compare(0, 2, "--") == 0) logger::instance().setLevel(LOG_SILENT);
+
+	// Run microbenchmarks instead of the simulation: --benchmark [sizes...] [--json FILE]
+	if(argc > 1 && string(argv[1]) == "--benchmark")
+	{
+		vector<size_t> sizes;
+		const char* jsonFile = NULL;
+		for(int i = 2; i < argc; i++)
+		{
+			if(string(argv[i]) == "--json" && i + 1 < argc) jsonFile = argv[++i];
+			else sizes.push_back((size_t) strtoull(argv[i], NULL, 10));
+		}
+		if(sizes.empty()) sizes = { 10000, 1000000, 10000000 };
+		runBenchmarks(sizes);
+		benchmarkRoutingAllocations();
+
+		benchReport report;
+		benchmarkProtocol(sizes, report);
+		benchmarkRegistrationBatching(sizes, report);
+		benchmarkHandoffBuffering();
+		if(jsonFile != NULL)
+		{
+			ofstream fout(jsonFile);
+			report.writeJSON(fout);
+			if(!fout)
+			{
+				cerr << "Could not write " << jsonFile << endl;
+				return 1;
+			}
+		}
+		if(benchFailures() > 0) cerr << benchFailures() << " benchmark checks failed" << endl;
+		return benchFailures() == 0 ? 0 : 1;
+	}
+
+	// Run the simulation without prompts: --simulate <seconds of network time> [I|D]
+	if(argc > 2 && string(argv[1]) == "--simulate")
+	{
+		scenarioConfig config;
+		config.duration = (simTime) (atof(argv[2]) * SECOND);
+		if(argc > 3 && (argv[3][0] == 'D' || argv[3][0] == 'd')) config.routingMethod = DIRECT;
+
+		scenarioResult result;
+		string error;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		runScenario(config, result, error);
+		printSummary(result, chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1, 0);
+		return 0;
+	}
+
+	// Run every scenario in a file without prompts: --scenario <file>
+	if(argc > 2 && string(argv[1]) == "--scenario") return runScenarioFile(argv[2]);
+
+	// Serve registrations for one home agent over UDP on localhost: --registration-server [port]
+	if(argc > 1 && string(argv[1]) == "--registration-server")
+		return runRegistrationServer(argc > 2 ? (uint16_t) atoi(argv[2]) : REGISTRATION_PORT);
+
+	// Load the UDP registration service with simulated foreign agents:
+	// --registration-load [requests] [foreign agents] [port]
+	if(argc > 1 && string(argv[1]) == "--registration-load")
+		return runRegistrationLoadTest(argc > 2 ? (size_t) strtoull(argv[2], NULL, 10) : 1000000,
+			argc > 3 ? (size_t) strtoull(argv[3], NULL, 10) : 64, argc > 4 ? (uint16_t) atoi(argv[4]) : REGISTRATION_PORT);
+
+	// Seed time
+	randomService::local().seed((uint64_t) time(NULL));
+
+    // Initialize objects
+	simulation sim;
+	IPv4Addr homeAddress = generateIP();
+	uint32_t home = sim.net.addHomeAgent(homeAddress);
+	uint32_t foreign = sim.net.addForeignAgent(generateUniqueIP(sim.net));
+	uint32_t correspondent = sim.net.addCorrespondent(generateUniqueIP(sim.net));
+	uint32_t mobile = sim.net.addMobileNode(homeAddress, generateMAC(), home, correspondent);
+    mobileNode &MN = sim.net.getMobileNode(mobile);
+	homeAgent &HA = sim.net.getHomeAgent(home);
+    foreignAgent &FA = sim.net.getForeignAgent(foreign);
+    correspondentNode &CN = sim.net.getCorrespondent(correspondent);
+	network networkSelection;
+	char selection;
+	bool keepRunning = true;
+
+	// Display information
+	ostream &out = narrate(LOG_SIMULATION);
+	out << endl << "----------------------INITIAL INFORMATION------------------------" << endl << endl;
+	out << "Mobile Node IP: " << MN.getIP() << endl << endl;
+	out << "Home Agent address: " << HA.getHA() << endl;
+	HA.printEntries();
+	out << endl;
+	out << "Foreign Agent address: " << FA.getFA() << endl;
+	FA.printEntries();
+	out << endl;
+	out << "----------------------INITIAL INFORMATION------------------------" << endl << endl << endl;
+
+	// Display configuration prompt
+	configuration(sim.agentMethod, sim.routingMethod, networkSelection);
+
+    // Display Main Menu
+	do {
+
+		// Agent discovery, registration and routing run as events in virtual time
+		sim.net.moveTo(mobile, networkSelection == FOREIGN ? foreign : topology::NONE);
+		startSession(sim, mobile);
+		runSimulation(sim, sim.events.now() + roundDuration);
+
+		// Direct routing then walks through the mobile node moving on to another foreign network
+		if(sim.routingMethod == DIRECT && networkSelection == FOREIGN) moveToNewForeignNetwork(MN, HA, FA, CN);
+
+		// Prompt user for next action once the round's narration is on screen
+		logFlush();
+		cout << "1. Reconfigure simulator" << endl;
+		cout << "2. Quit simulator" << endl;
+		cout << "Enter your selection: ";
+		cin >> selection;
+		switch(selection)
+		{
+			case '1':
+				configuration(sim.agentMethod, sim.routingMethod, networkSelection);
+				break;
+			default:
+				keepRunning = false;
+		}
+    } while(keepRunning);
+
+	// Output results to database
+	outputDatabase(MN, HA, FA, CN);
+
+	return 0;
+}
+
+// Function Implementation
+void Sleep(int time) { if(time > 0) this_thread::sleep_for(chrono::seconds(time)); }
+
+/*
+This function generates a random IP address
+*/
+IPv4Addr generateIP()
+{
+   // Generate random IP address
+   randomStream &random = threadRandom();
+   return IPv4Addr{ (uint8_t) random.between(192, 222),
+      (uint8_t) random.between(1, 254),
+      (uint8_t) random.between(1, 254),
+      (uint8_t) random.between(1, 254) };
+}
+
+/*
+This function generates a random IP address that no entity in the topology is using yet
+*/
+IPv4Addr generateUniqueIP(topology &net)
+{
+   IPv4Addr IP = generateIP();
+   while(net.addressInUse(IP)) IP = generateIP();
+   return IP;
+}
+
+/*
+This function picks a random care-of-address pool block that overlaps no other block and no
+entity's address
+*/
+IPv4Addr generateCOABlock(topology &net)
+{
+   IPv4Addr base = net.blockOf(generateIP());
+   while(net.blockInUse(base)) base = net.blockOf(generateIP());
+   return base;
+}
+
+/*
+This function generates a random MAC address
+*/
+MacAddr generateMAC()
+{
+   // Generate random MAC address, one octet at a time
+   randomStream &random = threadRandom();
+   uint64_t MAC = 0;
+   for (int i = 0; i < 6; i++) MAC = (MAC << 8) | (uint64_t) random.between(1, 254);
+  
+   return MacAddr(MAC);
+}
+
+/*
+Follows a mobile node's registration once the home agent has accepted it. After a handoff the
+new foreign agent tells the foreign agents left behind where the mobile node is; the previous
+one hears it once the request reaches the new one. A full session (key 1) starts the datagram
+stream once request and reply have crossed MN -> FA -> HA -> FA -> MN, and a caching
+correspondent gets a binding update as soon as the request reaches the home agent
+(MN -> FA -> HA -> CN).
+*/
+void registrationDone(simulation &sim, uint32_t mobile, uint64_t key)
+{
+	mobileNode &MN = sim.net.getMobileNode(mobile);
+	homeAgent &HA = sim.net.getHomeAgent(sim.net.homeAgentOf(mobile));
+	if(sim.exporter != NULL)
+		sim.exporter->event(sim.events.now(), "registration", MN.getIP(), HA.getHA(), sim.net.getForeignAgent(sim.net.foreignAgentOf(mobile)).getFA());
+
+	if(sim.net.handoffPending(mobile))
+	{
+		if(sim.anchorMode != NO_ANCHOR) updateForwarding(sim, mobile);
+		if(sim.handoffBuffers.enabled())
+			sim.events.scheduleAfter(2 * linkDelay, simEvent(BUFFER_FLUSH_EVENT, mobile, sim.net.previousForeignAgentOf(mobile)));
+		sim.net.completeHandoff(mobile);
+	}
+	if(key == 1) sim.events.scheduleAfter(4 * linkDelay, simEvent(ROUTING_EVENT, mobile, 1));
+	if(HA.subscriberOf(MN.getIP()).isSet())
+		sim.events.scheduleAfter(3 * linkDelay, simEvent(BINDING_UPDATE_EVENT, mobile, HA.subscriberOf(MN.getIP()).toUint()));
+}
+
+/*
+Batched registration: the mobile node's request joins the batch its foreign agent is filling
+for the home agent. A full batch is relayed at once; the first request of a batch starts the
+batch's time limit.
+*/
+void queueRegistration(simulation &sim, uint32_t mobile, uint64_t key)
+{
+	uint32_t foreign = sim.net.foreignAgentOf(mobile), home = sim.net.homeAgentOf(mobile);
+	pendingRegistration request;
+	request.mobile = mobile;
+	request.session = (uint32_t) key;
+	request.arrived = sim.events.now();
+	size_t queued = sim.relay.enqueue(foreign, home, request);
+	if(queued >= sim.relay.batchSize()) relayRegistrations(sim, foreign, home, true);
+	else if(queued == 1) sim.events.scheduleAfter(sim.relay.wait(), simEvent(REGISTRATION_RELAY_EVENT, foreign, home));
+}
+
+/*
+Relays the batch of registration requests a foreign agent has queued for a home agent. The
+foreign agent updates its Visitor List for every request and sends them in one message; the
+home agent applies them in one pass over its Mobility Binding Table and answers with one
+combined reply, which the foreign agent splits into a reply per mobile node. Each request's
+latency is the time it waited for the batch plus the four link hops of an unbatched
+registration. Requests from mobile nodes that have moved on since are dropped. Wall time is
+measured per batch rather than sampled per phase.
+*/
+void relayRegistrations(simulation &sim, uint32_t foreign, uint32_t home, bool full)
+{
+	static vector<bindingRequest> bindings;
+	uint64_t clockStart = metricsClock();
+	protocolMetrics &metrics = protocolMetrics::instance();
+	foreignAgent &FA = sim.net.getForeignAgent(foreign);
+	homeAgent &HA = sim.net.getHomeAgent(home);
+	simTime now = sim.events.now();
+	const vector<pendingRegistration> &batch = sim.relay.take(foreign, home);
+
+	// FA: update the Visitor List and relay the requests still valid
+	bindings.clear();
+	for(size_t i = 0; i < batch.size(); i++)
+	{
+		mobileNode &MN = sim.net.getMobileNode(batch[i].mobile);
+		bindingRequest binding;
+		binding.homeAddress = MN.getIP();
+		binding.lifetime = 0;
+		if(sim.net.foreignAgentOf(batch[i].mobile) == foreign)
+		{
+			int lifetimeRequest = (int) MN.getRandom().between(1999, 9998);
+			binding.lifetime = lifetimeRequest - (int) MN.getRandom().below(1999);
+			MN.setCOA(FA.assignCOA(MN.getIP()));
+			FA.addEntry(MN.getIP(), HA.getHA(), MN.getMAC(), lifetimeRequest);
+			binding.COA = MN.getCOA();
+		}
+		bindings.push_back(binding);
+	}
+
+	// HA: apply the batch in one pass (requests for mobile nodes that moved on are skipped)
+	size_t valid = 0;
+	for(size_t i = 0; i < bindings.size(); i++)
+		if(bindings[i].lifetime > 0) bindings[valid++] = bindings[i];
+	HA.addEntries(bindings.data(), valid);
+	narrate(LOG_REGISTRATION, LOG_DEBUG) << "Foreign Agent " << FA.getFA() << ": Relayed " << valid << " registration requests to Home Agent "
+	                                     << HA.getHA() << " in one message" << endl;
+
+	// FA: split the combined reply, one per mobile node
+	registrationRelayStats &stats = sim.relay.stats();
+	for(size_t i = 0, b = 0; i < batch.size(); i++)
+	{
+		// A mobile node that moved on registers again in its new network; its datagram stream
+		// still starts
+		if(sim.net.foreignAgentOf(batch[i].mobile) != foreign)
+		{
+			if(batch[i].session == 1) sim.events.scheduleAfter(4 * linkDelay, simEvent(ROUTING_EVENT, batch[i].mobile, 1));
+			continue;
+		}
+		mobileNode &MN = sim.net.getMobileNode(batch[i].mobile);
+		MN.scheduleReregistration(bindings[b++].lifetime);
+		simTime waited = now - batch[i].arrived;
+		metrics.record(PHASE_REGISTRATION_REQUEST, 0, waited + 2 * linkDelay);
+		metrics.record(PHASE_REGISTRATION_REPLY, 0, 2 * linkDelay);
+		metrics.count(COUNT_REGISTRATIONS);
+		stats.latency += waited + 4 * linkDelay;
+		if(waited + 4 * linkDelay > stats.maxLatency) stats.maxLatency = waited + 4 * linkDelay;
+		stats.requests++;
+		registrationDone(sim, batch[i].mobile, batch[i].session);
+	}
+	stats.batches++;
+	if(full) stats.fullBatches++;
+	metrics.count(COUNT_REGISTRATION_BATCHES);
+	stats.wallTicks += metricsClock() - clockStart;
+}
+
+/*
+Moves a visiting mobile node to the network of foreign agent to, where it discovers the agent
+and registers. Its entry at the old foreign agent lapses with its lifetime.
+*/
+void handoff(simulation &sim, uint32_t mobile, uint32_t to)
+{
+	mobileNode &MN = sim.net.getMobileNode(mobile);
+	uint32_t from = sim.net.foreignAgentOf(mobile);
+	sim.net.getForeignAgent(from).visitorLeft(MN.getIP());
+	sim.net.moveTo(mobile, to);
+	narrate(LOG_DISCOVERY, LOG_DEBUG) << "Mobile Node " << MN.getIP() << ": Moved to the network of Foreign Agent " << sim.net.getForeignAgent(to).getFA() << endl;
+	if(sim.exporter != NULL)
+		sim.exporter->event(sim.events.now(), "handoff", MN.getIP(), sim.net.getHomeAgent(sim.net.homeAgentOf(mobile)).getHA(), sim.net.getForeignAgent(to).getFA());
+	sim.events.scheduleAfter(0, simEvent(DISCOVERY_EVENT, mobile, 2));
+}
+
+/*
+Advances the mobility model by one step. Each visiting mobile node that has moved into another
+foreign agent's coverage hands off to it; mobile nodes at home move without handing off.
+*/
+void moveMobileNodes(simulation &sim)
+{
+	uint64_t clockStart = metricsClock();
+	const vector<uint32_t> &crossed = sim.mobility.step((float) sim.mobilityStep / SECOND);
+	mobilityStats &stats = sim.mobility.stats();
+	stats.wallTicks += metricsClock() - clockStart;
+	for(size_t i = 0; i < crossed.size(); i++)
+	{
+		uint32_t mobile = crossed[i], to = sim.mobility.agentOf(mobile);
+		if(!sim.net.isAway(mobile) || sim.net.foreignAgentOf(mobile) == to) continue;
+		handoff(sim, mobile, to);
+		stats.handoffs++;
+	}
+	sim.events.scheduleAfter(sim.mobilityStep, simEvent(MOBILITY_EVENT, 0, 0));
+}
+
+/*
+Starts a protocol session for one mobile node at the current virtual time: the mobile node
+discovers an agent and, in a foreign network, registers with its home agent before its
+correspondent sends datagrams.
+*/
+void startSession(simulation &sim, uint32_t mobile)
+{
+	sim.events.schedule(sim.events.now(), simEvent(DISCOVERY_EVENT, mobile, 1));
+}
+
+/*
+Runs the discrete-event loop until the virtual clock reaches the given time. Lifetime timers
+that come due before the next event fire first, so expiries and re-registrations happen at
+their exact virtual time.
+*/
+void runSimulation(simulation &sim, simTime until)
+{
+	while(true)
+	{
+		simTime next = (sim.events.empty() || sim.events.nextTime() > until) ? until : sim.events.nextTime();
+		sim.lifetimeTimers.advance(next / SECOND, [&sim](timerId id, const timerEvent &event) { handleTimer(sim, id, event); });
+		if(sim.events.empty() || sim.events.nextTime() > until) break;
+		dispatchEvent(sim, sim.events.pop());
+	}
+}
+
+/*
+Event handlers: each protocol step runs when its event comes due and schedules the step that
+follows it, one link delay per message hop. An event key of 1 marks a full session (discovery,
+registration, then routing); a key of 0 is a standalone step such as a re-registration, and a
+discovery key of 2 is a handoff (discovery and registration in the new network, with the
+datagram stream already running). A binding update carries the caching correspondent's
+address as its key. A registration relay event is the time limit of the batch from foreign
+agent target to the home agent in its key.
+*/
+void dispatchEvent(simulation &sim, const simEvent &event)
+{
+	// A batch timer names a foreign agent and home agent rather than a mobile node
+	if(event.type == REGISTRATION_RELAY_EVENT)
+	{
+		simTime arrived;
+		if(sim.relay.oldest(event.target, (uint32_t) event.key, arrived) && arrived + sim.relay.wait() <= sim.events.now())
+			relayRegistrations(sim, event.target, (uint32_t) event.key, false);
+		return;
+	}
+
+	// A mobility step moves every mobile node at once
+	if(event.type == MOBILITY_EVENT)
+	{
+		moveMobileNodes(sim);
+		return;
+	}
+
+	// Entities involved with this event's mobile node. A mobile node at home still hears
+	// the first foreign agent's information in displayInformation.
+	uint32_t mobile = event.target;
+	bool away = sim.net.isAway(mobile);
+	mobileNode &MN = sim.net.getMobileNode(mobile);
+	homeAgent &HA = sim.net.getHomeAgent(sim.net.homeAgentOf(mobile));
+	foreignAgent &FA = sim.net.getForeignAgent(away ? sim.net.foreignAgentOf(mobile) : 0);
+	correspondentNode &CN = sim.net.getCorrespondent(sim.net.correspondentOf(mobile));
+
+	switch(event.type)
+	{
+		case DISCOVERY_EVENT:
+			agentDiscovery(MN, HA, FA, away ? FOREIGN : HOME, sim.agentMethod);
+			if(sim.exporter != NULL) sim.exporter->event(sim.events.now(), "discovery", MN.getIP(), HA.getHA(), away ? FA.getFA() : IPv4Addr());
+
+			// Advertisement reaches the mobile node, which then registers
+			if(away && event.key != 0)
+				sim.events.scheduleAfter(linkDelay, simEvent(REGISTRATION_EVENT, mobile, event.key == 1 ? 1 : 0));
+			break;
+
+		case REGISTRATION_EVENT:
+			if(!away) break;
+			if(MN.isRegistrationDue()) narrate(LOG_REGISTRATION) << "Mobile Node: Registration lifetime nearly expired, re-registering..." << endl << endl;
+			if(sim.relay.enabled())
+			{
+				queueRegistration(sim, mobile, event.key);
+				break;
+			}
+			registerMN(MN, HA, FA);
+			registrationDone(sim, mobile, event.key);
+			break;
+
+		case ROUTING_EVENT:
+			if(!away) break;
+			if(sim.routingMethod == INDIRECT) indirectRouting(MN, HA, FA, CN, &sim.net);
+			else if(sim.anchorMode != NO_ANCHOR) anchoredRouting(sim, mobile);
+			else if(sim.routingMethod == DIRECT) directRouting(MN, HA, FA, CN, &sim.net);
+			if(sim.exporter != NULL) sim.exporter->event(sim.events.now(), "datagram", MN.getIP(), HA.getHA(), FA.getFA());
+
+			// Correspondent keeps sending for the rest of the run
+			if(sim.datagramInterval > 0) sim.events.scheduleAfter(sim.datagramInterval, simEvent(ROUTING_EVENT, mobile, 1));
+			break;
+
+		case BINDING_UPDATE_EVENT:
+		{
+			// Correspondent caches the binding the home agent now holds, or drops its entry if
+			// the binding is gone
+			uint32_t handle = sim.net.findCorrespondent(IPv4Addr((uint32_t) event.key));
+			if(handle == topology::NONE) break;
+			correspondentNode &subscriber = sim.net.getCorrespondent(handle);
+			IPv4Addr careOfAddress;
+			int lifetime;
+			if(HA.queryBinding(MN.getIP(), subscriber.getIP(), careOfAddress, lifetime))
+			{
+				subscriber.updateBinding(MN.getIP(), careOfAddress, lifetime);
+				protocolMetrics::instance().count(COUNT_BINDING_UPDATES);
+				narrate(LOG_ROUTING, LOG_DEBUG) << "Correspondent " << subscriber.getIP() << ": Binding update, Mobile Node " << MN.getIP() << " is at " << careOfAddress << endl;
+				if(sim.exporter != NULL) sim.exporter->event(sim.events.now(), "binding-update", MN.getIP(), HA.getHA(), careOfAddress);
+			}
+			else if(subscriber.invalidateBinding(MN.getIP()))
+			{
+				protocolMetrics::instance().count(COUNT_BINDING_INVALIDATIONS);
+				narrate(LOG_ROUTING, LOG_DEBUG) << "Correspondent " << subscriber.getIP() << ": Binding for Mobile Node " << MN.getIP() << " invalidated" << endl;
+				if(sim.exporter != NULL) sim.exporter->event(sim.events.now(), "binding-invalidation", MN.getIP(), HA.getHA(), IPv4Addr());
+			}
+			break;
+		}
+
+		case HANDOFF_EVENT:
+			if(!away) break;
+
+			// Mobile node moves to another foreign network and registers there
+			if(sim.net.foreignAgentCount() > 1)
+			{
+				uint32_t to = MN.getRandom().below((uint32_t) sim.net.foreignAgentCount() - 1);
+				if(to >= sim.net.foreignAgentOf(mobile)) to++;
+				handoff(sim, mobile, to);
+			}
+			sim.events.scheduleAfter(sim.handoffInterval, simEvent(HANDOFF_EVENT, mobile, 0));
+			break;
+
+		case BUFFER_FLUSH_EVENT:
+		{
+			// The foreign agent the mobile node left learns the care-of-address its new registration
+			// bound and tunnels the datagrams it held there. Each reaches the mobile node a link delay
+			// after the flush plus one more hop, where it would have arrived a link delay after
+			// reaching the old agent. If the mobile node has moved on again since, the agent serving
+			// that care-of-address holds or drops them in turn.
+			if(!away) break;
+			foreignAgent &oldFA = sim.net.getForeignAgent((uint32_t) event.key);
+			IPv4Addr careOfAddress;
+			uint32_t serving = HA.lookupCOA(MN.getIP(), careOfAddress) ? sim.net.findForeignAgent(careOfAddress) : topology::NONE;
+			simTime now = sim.events.now();
+			protocolMetrics &metrics = protocolMetrics::instance();
+			size_t flushed = oldFA.flushHeld(MN.getIP(), [&](packetBuffer &packet, simTime arrived)
+			{
+				if(serving == topology::NONE)
+				{
+					metrics.count(COUNT_HANDOFF_LOST);
+					metrics.count(COUNT_DATAGRAMS_DROPPED);
+					return;
+				}
+				uint64_t started = metrics.start(PHASE_HANDOFF_BUFFER);
+				if(tunnelDatagram(packet, oldFA.getFA(), careOfAddress) && deliverToVisitor(packet, sim.net.getForeignAgent(serving)))
+					metrics.record(PHASE_HANDOFF_BUFFER, started, now + linkDelay - arrived);
+			});
+			if(flushed > 0)
+				narrate(LOG_ROUTING, LOG_DEBUG) << "Foreign Agent " << oldFA.getFA() << ": Sent " << flushed << " held datagrams to " << careOfAddress << endl;
+			break;
+		}
+	}
+}
+
+/*
+Called by the lifetime timer wheel whenever a timer comes due. The timer key names the agent
+and mobile node by address, so the owner is found through the topology. Home agent bindings
+and foreign agent visitor entries are removed when their lifetime runs out, and mobile nodes
+re-register shortly before their registration expires.
+*/
+void handleTimer(simulation &sim, timerId id, const timerEvent &event)
+{
+	IPv4Addr agent((uint32_t) (event.key >> 32));
+	IPv4Addr home((uint32_t) event.key);
+	uint32_t handle;
+
+	switch(event.type)
+	{
+		case BINDING_EXPIRY:
+		{
+			handle = sim.net.findHomeAgent(agent);
+			if(handle == topology::NONE) break;
+			homeAgent &HA = sim.net.getHomeAgent(handle);
+			IPv4Addr subscriber = HA.subscriberOf(home);
+			if(!HA.expireEntry(home)) break;
+			if(sim.exporter != NULL) sim.exporter->event(sim.lifetimeTimers.now() * SECOND, "binding-expiry", home, agent, IPv4Addr());
+
+			// Tell the correspondent caching the binding that it is gone
+			uint32_t mobile = sim.net.findMobileNode(home);
+			if(subscriber.isSet() && mobile != topology::NONE)
+				sim.events.schedule(sim.lifetimeTimers.now() * SECOND + linkDelay, simEvent(BINDING_UPDATE_EVENT, mobile, subscriber.toUint()));
+			break;
+		}
+		case VISITOR_EXPIRY:
+			handle = sim.net.findForeignAgent(agent);
+			if(handle != topology::NONE && sim.net.getForeignAgent(handle).expireEntry(home, id) && sim.exporter != NULL)
+				sim.exporter->event(sim.lifetimeTimers.now() * SECOND, "visitor-expiry", home, IPv4Addr(), agent);
+			break;
+		case REREGISTRATION:
+			handle = sim.net.findMobileNode(home);
+			if(handle == topology::NONE) break;
+			sim.net.getMobileNode(handle).setRegistrationDue(true);
+			if(sim.net.isAway(handle))
+				sim.events.schedule(sim.lifetimeTimers.now() * SECOND, simEvent(REGISTRATION_EVENT, handle, 0));
+			if(sim.exporter != NULL) sim.exporter->event(sim.lifetimeTimers.now() * SECOND, "reregistration", home, IPv4Addr(), IPv4Addr());
+			break;
+	}
+}
+
+/*
+Runs one scenario without prompts and adds its totals to result. Narration follows the
+logging options (silent unless asked for). The scenario's
+seed makes the run repeatable: the topology is built from the thread's stream and each mobile
+node draws from its own (see randomStream.h).
+*/
+bool runScenario(const scenarioConfig &config, scenarioResult &result, string &error)
+{
+	uint64_t seed = config.seed != 0 ? config.seed : (uint64_t) time(NULL);
+	randomService::local().seed(seed);
+	narrate(LOG_SIMULATION) << "Scenario " << config.name << ": seed " << seed << endl;
+	simulation sim;
+	if(config.loadSnapshot != "")
+	{
+		// Warm start from a saved state
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if(!loadSnapshot(sim, config.loadSnapshot, error)) return false;
+		result.restoreSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		result.restored++;
+	}
+	else
+	{
+		// Build the topology
+		sim.net.reserve(config.mobileNodes, config.homeAgents, config.foreignAgents, config.correspondents);
+		for(size_t i = 0; i < config.homeAgents; i++) sim.net.addHomeAgent(generateUniqueIP(sim.net));
+		sim.net.setCOAPoolSize(config.coaPoolSize);
+		for(size_t i = 0; i < config.foreignAgents; i++)
+		{
+			uint32_t agent = sim.net.addForeignAgent(generateUniqueIP(sim.net));
+			if(config.anchorMode != NO_ANCHOR) sim.net.getForeignAgent(agent).setForwardingLimit(config.mobileNodes);
+			if(config.coaPoolSize > 0) sim.net.setCOABlock(agent, generateCOABlock(sim.net));
+		}
+		for(size_t i = 0; i < config.correspondents; i++)
+			sim.net.getCorrespondent(sim.net.addCorrespondent(generateUniqueIP(sim.net))).setCacheSize(config.bindingCacheSize);
+		// With a mobility model each mobile node starts out in the coverage of the foreign agent
+		// it visits
+		sim.mobility.configure(config.mobility, config.foreignAgents);
+		for(size_t i = 0; i < config.mobileNodes; i++)
+		{
+			uint32_t mobile = sim.net.addMobileNode(generateUniqueIP(sim.net), generateMAC(),
+				(uint32_t) (i % config.homeAgents), (uint32_t) (i % config.correspondents));
+			uint32_t visited = sim.mobility.enabled() ? sim.mobility.add() : topology::NONE;
+			if(config.networkSelection == FOREIGN)
+				sim.net.moveTo(mobile, visited != topology::NONE ? visited : threadRandom().below((uint32_t) config.foreignAgents));
+		}
+		sim.agentMethod = config.agentMethod;
+		sim.routingMethod = config.routingMethod;
+		sim.datagramInterval = config.datagramInterval;
+		sim.handoffInterval = config.handoffInterval;
+		sim.anchorMode = config.anchorMode;
+		sim.forwardingLifetime = config.forwardingLifetime;
+		sim.handoffBuffers.configure(config.handoffBufferRings, config.handoffBufferDepth, DATAGRAM_SIZE);
+		sim.relay.configure(config.registrationBatch, config.registrationBatchWait);
+		if(sim.mobility.enabled())
+		{
+			sim.mobilityStep = config.mobilityStep;
+			sim.events.schedule(sim.mobilityStep, simEvent(MOBILITY_EVENT, 0, 0));
+		}
+
+		// Stagger the mobile nodes' sessions (and their handoffs) evenly over the first second
+		for(size_t i = 0; i < config.mobileNodes; i++)
+		{
+			sim.events.schedule(i * SECOND / config.mobileNodes, simEvent(DISCOVERY_EVENT, (uint32_t) i, 1));
+			if(sim.handoffInterval > 0)
+				sim.events.schedule(sim.handoffInterval + i * SECOND / config.mobileNodes, simEvent(HANDOFF_EVENT, (uint32_t) i, 0));
+		}
+	}
+
+	// Stream records while the run goes on, dumping the tables at each export interval
+	recordExporter exporter;
+	if(config.exportPrefix != "")
+	{
+		if(!exporter.open(config.exportPrefix, config.exportFileFormat, config.exportCompressed, error)) return false;
+		sim.exporter = &exporter;
+	}
+
+	uint64_t processedBefore = sim.events.processed();
+	bindingCacheStats cacheBefore;
+	for(size_t i = 0; i < sim.net.correspondentCount(); i++) cacheBefore.add(sim.net.getCorrespondent((uint32_t) i).cacheStats());
+	careOfAddressStats coaBefore;
+	for(size_t i = 0; i < sim.net.foreignAgentCount(); i++) coaBefore.add(sim.net.getForeignAgent((uint32_t) i).getCOAPool().stats());
+	datagramStats datagramsBefore = datagramStats::read();
+	simTime until = sim.events.now() + config.duration;
+	if(sim.exporter != NULL && config.exportInterval > 0)
+	{
+		for(simTime dump = sim.events.now() + config.exportInterval; dump < until; dump += config.exportInterval)
+		{
+			runSimulation(sim, dump);
+			exportTables(sim, dump);
+		}
+	}
+	runSimulation(sim, until);
+
+	if(sim.exporter != NULL)
+	{
+		exportTables(sim, until);
+		sim.exporter = NULL;
+		if(!exporter.close(error)) return false;
+		result.exportedRows += exporter.rows();
+		result.exportedBytes += exporter.bytes();
+		result.exportWaits += exporter.waits();
+	}
+
+	result.events += sim.events.processed() - processedBefore;
+	result.networkTime += config.duration;
+	result.mobileNodes += sim.net.mobileNodeCount();
+	for(size_t i = 0; i < sim.net.homeAgentCount(); i++) result.bindings += sim.net.getHomeAgent((uint32_t) i).bindingCount();
+	for(size_t i = 0; i < sim.net.correspondentCount(); i++) result.cache.add(sim.net.getCorrespondent((uint32_t) i).cacheStats());
+	result.cache.add(cacheBefore, -1);
+	result.forwarding.add(sim.forwarding);
+	for(size_t i = 0; i < sim.net.foreignAgentCount(); i++)
+	{
+		const careOfAddressPool &pool = sim.net.getForeignAgent((uint32_t) i).getCOAPool();
+		result.coa.add(pool.stats());
+		result.coaInUse += pool.allocated();
+		result.coaPoolSize += pool.size();
+	}
+	result.coa.add(coaBefore, -1);
+	result.relay.add(sim.relay.stats());
+	result.mobility.add(sim.mobility.stats());
+	datagramStats datagrams = datagramStats::read();
+	datagrams.add(datagramsBefore, -1);
+	result.datagrams.add(datagrams);
+	result.runs.push_back(make_pair(config.name, datagrams));
+
+	if(config.saveSnapshot != "")
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if(!saveSnapshot(sim, config.saveSnapshot, error)) return false;
+		result.saveSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		result.saved++;
+	}
+	return true;
+}
+
+/*
+Streams every home agent's bindings and every foreign agent's visitors to the exporter,
+stamped with the given network time
+*/
+void exportTables(simulation &sim, simTime time)
+{
+	for(size_t i = 0; i < sim.net.homeAgentCount(); i++) sim.net.getHomeAgent((uint32_t) i).exportEntries(*sim.exporter, time);
+	for(size_t i = 0; i < sim.net.foreignAgentCount(); i++) sim.net.getForeignAgent((uint32_t) i).exportEntries(*sim.exporter, time);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+/*
+Writes the whole simulation state to a snapshot file in one sequential write
+*/
+bool saveSnapshot(const simulation &sim, const string &fileName, string &error)
+{
+	snapshotWriter out;
+	sim.save(out);
+	return out.write(fileName.c_str(), error);
+}
+
+/*
+Replaces the simulation state with the one in a snapshot file. The file is mapped and each
+table is copied from it as a block.
+*/
+bool loadSnapshot(simulation &sim, const string &fileName, string &error)
+{
+	snapshotReader in;
+	if(!in.open(fileName.c_str(), error)) return false;
+	if(sim.load(in)) return true;
+	error = in.error() != "" ? in.error() : fileName + ": snapshot does not match this simulator";
+	return false;
+}
+#else
+bool saveSnapshot(const simulation&, const string&, string &error)
+{
+	error = "Snapshots need a POSIX system (mmap, writev)";
+	return false;
+}
+
+bool loadSnapshot(simulation &sim, const string &fileName, string &error) { return saveSnapshot(sim, fileName, error); }
+#endif
+
+/*
+Runs every scenario in a scenario file back to back. Only malformed scenarios and the final
+summary are printed. Returns a non-zero exit code if the file could not be read or any
+scenario was malformed.
+*/
+int runScenarioFile(const char* fileName)
+{
+	// Open file
+	ifstream fin(fileName);
+	if(!fin.is_open())
+	{
+		cerr << "Could not open scenario file " << fileName << endl;
+		return 1;
+	}
+
+	// Run each scenario as it is read
+	scenarioReader reader(fin);
+	scenarioConfig config;
+	scenarioResult result;
+	string error;
+	int run = 0, failed = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	while(reader.next(config, error))
+	{
+		if(error != "")
+		{
+			cerr << fileName << ":" << reader.getLine() << ": " << error << endl;
+			failed++;
+			continue;
+		}
+		if(!runScenario(config, result, error))
+		{
+			cerr << fileName << ":" << reader.getLine() << ": " << error << endl;
+			failed++;
+			continue;
+		}
+		run++;
+	}
+
+	printSummary(result, chrono::duration<double>(chrono::steady_clock::now() - start).count(), run, failed);
+	return failed == 0 ? 0 : 1;
+}
+
+/*
+Home agent side of registration over the wire: decodes a registration request, updates the
+Mobility Binding Table and writes the registration reply. A lifetime of 0 deregisters the
+mobile node. Requests naming another home agent are denied with code 136. Returns the reply
+length, or 0 if the message is not a registration request.
+*/
+size_t serveRegistration(homeAgent &HA, const uint8_t* request, size_t length, uint8_t* reply, size_t capacity)
+{
+	registrationView view;
+	if(!view.parse(request, length) || !view.isRequest()) return 0;
+	if(view.homeAgent() != HA.getHA())
+		return encodeRegistrationReply(reply, capacity, REGISTRATION_UNKNOWN_HOME_AGENT, 0, view.homeAddress(), HA.getHA(), view.identification());
+
+	if(view.lifetime() == 0) HA.removeEntry(view.homeAddress());
+	else HA.addEntry(view.homeAddress(), view.careOfAddress(), view.lifetime());
+	return encodeRegistrationReply(reply, capacity, REGISTRATION_ACCEPTED, view.lifetime(), view.homeAddress(), HA.getHA(), view.identification());
+}
+
+#ifdef __linux__
+/*
+Runs a home agent as a UDP registration service on 127.0.0.1 until the process is stopped
+*/
+int runRegistrationServer(uint16_t port)
+{
+	homeAgent HA(IPv4Addr(127, 0, 0, 1));
+	registrationServer server;
+	string error;
+	if(!server.open(port, error))
+	{
+		cerr << error << endl;
+		return 1;
+	}
+	cout << "Home Agent " << HA.getHA() << " serving registrations on 127.0.0.1:" << server.port() << endl;
+	server.run([&HA](const uint8_t* request, size_t length, uint8_t* reply, size_t capacity)
+	{
+		return serveRegistration(HA, request, length, reply, capacity);
+	});
+	return 0;
+}
+
+/*
+Starts the registration service on its own thread, drives it with simulated foreign agents
+over loopback and reports registrations/second and reply latency
+*/
+int runRegistrationLoadTest(size_t requests, size_t foreignAgents, uint16_t port)
+{
+	const size_t window = 32;
+	if(requests == 0 || foreignAgents == 0)
+	{
+		cerr << "Need at least one request and one foreign agent" << endl;
+		return 1;
+	}
+
+	homeAgent HA(IPv4Addr(127, 0, 0, 1));
+	registrationServer server;
+	string error;
+	if(!server.open(port, error))
+	{
+		cerr << error << endl;
+		return 1;
+	}
+	thread service([&server, &HA]()
+	{
+		server.run([&HA](const uint8_t* request, size_t length, uint8_t* reply, size_t capacity)
+		{
+			return serveRegistration(HA, request, length, reply, capacity);
+		});
+	});
+
+	registrationLoadResult result;
+	bool ok = runRegistrationLoad(server.port(), HA.getHA(), requests, foreignAgents, window, result, error);
+	server.stop();
+	service.join();
+	if(!ok)
+	{
+		cerr << error << endl;
+		return 1;
+	}
 
-		// Agent Discovery
-		agentDiscovery(MN, HA, FA, networkSelection, agentMethod);
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            UDP Registration Service (127.0.0.1:" << server.port() << ")" << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "Foreign agents: " << foreignAgents << " (" << window << " requests in flight each)" << endl;
+	cout << "Requests sent: " << result.sent << endl;
+	cout << "Registrations accepted: " << result.accepted;
+	if(result.rejected > 0) cout << " (" << result.rejected << " denied)";
+	cout << endl;
+	cout << "Requests lost: " << result.lost << endl;
+	cout << "Wall time: " << result.seconds << " sec" << endl;
+	cout << "Registrations/second: " << (result.seconds > 0 ? result.accepted / result.seconds : 0) << endl;
+	cout << "Reply latency: median " << result.medianUs << " us, p99 " << result.p99Us << " us" << endl;
+	cout << "Bindings at Home Agent: " << HA.bindingCount() << endl;
+	return result.lost == 0 ? 0 : 1;
+}
+#else
+int runRegistrationServer(uint16_t)
+{
+	cerr << "The UDP registration service needs Linux (epoll, recvmmsg, sendmmsg)" << endl;
+	return 1;
+}
 
-		// If mobile node is in foreign network
-		if(networkSelection == FOREIGN)
-		{
-			// Register Mobile Node to Home Agent
-			registerMN( MN, HA, FA );   
+int runRegistrationLoadTest(size_t, size_t, uint16_t) { return runRegistrationServer(0); }
+#endif
 
-			// Datagram routing
-			if(routingMethod == INDIRECT) indirectRouting(MN, HA, FA, CN);
-			else if(routingMethod == DIRECT) directRouting(MN, HA, FA, CN);
+/*
+Applies the logging options and removes them from the argument list, returning the new
+argument count (or -1 after reporting a bad option):
+	--log-level LEVEL              lowest level shown: debug, info, warning, error or silent
+	--log SUBSYSTEM=LEVEL          level for one subsystem: simulation, discovery,
+	                               registration, routing, tables or timers
+	--log-file FILE                write narration to FILE instead of the terminal
+*/
+int configureLogging(int argc, char* argv[], bool &configured)
+{
+	logger &log = logger::instance();
+	int kept = 1;
+	for(int i = 1; i < argc; i++)
+	{
+		string option = argv[i];
+		if(option != "--log-level" && option != "--log" && option != "--log-file")
+		{
+			argv[kept++] = argv[i];
+			continue;
 		}
-
-		// Prompt user for next action
-		cout << "1. Reconfigure simulator" << endl;
-		cout << "2. Quit simulator" << endl;
-		cout << "Enter your selection: ";
-		cin >> selection;
-		switch(selection)
+		if(i + 1 >= argc)
 		{
-			case '1':
-				configuration(agentMethod, routingMethod, networkSelection);
-				break;
-			default:
-				keepRunning = false;
+			cerr << option << " needs a value" << endl;
+			return -1;
 		}
-    } while(keepRunning);
-
-	// Output results to database
-	outputDatabase(MN, HA, FA, CN);
-
-	return 0;
+		string value = argv[++i];
+		configured = true;
+
+		logLevel level;
+		logSubsystem subsystem;
+		size_t equals = value.find('=');
+		if(option == "--log-level" && parseLogLevel(value, level)) log.setLevel(level);
+		else if(option == "--log" && equals != string::npos && parseLogSubsystem(value.substr(0, equals), subsystem) &&
+		        parseLogLevel(value.substr(equals + 1), level)) log.setLevel(subsystem, level);
+		else if(option == "--log-file" && log.openFile(value.c_str())) continue;
+		else
+		{
+			cerr << "Bad value for " << option << ": " << value << endl;
+			return -1;
+		}
+	}
+	argv[kept] = NULL;
+	return kept;
 }
 
-// Function Implementation
-void Sleep(int time) { this_thread::sleep_for(chrono::seconds(time)); }
-
 /*
-This function generates a random IP address
+Applies the metrics options and removes them from the argument list, returning the new
+argument count (or -1 after reporting a bad option):
+	--metrics FILE                 append a JSON snapshot of the protocol phase histograms and
+	                               counters to FILE every interval and at exit
+	--metrics-interval SECONDS     time between snapshots (default 10)
 */
-string generateIP()
+int configureMetrics(int argc, char* argv[], metricsDumper &dumper)
 {
-   // Generate random IP address
-   int ipInt[4] = { rand() % 31 + 192,
-      rand() % 254 + 1,
-      rand() % 254 + 1,
-      rand() % 254 + 1};
-   string IP = to_string(ipInt[0]);   
-   for(int i = 1; i < 4; i++) IP += "." + to_string(ipInt[i]);
-   
-   // return the IP
-   return IP;
+	const char* fileName = NULL;
+	double interval = 10;
+	int kept = 1;
+	for(int i = 1; i < argc; i++)
+	{
+		string option = argv[i];
+		if(option != "--metrics" && option != "--metrics-interval")
+		{
+			argv[kept++] = argv[i];
+			continue;
+		}
+		if(i + 1 >= argc)
+		{
+			cerr << option << " needs a value" << endl;
+			return -1;
+		}
+		char* end;
+		if(option == "--metrics") fileName = argv[++i];
+		else if((interval = strtod(argv[++i], &end)) <= 0 || *end != '\0')
+		{
+			cerr << "Bad value for " << option << ": " << argv[i] << endl;
+			return -1;
+		}
+	}
+	argv[kept] = NULL;
+	if(fileName != NULL && !dumper.start(fileName, interval))
+	{
+		cerr << "Could not create metrics file " << fileName << endl;
+		return -1;
+	}
+	return kept;
 }
 
 /*
-This function generates a random MAC address
+Displays the totals of a headless run
 */
-string generateMAC()
+void printSummary(const scenarioResult &result, double wallSeconds, int run, int failed)
 {
-   // Generate random MAC address
-   char buffer[33];
-   string MAC = "";
+	logFlush();
+	cout << "---------------------------------------------------------" << endl;
+	cout << "                   Simulation Summary                    " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "Scenarios run: " << run;
+	if(failed > 0) cout << " (" << failed << " malformed or failed, skipped)";
+	cout << endl;
+	cout << "Mobile nodes simulated: " << result.mobileNodes << endl;
+	cout << "Network time simulated: " << result.networkTime / SECOND << " sec" << endl;
+	cout << "Wall time: " << wallSeconds << " sec" << endl;
+	cout << "Events processed: " << result.events << endl;
+	cout << "Events/second: " << (wallSeconds > 0 ? result.events / wallSeconds : 0) << endl;
+	cout << "Bindings at Home Agents: " << result.bindings << endl;
+	if(result.restored > 0) cout << "Snapshots restored: " << result.restored << " (" << result.restoreSeconds * 1000 << " ms)" << endl;
+	if(result.saved > 0) cout << "Snapshots saved: " << result.saved << " (" << result.saveSeconds * 1000 << " ms)" << endl;
+	if(result.exportedRows > 0)
+		cout << "Rows exported: " << result.exportedRows << " (" << result.exportedBytes / 1024 << " KB, " << result.exportWaits << " writer waits)" << endl;
+
+	// A direct datagram crosses CN -> FA -> MN, after a CN -> HA -> CN query unless the
+	// correspondent's binding cache already holds the care-of-address
+	const bindingCacheStats &cache = result.cache;
+	uint64_t lookups = cache.hits + cache.misses;
+	if(lookups > 0)
+	{
+		double query = 2.0 * linkDelay / MILLISECOND;
+		cout << "Binding cache lookups: " << lookups << " (" << cache.hits << " hits, " << cache.misses << " misses, "
+		     << 100.0 * cache.hits / lookups << "% hit rate)" << endl;
+		cout << "Home Agent round trips avoided: " << cache.hits << " (" << cache.hits * query / 1000 << " sec of latency saved)" << endl;
+		cout << "Binding cache updates: " << cache.updates << ", invalidations: " << cache.invalidations << ", expirations: "
+		     << cache.expirations << ", evictions: " << cache.evictions << endl;
+		cout << "Direct routing latency per datagram: " << query + query * cache.misses / lookups << " ms with the cache, "
+		     << 2 * query << " ms without" << endl;
+	}
 
-   _itoa_s((rand() % 254 + 1), buffer, 4, 16);
-   if (string(buffer).length() == 1)
-	MAC += "0";
-   MAC += buffer;
+	// Datagrams that reached a foreign agent after the mobile node left it, and the delay added to
+	// those held there until the new foreign agent reported the move. The percentiles cover every
+	// run; the rest is counted per run, and shown per scenario when there are several.
+	protocolMetrics &metrics = protocolMetrics::instance();
+	const datagramStats &datagrams = result.datagrams;
+	if(datagrams.delivered + datagrams.dropped > 0)
+	{
+		cout << "Datagrams delivered: " << datagrams.delivered << ", dropped: " << datagrams.dropped << " ("
+		     << 100.0 * datagrams.dropped / (datagrams.delivered + datagrams.dropped) << "% loss)" << endl;
+	}
+	if(datagrams.held + datagrams.lost > 0)
+	{
+		const latencyHistogram &delay = metrics.networkTime(PHASE_HANDOFF_BUFFER);
+		cout << "Datagrams reaching a Foreign Agent after the Mobile Node left: " << datagrams.held + datagrams.lost << " (" << datagrams.held
+		     << " held, " << datagrams.lost << " lost)" << endl;
+		cout << "Held datagrams delivered: " << datagrams.flushed << " (added delay mean "
+		     << (datagrams.flushed > 0 ? (double) datagrams.flushDelay / datagrams.flushed / MILLISECOND : 0) << " ms, p99 "
+		     << (double) delay.percentile(0.99) / MILLISECOND << " ms, max " << (double) delay.max() / MILLISECOND << " ms)" << endl;
+	}
+	for(size_t i = 0; result.runs.size() > 1 && i < result.runs.size(); i++)
+	{
+		const datagramStats &stats = result.runs[i].second;
+		if(stats.delivered + stats.dropped + stats.held + stats.lost == 0) continue;
+		cout << "Scenario " << result.runs[i].first << ": " << stats.delivered << " datagrams delivered, " << stats.dropped << " dropped; "
+		     << stats.held << " held (" << stats.flushed << " delivered, added delay mean "
+		     << (stats.flushed > 0 ? (double) stats.flushDelay / stats.flushed / MILLISECOND : 0) << " ms), " << stats.lost << " lost after a handoff" << endl;
+	}
 
-   for (int i = 1; i < 6; i++)
-   {
-   	_itoa_s((rand() % 254 + 1), buffer, 4, 16);
-	MAC += "-";
-	if (string(buffer).length() == 1)
-		MAC += "0";
-	MAC += buffer;
-   }
-  
-   return MAC;
+	// Batched registration relay: requests per message, latency from request to reply and the
+	// rate the foreign and home agents get through them
+	const registrationRelayStats &relay = result.relay;
+	if(relay.batches > 0)
+	{
+		double relaySeconds = relay.wallTicks * metrics.nsPerTick() / 1e9;
+		cout << "Registration batches: " << relay.batches << " (" << relay.requests << " requests, " << (double) relay.requests / relay.batches
+		     << " per batch, " << relay.fullBatches << " sent full)" << endl;
+		cout << "Registration latency: mean " << (relay.requests > 0 ? (double) relay.latency / relay.requests / MILLISECOND : 0) << " ms, max "
+		     << (double) relay.maxLatency / MILLISECOND << " ms; " << (relaySeconds > 0 ? relay.requests / relaySeconds : 0)
+		     << " registrations/sec relayed and applied" << endl;
+	}
+
+	// Mobility model: position updates per second of wall time, the handoffs they caused and the
+	// advertisements a mobile node heard where it looked for a new agent
+	const mobilityStats &mobility = result.mobility;
+	if(mobility.steps > 0)
+	{
+		double mobilitySeconds = mobility.wallTicks * metrics.nsPerTick() / 1e9;
+		cout << "Mobility steps: " << mobility.steps << " (" << mobility.updates << " position updates, "
+		     << (mobilitySeconds > 0 ? mobility.updates / mobilitySeconds / 1e6 : 0) << " million/sec, " << mobility.legs << " legs)" << endl;
+		cout << "Coverage crossings: " << mobility.crossings << " (" << mobility.handoffs << " handoffs, "
+		     << (mobility.crossings > 0 ? (double) mobility.heard / mobility.crossings : 0) << " agents in range per crossing, "
+		     << mobility.uncovered << " node steps out of every agent's range)" << endl;
+	}
+
+	// Co-located care-of-addresses handed out by the foreign agents' pools
+	const careOfAddressStats &coa = result.coa;
+	if(result.coaPoolSize > 0)
+	{
+		cout << "Care-of-addresses in use: " << result.coaInUse << " of " << result.coaPoolSize << " (" << coa.assigned << " assigned, "
+		     << coa.released << " released on expiry, " << coa.exhausted << " registrations found the pool empty)" << endl;
+	}
+
+	// Tunnel hops (one link delay each) and wall time per anchored datagram, by handoffs since
+	// the anchor was chosen
+	const forwardingStats &forwarding = result.forwarding;
+	double nsPerTick = metrics.nsPerTick();
+	for(int g = 0; g < forwardingStats::groups; g++)
+	{
+		if(forwarding.datagrams[g] == 0) continue;
+		uint64_t delivered = forwarding.datagrams[g] - forwarding.dropped[g];
+		double meanHops = delivered > 0 ? (double) forwarding.hops[g] / delivered : 0;
+		cout << "Anchored datagrams after " << forwardingStats::groupName(g) << " handoffs: " << forwarding.datagrams[g]
+		     << " (" << forwarding.dropped[g] << " dropped), " << meanHops << " tunnel hops (max " << forwarding.maxHops[g] << "), "
+		     << meanHops * linkDelay / MILLISECOND << " ms forwarding, " << forwarding.wallTicks[g] * nsPerTick / forwarding.datagrams[g]
+		     << " ns wall per datagram" << endl;
+	}
 }
 
 /*
-Prints information of mobile node, home agent, foreign agent
+Prints information of mobile node, home agent, foreign agent to the calling step's narration
 */
-void displayInformation(mobileNode MN, homeAgent HA, foreignAgent FA)
+void displayInformation(ostream &out, mobileNode &MN, homeAgent &HA, foreignAgent &FA)
 {
 	// Display information
-	cout << "Mobile Node IP: " << MN.getIP() << endl;
-	cout << "Home Agent address: " << HA.getHA() << endl;
-	cout << "Foreign Agent address: " << FA.getFA() << endl;
-	cout << "--------------------------------------" << endl << endl;
+	out << "Mobile Node IP: " << MN.getIP() << endl;
+	out << "Home Agent address: " << HA.getHA() << endl;
+	out << "Foreign Agent address: " << FA.getFA() << endl;
+	out << "--------------------------------------" << endl << endl;
 }
 
 /*
@@ -576,7 +2706,8 @@ void configuration(ICMP_t& agentDiscovery, routing_t& r, network& n)
 	char selection;
 	bool continueRunning = true, flag1 = false, flag2 = false, flag3 = false;
 	
-	// Display title
+	// Display title once pending narration is on screen
+	logFlush();
 	cout << "---------------------------------------------------------" << endl;
 	cout << "                        Mobile IP                        " << endl;
     cout << "---------------------------------------------------------" << endl;
@@ -671,17 +2802,20 @@ The second method is through solicitation, where the mobile node broadcasts an I
 specified with a type field of 10. When an agent receives the ICMP message, it unicasts an
 agent advertisement to that mobile node.
 */
-void agentDiscovery(mobileNode m, homeAgent h, foreignAgent f, network networkSelection, ICMP_t agentMethod)
+void agentDiscovery(mobileNode &m, homeAgent &h, foreignAgent &f, network networkSelection, ICMP_t agentMethod)
 {
+	uint64_t started = protocolMetrics::instance().start(PHASE_DISCOVERY);
+	ostream &out = narrate(LOG_DISCOVERY);
+
 	// Select method (advertisement or solicitation)
-	cout << "---------------------------------------------------------" << endl;
-	cout << "            Agent Discovery (";
-	if(agentMethod == ADVERTISEMENT) cout << "ADVERTISEMENT)" << endl;
-	else if(agentMethod == SOLICITATION) cout << "SOLICITATION)" << endl;
-	cout << "---------------------------------------------------------" << endl;
+	out << "---------------------------------------------------------" << endl;
+	out << "            Agent Discovery (";
+	if(agentMethod == ADVERTISEMENT) out << "ADVERTISEMENT)" << endl;
+	else if(agentMethod == SOLICITATION) out << "SOLICITATION)" << endl;
+	out << "---------------------------------------------------------" << endl;
 
 	// Display information
-	displayInformation(m, h, f);
+	displayInformation(out, m, h, f);
 
 	// Solicitation
 	if(agentMethod == SOLICITATION)
@@ -690,14 +2824,14 @@ void agentDiscovery(mobileNode m, homeAgent h, foreignAgent f, network networkSe
 		ICMP solicitation(SOLICITATION, m.getIP(), false, false, false);
 
 		// Mobile node broadcast ICMP message to agent in network
-		cout << "Mobile Node broadcasting solicitation..." << endl;
+		out << "Mobile Node broadcasting solicitation..." << endl;
 		solicitation.printICMP();
 		Sleep(sleepTime);
 	}
 
 	// Advertisement
 		// Listen for broadcast
-		cout << "Mobile Node listening for Home Agent or Foreign Agent advertisement..." << endl << endl;
+		out << "Mobile Node listening for Home Agent or Foreign Agent advertisement..." << endl << endl;
 		Sleep(sleepTime);
 
 		// Agent broadcast ICMP message/advertisement
@@ -709,8 +2843,8 @@ void agentDiscovery(mobileNode m, homeAgent h, foreignAgent f, network networkSe
 			advertisement.insertCOA(h.getHA());
 
 			// Print advertisement
-			if( agentMethod == SOLICITATION ) cout << "Home Agent UNICASTING advertisement... " << endl;
-			else cout << "Home Agent BROADCASTING advertisement... " << endl;
+			if( agentMethod == SOLICITATION ) out << "Home Agent UNICASTING advertisement... " << endl;
+			else out << "Home Agent BROADCASTING advertisement... " << endl;
 			advertisement.printICMP();
 		}
 		// Otherwise, foreign network
@@ -721,29 +2855,34 @@ void agentDiscovery(mobileNode m, homeAgent h, foreignAgent f, network networkSe
 			advertisement.insertCOA(f.getFA());
 			
 			// Print advertisement
-			if( agentMethod == SOLICITATION ) cout << "Foreign Agent UNICASTING advertisement... " << endl;
-			else cout << "Foreign Agent BROADCASTING advertisement... " << endl;
+			if( agentMethod == SOLICITATION ) out << "Foreign Agent UNICASTING advertisement... " << endl;
+			else out << "Foreign Agent BROADCASTING advertisement... " << endl;
 			advertisement.printICMP();
 		}
 		Sleep(sleepTime);	
 	
 	// Confirm Mobile Node received advertisement
-	cout << "Mobile Node received advertisement!" << endl;
+	out << "Mobile Node received advertisement!" << endl;
 
 	// Check if function is not at home network	
 	if( networkSelection == FOREIGN )
     {    
        // Confirm Mobile Node is in foreign network
-       cout << "Mobile Node is in foreign network!" << endl << endl;
+       out << "Mobile Node is in foreign network!" << endl << endl;
        Sleep(sleepTime);
 	}
 
 	// Otherwise, mobile IP is not needed
-    else cout << "Mobile Node is in home network, no need for Mobile IP!" << endl;
+    else out << "Mobile Node is in home network, no need for Mobile IP!" << endl;
 
 	// Print divisor for next section
-	cout << "---------------------------------------------------------" << endl << endl;
+	out << "---------------------------------------------------------" << endl << endl;
 
+	// A solicitation adds one hop before the advertisement
+	protocolMetrics &metrics = protocolMetrics::instance();
+	metrics.count(COUNT_ADVERTISEMENTS);
+	if(agentMethod == SOLICITATION) metrics.count(COUNT_SOLICITATIONS);
+	metrics.record(PHASE_DISCOVERY, started, agentMethod == SOLICITATION ? 2 * linkDelay : linkDelay);
 }
 
 /*
@@ -774,70 +2913,84 @@ automatically when the mobile node registers a new care-of-address.
 */
 void registerMN( mobileNode &m, homeAgent &h, foreignAgent &f )
 {
+	protocolMetrics &metrics = protocolMetrics::instance();
+	uint64_t started = metrics.start(PHASE_REGISTRATION_REQUEST);
+	ostream &out = narrate(LOG_REGISTRATION);
+
 	// Display section title
-	cout << "---------------------------------------------------------" << endl;
-	cout << "                Registration with Home Agent             " << endl;
-	cout << "---------------------------------------------------------" << endl;
+	out << "---------------------------------------------------------" << endl;
+	out << "                Registration with Home Agent             " << endl;
+	out << "---------------------------------------------------------" << endl;
 
 	// Display information
-	displayInformation(m, h, f);
+	displayInformation(out, m, h, f);
 
 	// Create registration lifetime and ID
-	int lifetimeRequest = rand() % 8000 + 1999;
-	int lifetimeReply = lifetimeRequest - rand() % 1999;
-	int registrationId = rand() % 9999;
+	randomStream &random = m.getRandom();
+	int lifetimeRequest = (int) random.between(1999, 9998);
+	int lifetimeReply = lifetimeRequest - (int) random.below(1999);
+	uint64_t registrationId = random.next();
 
     // MN: send request to foreign agent
-  	    // Set COA for mobile node
-		m.setCOA(f.getFA());
+  	    // Set COA for mobile node (the foreign agent's address, or one of its own from the
+  	    // agent's pool)
+		m.setCOA(f.assignCOA(m.getIP()));
 
 		// Initialize registration REQUEST
 		registrationMessage request(REQUEST, m.getCOA(), h.getHA(), m.getIP(), lifetimeRequest, registrationId);
-	    cout << "Mobile Node: Sending registration request to Foreign Agent..." << endl;
+	    out << "Mobile Node: Sending registration request to Foreign Agent..." << endl;
 		request.printRegistration(false);
 	    Sleep(sleepTime);
 
     // FA: update visitor list
-	cout << "Foreign Agent: Received registration request!" << endl;
-    cout << "Foreign Agent: Updating Visitor List..." << endl << endl;
+	out << "Foreign Agent: Received registration request!" << endl;
+    out << "Foreign Agent: Updating Visitor List..." << endl << endl;
     Sleep(sleepTime);
     f.addEntry(m.getIP(), h.getHA(), m.getMAC(), lifetimeRequest);
     f.printEntries();
-    cout << endl << "Visitor List is updated!" << endl << endl << endl;
+    out << endl << "Visitor List is updated!" << endl << endl << endl;
     Sleep(sleepTime);
 
     // FA: forward request to home agent
-    cout << "Foreign Agent: Forwarding registration request to Home Agent..." << endl;
+    out << "Foreign Agent: Forwarding registration request to Home Agent..." << endl;
     request.printRegistration(true);
 	Sleep(sleepTime);
             
     // HA: update binding table
-	cout << "Home Agent: Received registration request!" << endl;
-    cout << "Home Agent: Updated Mobile Binding Table..." << endl << endl;
+	out << "Home Agent: Received registration request!" << endl;
+    out << "Home Agent: Updated Mobile Binding Table..." << endl << endl;
     Sleep(sleepTime);
-    h.addEntry(m.getIP(), f.getFA(), lifetimeReply);
+    h.addEntry(m.getIP(), m.getCOA(), lifetimeReply);
     h.printEntries();
-    cout << endl << "Mobile Binding Table is updated!" << endl << endl << endl;
+    out << endl << "Mobile Binding Table is updated!" << endl << endl << endl;
     Sleep(sleepTime);
 
+	// Request crossed MN -> FA -> HA
+	metrics.record(PHASE_REGISTRATION_REQUEST, started, 2 * linkDelay);
+	started = metrics.start(PHASE_REGISTRATION_REPLY);
+
 	// HA: send reply to foreign agent
 		// Initialize registration REPLY
-		registrationMessage reply(REPLY, "", h.getHA(), m.getIP(), lifetimeReply, registrationId);
-		cout << "Home Agent: Sending registration reply to Foreign Agent..." << endl;
+		registrationMessage reply(REPLY, IPv4Addr(), h.getHA(), m.getIP(), lifetimeReply, registrationId);
+		out << "Home Agent: Sending registration reply to Foreign Agent..." << endl;
 		reply.printRegistration(true);
 		Sleep(sleepTime);
             
     // FA: relay reply to mobile node
-	cout << "Foreign Agent: Received registration reply!" << endl;
-    cout << "Foreign Agent: Forwarding registration reply to Mobile Node..." << endl;
+	out << "Foreign Agent: Received registration reply!" << endl;
+    out << "Foreign Agent: Forwarding registration reply to Mobile Node..." << endl;
 	reply.printRegistration(false);
 
-	// MN: Show received message
-	cout << "Mobile Node: Received registration reply!" << endl;
+	// MN: Show received message and re-register before the granted lifetime runs out
+	out << "Mobile Node: Received registration reply!" << endl;
+	m.scheduleReregistration(lifetimeReply);
 
 	// Print divisor for next section
-	cout << "---------------------------------------------------------" << endl << endl;
+	out << "---------------------------------------------------------" << endl << endl;
 
+	// Reply crossed HA -> FA -> MN
+	metrics.record(PHASE_REGISTRATION_REPLY, started, 2 * linkDelay);
+	metrics.count(COUNT_REGISTRATIONS);
 }
 
 /*
@@ -846,47 +2999,78 @@ The datagrams are routed to the mobile node's home network, where the home agent
 intercept the datagrams. It forwards the encapsulated datagrams (tunneling) to the foreign 
 agent of the mobile node specified in its binding table. The foreign agent then forwards the 
 decapsulated datagrams to the mobile node. The correspondent node is unaware that the mobile 
-node is located in a foreign network.
+node is located in a foreign network. Until the mobile node's latest registration reaches the
+home agent, the binding may still name a foreign agent it has left, over any number of
+handoffs; given the topology (net), the tunnel ends at the agent owning the care-of-address,
+which holds or drops the datagram. Without it the tunnel ends at FA.
 */
-void indirectRouting(mobileNode MN, homeAgent HA, foreignAgent FA, correspondentNode CN)
+void indirectRouting(mobileNode &MN, homeAgent &HA, foreignAgent &FA, correspondentNode &CN, topology* net)
 {
+	ostream &out = narrate(LOG_ROUTING);
+
 	// Display section title
-	cout << "---------------------------------------------------------" << endl;
-	cout << "               Indirect Routing of Datagrams             " << endl;
-	cout << "---------------------------------------------------------" << endl;
+	out << "---------------------------------------------------------" << endl;
+	out << "               Indirect Routing of Datagrams             " << endl;
+	out << "---------------------------------------------------------" << endl;
   
 	// Display information
-	displayInformation(MN, HA, FA);
+	displayInformation(out, MN, HA, FA);
 
 	// Initialize datagram
-	int sequenceNumber = rand() % 65536;
+	int sequenceNumber = (int) MN.getRandom().below(65536);
 	datagram data(CN.getIP(), MN.getIP(), sequenceNumber);
+	packetBuffer packet;
+	data.encode(packet.append(DATAGRAM_SIZE), DATAGRAM_SIZE);
 
 	// CN: Send datagram from to mobile node
-	cout << "Correspondent: Sending datagram to Mobile Node (Home Agent)..." << endl;	
-	data.print(false, "");
+	out << "Correspondent: Sending datagram to Mobile Node (Home Agent)..." << endl;	
+	printPacket(packet);
 	Sleep(sleepTime);
 
 	// HA: Send encapsulated datagram to mobile node's care-of-address
-	cout << "Home Agent: Intercepted datagram sent to Mobile Node!" << endl;
-	cout << "Home Agent: Looking up Mobile Node's care-of-address in binding table..." << endl;
+	out << "Home Agent: Intercepted datagram sent to Mobile Node!" << endl;
+	out << "Home Agent: Looking up Mobile Node's care-of-address in binding table..." << endl;
 	Sleep(sleepTime);
 	HA.printEntries();
-	cout << endl << "Home Agent: Mobile Node's care-of-address found!" << endl;
-	cout << "Home Agent: Sending datagram to care-of-address " << MN.getCOA() << "..." << endl;
-	data.print(true, MN.getCOA());
+	IPv4Addr careOfAddress;
+	protocolMetrics &metrics = protocolMetrics::instance();
+	uint64_t started = metrics.start(PHASE_HA_LOOKUP);
+	bool bound = HA.lookupCOA(MN.getIP(), careOfAddress);
+	metrics.record(PHASE_HA_LOOKUP, started, 0);
+	if(!bound)
+	{
+		metrics.count(COUNT_LOOKUP_MISSES);
+		metrics.count(COUNT_DATAGRAMS_DROPPED);
+		narrate(LOG_ROUTING, LOG_WARNING) << endl << "Home Agent: Mobile Node has no binding, datagram dropped!" << endl;
+		out << "---------------------------------------------------------" << endl << endl;
+		return;
+	}
+	out << endl << "Home Agent: Mobile Node's care-of-address found!" << endl;
+	out << "Home Agent: Sending datagram to care-of-address " << careOfAddress << "..." << endl;
+	if(!tunnelDatagram(packet, HA.getHA(), careOfAddress))
+	{
+		out << "---------------------------------------------------------" << endl << endl;
+		return;
+	}
+	printPacket(packet);
 	Sleep(sleepTime);
 
 	// FA: Forward decapsulated datagram to mobile node
-	cout << "Foreign Agent: Received encapsulated datagram sent to Mobile Node!" << endl;
-	cout << "Foreign Agent: Forwarding decapsulated datagram to Mobile Node..." << endl;
-	data.print(false, "");
+	out << "Foreign Agent: Received encapsulated datagram sent to Mobile Node!" << endl;
+	out << "Foreign Agent: Forwarding decapsulated datagram to Mobile Node..." << endl;
+	uint32_t exit = net != NULL ? net->findForeignAgent(careOfAddress) : topology::NONE;
+	if(!deliverToVisitor(packet, exit != topology::NONE ? net->getForeignAgent(exit) : FA))
+	{
+		out << "---------------------------------------------------------" << endl << endl;
+		return;
+	}
+	printPacket(packet);
 
 	// MN: Show received message
-	cout << "Mobile Node: Received Correspondent's datagram!" << endl;
+	out << "Mobile Node: Received Correspondent's datagram!" << endl;
 
 	// Print divisor for next section
-	cout << "---------------------------------------------------------" << endl << endl;
+	out << "---------------------------------------------------------" << endl << endl;
 }
 
 /*
@@ -903,72 +3087,145 @@ it has to register with the new foreign agent before it can receive a new care-o
 After the mobile node is registered, the foreign agent of that network sends the foreign 
 anchor agent the mobile node's new care-of-address. The correspondent node tunnels datagrams
 addressed to the foreign anchor agent, who then forwards those datagrams to the mobile 
-node's new foreign agent.
+node's new foreign agent. A correspondent with a binding cache skips the query while its
+cached care-of-address is valid; the home agent keeps the cache current with binding updates.
+Given the topology (net), the tunnel ends at whichever foreign agent owns the care-of-address,
+so a cached address the mobile node has since left, over any number of handoffs, reaches the
+agent it names, which holds or drops the datagram; without it the tunnel ends at FA. Each
+call sends one datagram to the current binding: moves come from handoffs, and the interactive
+walkthrough of one is moveToNewForeignNetwork.
 */
-void directRouting(mobileNode MN, homeAgent HA, foreignAgent FA, correspondentNode CN)
+void directRouting(mobileNode &MN, homeAgent &HA, foreignAgent &FA, correspondentNode &CN, topology* net)
 {
+	ostream &out = narrate(LOG_ROUTING);
+
 	// Display section title
-	cout << "---------------------------------------------------------" << endl;
-	cout << "                Direct Routing of Datagrams              " << endl;
-	cout << "---------------------------------------------------------" << endl;
+	out << "---------------------------------------------------------" << endl;
+	out << "                Direct Routing of Datagrams              " << endl;
+	out << "---------------------------------------------------------" << endl;
   
 	// Display information
-	displayInformation(MN, HA, FA);
+	displayInformation(out, MN, HA, FA);
 
 	// Initialize datagram
-	int sequenceNumber = rand() % 65535;
+	int sequenceNumber = (int) MN.getRandom().below(65536);
 	datagram data(CN.getIP(), MN.getIP(), sequenceNumber);
+	packetBuffer packet;
+	data.encode(packet.append(DATAGRAM_SIZE), DATAGRAM_SIZE);
+
+	// Correspondent Agent: Look for Mobile Node's care-of-address in the binding cache
+	IPv4Addr careOfAddress;
+	protocolMetrics &metrics = protocolMetrics::instance();
+	bool cached = CN.cacheEnabled() && CN.lookupBinding(MN.getIP(), careOfAddress);
+	if(cached)
+	{
+		metrics.count(COUNT_BINDING_CACHE_HITS);
+		out << "Correspondent Agent: Mobile Node's care-of-address " << careOfAddress << " found in binding cache!" << endl << endl << endl;
+	}
+	else
+	{
+		// Correspondent Agent: Query Home Agent for Mobile Node's care-of-address
+		out << "Correspondent Agent: Querying Home Agent for Mobile Node's care-of-address..." << endl << endl << endl;
+		Sleep(sleepTime);
 
-	// Correspondent Agent: Query Home Agent for Mobile Node's care-of-address
-	cout << "Correspondent Agent: Querying Home Agent for Mobile Node's care-of-address..." << endl << endl << endl;
-	Sleep(sleepTime);
-
-	// Home Agent: Respond to Correspondent Agent with Mobile Node's care-of-address
-	cout << "Home Agent: Looking up Mobile Node's care-of-address in binding table..." << endl;
-	Sleep(sleepTime);
-	HA.printEntries();
-	cout << endl << "Home Agent: Mobile Node's care-of-address found!" << endl;
-	cout << "Home Agent: Responding to query with Mobile Node's care-of-address " << MN.getCOA() << "..." << endl << endl << endl;
-	Sleep(sleepTime);
+		// Home Agent: Respond to Correspondent Agent with Mobile Node's care-of-address (and
+		// send it binding updates from now on if it caches the answer)
+		out << "Home Agent: Looking up Mobile Node's care-of-address in binding table..." << endl;
+		Sleep(sleepTime);
+		HA.printEntries();
+		int lifetime = 0;
+		uint64_t started = metrics.start(PHASE_HA_LOOKUP);
+		bool bound = CN.cacheEnabled() ? HA.queryBinding(MN.getIP(), CN.getIP(), careOfAddress, lifetime) : HA.lookupCOA(MN.getIP(), careOfAddress);
+
+		// The query and its answer cross CN -> HA -> CN
+		metrics.record(PHASE_HA_LOOKUP, started, 2 * linkDelay);
+		if(!bound)
+		{
+			metrics.count(COUNT_LOOKUP_MISSES);
+			metrics.count(COUNT_DATAGRAMS_DROPPED);
+			narrate(LOG_ROUTING, LOG_WARNING) << endl << "Home Agent: Mobile Node has no binding, query failed!" << endl;
+			out << "---------------------------------------------------------" << endl << endl;
+			return;
+		}
+		out << endl << "Home Agent: Mobile Node's care-of-address found!" << endl;
+		out << "Home Agent: Responding to query with Mobile Node's care-of-address " << careOfAddress << "..." << endl << endl << endl;
+		Sleep(sleepTime);
+		if(CN.cacheEnabled())
+		{
+			CN.updateBinding(MN.getIP(), careOfAddress, lifetime);
+			out << "Correspondent Agent: Caching care-of-address for " << lifetime << " sec" << endl << endl << endl;
+		}
+	}
 
 	// Correspondent Agent: Send encapsulated datagram to care-of-address (tunneling)
-	cout << "Correspondent Agent: Tunneling datagram to Mobile Node's care-of-address..." << endl;
-	data.print(true, MN.getCOA());
+	out << "Correspondent Agent: Tunneling datagram to Mobile Node's care-of-address..." << endl;
+	if(!tunnelDatagram(packet, CN.getIP(), careOfAddress))
+	{
+		out << "---------------------------------------------------------" << endl << endl;
+		return;
+	}
+	printPacket(packet);
 	Sleep(sleepTime);
 
 	// FA: Forward decapsulated datagram to mobile node
-	cout << "Foreign Agent: Received encapsulated datagram sent to Mobile Node!" << endl;
-	cout << "Foreign Agent: Forwarding decapsulated datagram to Mobile Node..." << endl;
-	data.print(false, "");
+	out << "Foreign Agent: Received encapsulated datagram sent to Mobile Node!" << endl;
+	out << "Foreign Agent: Forwarding decapsulated datagram to Mobile Node..." << endl;
+	uint32_t exit = net != NULL ? net->findForeignAgent(careOfAddress) : topology::NONE;
+	if(!deliverToVisitor(packet, exit != topology::NONE ? net->getForeignAgent(exit) : FA))
+	{
+		// A cached care-of-address the mobile node has left is dropped, so the next datagram
+		// queries the home agent
+		if(cached && !FA.servesAddress(careOfAddress)) CN.invalidateBinding(MN.getIP());
+		out << "---------------------------------------------------------" << endl << endl;
+		return;
+	}
+	printPacket(packet);
 
 	// MN: Show received message
-	cout << "Mobile Node: Received Correspondent's datagram!" << endl;
-	cout << "Mobile Node: Moving to new foreign network!" << endl << endl << endl;
+	out << "Mobile Node: Received Correspondent's datagram!" << endl;
+
+	// Print divisor for next section
+	out << "---------------------------------------------------------" << endl << endl;
+}
+
+/*
+Interactive walkthrough of direct routing after a move: the mobile node moves to a new foreign
+network, registers with its foreign agent, which reports the new care-of-address to the
+foreign anchor agent (FA), and the correspondent's next datagram is tunneled to the anchor and
+on to the new foreign agent. The new foreign network exists only for the walkthrough; headless
+runs move mobile nodes through handoffs instead (see handoff).
+*/
+void moveToNewForeignNetwork(mobileNode &MN, homeAgent &HA, foreignAgent &FA, correspondentNode &CN)
+{
+	ostream &out = narrate(LOG_ROUTING);
+	protocolMetrics &metrics = protocolMetrics::instance();
+	packetBuffer packet;
+	out << "Mobile Node: Moving to new foreign network!" << endl << endl << endl;
 
 	// Mobile Node moves to new foreign network
 		// Initialize new foreign agent and ICMP advertisement message
 		foreignAgent newFA(generateIP());
 		ICMP advertisement(ADVERTISEMENT, newFA.getFA(), false, true, true);
 		advertisement.insertCOA(newFA.getFA());
-		int lifetimeRequest = rand() % 9999;
-		int registrationId = rand() % 9999;
-		datagram data2(CN.getIP(), MN.getIP(), sequenceNumber + 1);
+		int lifetimeRequest = (int) MN.getRandom().between(1999, 9998);
+		uint64_t registrationId = MN.getRandom().next();
+		datagram data2(CN.getIP(), MN.getIP(), (int) MN.getRandom().below(65536));
 
 		// Agent discovery
 			// Listen for broadcast
-			cout << "           Agent Discovery           " << endl;
-			cout << "-------------------------------------" << endl;
-			cout << "Mobile Node is in new foreign network!" << endl;
-			cout << "Mobile Node listening for Home Agent or Foreign Agent advertisement..." << endl << endl << endl;
+			out << "           Agent Discovery           " << endl;
+			out << "-------------------------------------" << endl;
+			out << "Mobile Node is in new foreign network!" << endl;
+			out << "Mobile Node listening for Home Agent or Foreign Agent advertisement..." << endl << endl << endl;
 			Sleep(sleepTime);
 
 			// Foreign Agent broadcast advertisement
-			cout << "Foreign Agent BROADCASTING advertisement... " << endl;
+			out << "Foreign Agent BROADCASTING advertisement... " << endl;
 			advertisement.printICMP();
 			Sleep(sleepTime);
 
 			// Confirm Mobile Node is in new foreign network
-		   cout << "Mobile Node received Foreign Agent broadcast!" << endl << endl << endl;
+		   out << "Mobile Node received Foreign Agent broadcast!" << endl << endl << endl;
 
 		// Registration
 			// MN: send request to foreign agent
@@ -979,61 +3236,321 @@ void directRouting(mobileNode MN, homeAgent HA, foreignAgent FA, correspondentNo
 				registrationMessage request(REQUEST, MN.getCOA(), HA.getHA(), MN.getIP(), lifetimeRequest, registrationId);
 
 				// MN: Send registration request to FA
-				cout << "             Registration            " << endl;
-				cout << "-------------------------------------" << endl;
-				cout << "Mobile Node: Sending registration request to Foreign Agent..." << endl;
+				out << "             Registration            " << endl;
+				out << "-------------------------------------" << endl;
+				out << "Mobile Node: Sending registration request to Foreign Agent..." << endl;
 				request.printRegistration(false);
 				Sleep(sleepTime);
 
 			// FA: update visitor list
-			cout << "Foreign Agent: Received registration request!" << endl;
-			cout << "Foreign Agent: Updating new Visitor List..." << endl << endl;
+			out << "Foreign Agent: Received registration request!" << endl;
+			out << "Foreign Agent: Updating new Visitor List..." << endl << endl;
 			Sleep(sleepTime);
 			newFA.addEntry(MN.getIP(), HA.getHA(), MN.getMAC(), lifetimeRequest);
 			newFA.printEntries();
+			metrics.count(COUNT_REGISTRATIONS);
 
 			// Confirm Mobile Node is registered with new Foreign Agent
-			cout << endl << "Visitor List is updated!" << endl;
-			cout << "Mobile Node registered with new Foreign Agent!" << endl << endl << endl;
+			out << endl << "Visitor List is updated!" << endl;
+			out << "Mobile Node registered with new Foreign Agent!" << endl << endl << endl;
 			Sleep(sleepTime);
 
 			// New FA: Send Mobile Node's new care-of-address to Anchor Foreign Agent
-			cout << "New Foreign Agent: Sending Anchor Foreign Agent the Mobile Node's new care-of-address " << MN.getCOA() << "..." << endl;
+			out << "New Foreign Agent: Sending Anchor Foreign Agent the Mobile Node's new care-of-address " << MN.getCOA() << "..." << endl;
 			Sleep(sleepTime);
 
 			// Confirm Anchor Foreign Agent has received new care-of-address
-			cout << "Anchor Foreign Agent: Received Mobile Node's new care-of-address!" << endl << endl << endl;
+			out << "Anchor Foreign Agent: Received Mobile Node's new care-of-address!" << endl << endl << endl;
 
 		// Correspondent Agent: Send encapsulated datagram to care-of-address (tunneling)
-		cout << "               Routing               " << endl;
-		cout << "-------------------------------------" << endl;
-		cout << "Correspondent Agent: Tunneling datagram to Mobile Node's care-of-address..." << endl;
-		data2.print(true, FA.getFA());
+		out << "               Routing               " << endl;
+		out << "-------------------------------------" << endl;
+		out << "Correspondent Agent: Tunneling datagram to Mobile Node's care-of-address..." << endl;
+		data2.encode(packet.append(DATAGRAM_SIZE), DATAGRAM_SIZE);
+		if(!tunnelDatagram(packet, CN.getIP(), FA.getFA()))
+		{
+			out << "---------------------------------------------------------" << endl << endl;
+			return;
+		}
+		printPacket(packet);
 		Sleep(sleepTime);
 
-		// FA Anchor: Forward datagram to new Foreign Agent
-		cout << "Anchor Foreign Agent: Received encapsulated datagram sent to Mobile Node!" << endl;
-		cout << "Anchor Foreign Agent: Forwarding datagram to new Foreign Agent..." << endl;
-		data2.print(true, MN.getCOA());
+		// FA Anchor: Forward datagram to new Foreign Agent (re-tunneled in place)
+		out << "Anchor Foreign Agent: Received encapsulated datagram sent to Mobile Node!" << endl;
+		out << "Anchor Foreign Agent: Forwarding datagram to new Foreign Agent..." << endl;
+		if(!detunnelDatagram(packet, FA.getFA()) || !tunnelDatagram(packet, FA.getFA(), MN.getCOA()))
+		{
+			out << "---------------------------------------------------------" << endl << endl;
+			return;
+		}
+		printPacket(packet);
 		Sleep(sleepTime);
 
 		// New FA: Forward decapsulated datagram to mobile node
-		cout << "New Foreign Agent: Received encapsulated datagram sent to Mobile Node!" << endl;
-		cout << "New Foreign Agent: Forwarding decapsulated datagram to Mobile Node..." << endl;
-		data.print(false, "");
+		out << "New Foreign Agent: Received encapsulated datagram sent to Mobile Node!" << endl;
+		out << "New Foreign Agent: Forwarding decapsulated datagram to Mobile Node..." << endl;
+		if(!deliverToVisitor(packet, newFA))
+		{
+			out << "---------------------------------------------------------" << endl << endl;
+			return;
+		}
+		printPacket(packet);
 
 		// MN: Show received message
-		cout << "Mobile Node: Received Correspondent's datagram!" << endl;
+		out << "Mobile Node: Received Correspondent's datagram!" << endl;
 
 	// Print divisor for next section
-	cout << "---------------------------------------------------------" << endl << endl;
+	out << "---------------------------------------------------------" << endl << endl;
+}
+
+/*
+Direct routing through a foreign anchor agent over any sequence of handoffs. The correspondent
+queries the home agent once per session, and the foreign agent serving the mobile node then
+becomes the anchor: every datagram of the session is tunneled to it. A foreign agent that
+receives the datagram hands it to its visitor if the mobile node is there, or otherwise
+re-tunnels it along its forwarding pointer (see updateForwarding). Hops and wall time of each
+datagram are recorded by the handoffs made since the anchor was chosen, except for datagrams
+held over a handoff.
+*/
+void anchoredRouting(simulation &sim, uint32_t mobile)
+{
+	uint64_t clockStart = metricsClock();
+	uint32_t handoffs = sim.net.handoffsOf(mobile);
+	uint64_t hops = 0;
+	mobileNode &MN = sim.net.getMobileNode(mobile);
+	homeAgent &HA = sim.net.getHomeAgent(sim.net.homeAgentOf(mobile));
+	correspondentNode &CN = sim.net.getCorrespondent(sim.net.correspondentOf(mobile));
+	protocolMetrics &metrics = protocolMetrics::instance();
+	ostream &out = narrate(LOG_ROUTING);
+
+	// Display section title
+	out << "---------------------------------------------------------" << endl;
+	out << "               Anchored Routing of Datagrams             " << endl;
+	out << "---------------------------------------------------------" << endl;
+
+	// Correspondent Agent: Query Home Agent at the start of the session for the anchor
+	uint32_t at = sim.net.anchorOf(mobile);
+	if(at == topology::NONE)
+	{
+		out << "Correspondent Agent: Querying Home Agent for Mobile Node's care-of-address..." << endl;
+		IPv4Addr careOfAddress;
+		uint64_t started = metrics.start(PHASE_HA_LOOKUP);
+		bool bound = HA.lookupCOA(MN.getIP(), careOfAddress);
+		metrics.record(PHASE_HA_LOOKUP, started, 2 * linkDelay);
+		at = bound ? sim.net.findForeignAgent(careOfAddress) : topology::NONE;
+		if(at == topology::NONE)
+		{
+			metrics.count(COUNT_LOOKUP_MISSES);
+			metrics.count(COUNT_DATAGRAMS_DROPPED);
+			narrate(LOG_ROUTING, LOG_WARNING) << "Home Agent: Mobile Node has no binding, query failed!" << endl;
+			out << "---------------------------------------------------------" << endl << endl;
+			sim.forwarding.record(handoffs, 0, metricsClock() - clockStart);
+			return;
+		}
+		sim.net.setAnchor(mobile, at);
+		handoffs = 0;
+		out << "Correspondent Agent: Foreign Agent " << careOfAddress << " is the anchor for this session" << endl;
+	}
+
+	// Initialize datagram
+	datagram data(CN.getIP(), MN.getIP(), (int) MN.getRandom().below(65536));
+	packetBuffer packet;
+	data.encode(packet.append(DATAGRAM_SIZE), DATAGRAM_SIZE);
+
+	// Correspondent Agent: Tunnel to the anchor, then each Foreign Agent forwards the datagram
+	// until it reaches the one the Mobile Node is visiting
+	IPv4Addr from = CN.getIP();
+	bool delivered = false;
+	bool held = false;
+	while(true)
+	{
+		foreignAgent &FA = sim.net.getForeignAgent(at);
+		if(!tunnelDatagram(packet, from, FA.getFA())) break;
+		hops++;
+		if(at == sim.net.foreignAgentOf(mobile))
+		{
+			out << "Foreign Agent " << FA.getFA() << ": Forwarding decapsulated datagram to Mobile Node..." << endl;
+			delivered = deliverToVisitor(packet, FA);
+			break;
+		}
+
+		IPv4Addr next;
+		uint32_t nextAgent = FA.nextHop(MN.getIP(), next) ? sim.net.findForeignAgent(next) : topology::NONE;
+		if(nextAgent == topology::NONE && FA.hasLeft(MN.getIP()))
+		{
+			// The mobile node has just left and the new foreign agent has not reported yet
+			held = detunnelDatagram(packet, FA.getFA()) && holdForDeparted(packet, FA, MN.getIP());
+			break;
+		}
+		if(nextAgent == topology::NONE)
+		{
+			metrics.count(COUNT_DATAGRAMS_DROPPED);
+			narrate(LOG_ROUTING, LOG_WARNING) << "Foreign Agent " << FA.getFA() << ": No forwarding pointer for departed Mobile Node, datagram dropped!" << endl;
+			break;
+		}
+		out << "Foreign Agent " << FA.getFA() << ": Forwarding datagram to " << next << "..." << endl;
+		if(!detunnelDatagram(packet, FA.getFA())) break;
+		from = FA.getFA();
+		at = nextAgent;
+	}
+	if(delivered)
+	{
+		printPacket(packet);
+		out << "Mobile Node: Received Correspondent's datagram!" << endl;
+	}
+	out << "---------------------------------------------------------" << endl << endl;
+	if(!held) sim.forwarding.record(handoffs, delivered ? hops : 0, metricsClock() - clockStart);
+}
+
+/*
+Called when a mobile node registers after a handoff. In a session with an anchor, the new
+foreign agent sends forwarding pointers to where the mobile node is now. Without compression
+only the foreign agent it left learns the new care-of-address, so pointers chain through every
+foreign agent visited. With compression the anchor learns the current foreign agent directly,
+and the foreign agent left behind keeps a pointer for forwardingLifetime only, to catch
+datagrams already on their way to it.
+*/
+void updateForwarding(simulation &sim, uint32_t mobile)
+{
+	uint32_t previous = sim.net.previousForeignAgentOf(mobile);
+	uint32_t anchor = sim.net.anchorOf(mobile);
+	uint32_t current = sim.net.foreignAgentOf(mobile);
+	if(anchor == topology::NONE || previous == topology::NONE || current == topology::NONE) return;
+
+	// Pointers for the session last until it ends (the chain's links never expire)
+	const uint64_t sessionLifetime = 0xFFFFFFFF;
+	IPv4Addr home = sim.net.getMobileNode(mobile).getIP();
+	foreignAgent &FA = sim.net.getForeignAgent(current);
+	FA.removeForwardingPointer(home);
+	if(sim.anchorMode == ANCHOR_CHAIN)
+	{
+		sim.net.getForeignAgent(previous).addForwardingPointer(home, FA.getFA(), sessionLifetime);
+	}
+	else
+	{
+		if(anchor != current) sim.net.getForeignAgent(anchor).addForwardingPointer(home, FA.getFA(), sessionLifetime);
+		if(previous != anchor && previous != current && sim.forwardingLifetime >= SECOND)
+			sim.net.getForeignAgent(previous).addForwardingPointer(home, FA.getFA(), sim.forwardingLifetime / SECOND);
+	}
+	narrate(LOG_REGISTRATION, LOG_DEBUG) << "Foreign Agent " << FA.getFA() << ": Sent forwarding pointers for Mobile Node " << home << endl;
+}
+
+/*
+Tunnel entry point: the sender forwards the datagram in the packet (its TTL drops by one) and
+wraps it in an outer IP header addressed to the tunnel exit. A failed tunnel drops the
+datagram with a warning.
+*/
+bool tunnelDatagram(packetBuffer &packet, IPv4Addr from, IPv4Addr to)
+{
+	static uint16_t identification = 0;
+	protocolMetrics &metrics = protocolMetrics::instance();
+	uint64_t started = metrics.start(PHASE_TUNNEL);
+	if(forwardHop(packet.data()) && encapsulate(packet, from, to, identification++))
+	{
+		metrics.record(PHASE_TUNNEL, started, linkDelay);
+		return true;
+	}
+	metrics.count(COUNT_TUNNEL_FAILURES);
+	metrics.count(COUNT_DATAGRAMS_DROPPED);
+	narrate(LOG_ROUTING, LOG_WARNING) << "Tunnel from " << from << " to " << to << " failed, datagram dropped!" << endl;
+	return false;
+}
+
+/*
+Tunnel exit point: the agent at address at strips the outer IP header, leaving the original
+datagram in the packet
+*/
+bool detunnelDatagram(packetBuffer &packet, IPv4Addr at)
+{
+	if(decapsulate(packet)) return true;
+	protocolMetrics::instance().count(COUNT_TUNNEL_FAILURES);
+	protocolMetrics::instance().count(COUNT_DATAGRAMS_DROPPED);
+	narrate(LOG_ROUTING, LOG_WARNING) << "Agent " << at << " received a malformed tunnel packet, datagram dropped!" << endl;
+	return false;
+}
+
+/*
+Foreign agent ends the tunnel and hands the datagram to the visiting mobile node it is
+addressed to, finding the visitor by home address and then its link-layer address. Warns and
+returns false if the tunnel was addressed to another care-of-address (the mobile node has
+moved on), the packet is not a valid tunnel packet or the destination is not in the Visitor
+List. A datagram for a visitor that has left is held for its new care-of-address or lost.
+*/
+bool deliverToVisitor(packetBuffer &packet, foreignAgent &FA)
+{
+	protocolMetrics &metrics = protocolMetrics::instance();
+	uint64_t started = metrics.start(PHASE_DELIVERY);
+
+	// A tunnel addressed to another care-of-address reached a foreign agent the mobile node has left
+	IPv4Addr exit = packet.length() >= IPV4_HEADER_SIZE ? IPv4Addr(wireGet32(packet.data() + 16)) : IPv4Addr();
+	if(exit.isSet() && !FA.servesAddress(exit))
+	{
+		metrics.count(COUNT_DATAGRAMS_DROPPED);
+		narrate(LOG_ROUTING, LOG_WARNING) << "Foreign Agent " << exit << ": Mobile Node is no longer visiting, datagram dropped!" << endl;
+		return false;
+	}
+	if(!detunnelDatagram(packet, FA.getFA())) return false;
+
+	// The tunnel exit has already checked the header, so the destination is read directly
+	const visitorEntry* visitor = NULL;
+	if(packet.length() >= IPV4_HEADER_SIZE) visitor = FA.findVisitor(IPv4Addr(wireGet32(packet.data() + 16)));
+	if(visitor == NULL || FA.findVisitorByMAC(visitor->mediaAddress) != visitor)
+	{
+		metrics.count(COUNT_DATAGRAMS_DROPPED);
+		narrate(LOG_ROUTING, LOG_WARNING) << "Foreign Agent: Destination is not in the Visitor List, datagram dropped!" << endl;
+		return false;
+	}
+	if(FA.hasLeft(visitor->homeAddress))
+	{
+		holdForDeparted(packet, FA, visitor->homeAddress);
+		return false;
+	}
+	narrate(LOG_ROUTING, LOG_DEBUG) << "Foreign Agent: Delivering datagram to " << visitor->homeAddress << " at " << visitor->mediaAddress << endl;
+	metrics.record(PHASE_DELIVERY, started, linkDelay);
+	metrics.count(COUNT_DATAGRAMS_DELIVERED);
+	return true;
+}
+
+/*
+Smooth handoff: a datagram (already out of its tunnel) reached the foreign agent a mobile node
+has just left. The foreign agent holds it for the new care-of-address if it has a ring for the
+mobile node with room left; otherwise the datagram is lost. Returns true if it was held.
+*/
+bool holdForDeparted(packetBuffer &packet, foreignAgent &FA, IPv4Addr home)
+{
+	protocolMetrics &metrics = protocolMetrics::instance();
+	if(FA.holdDatagram(home, packet))
+	{
+		metrics.count(COUNT_HANDOFF_HELD);
+		narrate(LOG_ROUTING, LOG_DEBUG) << "Foreign Agent " << FA.getFA() << ": Mobile Node " << home << " has left, holding datagram" << endl;
+		return true;
+	}
+	metrics.count(COUNT_HANDOFF_LOST);
+	metrics.count(COUNT_DATAGRAMS_DROPPED);
+	narrate(LOG_ROUTING, LOG_WARNING) << "Foreign Agent " << FA.getFA() << ": Mobile Node " << home << " has left, datagram dropped!" << endl;
+	return false;
+}
+
+/*
+Prints the datagram in a packet as it appears on the wire, with the tunnel exit if the packet
+is encapsulated
+*/
+void printPacket(const packetBuffer &packet)
+{
+	if(!logEnabled(LOG_ROUTING)) return;
+	ipv4View outer;
+	if(!outer.parse(packet.data(), packet.length())) return;
+	bool encapsulated = outer.protocol() == IP_PROTOCOL_IPIP;
+	datagramView inner;
+	if(encapsulated ? !inner.parse(outer.payload(), outer.payloadLength()) : !inner.parse(packet.data(), packet.length())) return;
+	datagram(inner).print(encapsulated, outer.destination());
 }
 
 /*
 Once the simulation reaches its end, this function outputs all data; mobile nodes, home agents, foreign 
 agents, and correspondent nodes into a text file database called "output.txt". 
 */
-void outputDatabase(mobileNode m, homeAgent h, foreignAgent f, correspondentNode c)
+void outputDatabase(mobileNode &m, homeAgent &h, foreignAgent &f, correspondentNode &c)
 {
 	// Initialize variables
 	ofstream fout;
@@ -1049,7 +3566,9 @@ void outputDatabase(mobileNode m, homeAgent h, foreignAgent f, correspondentNode
 
 		// Mobile Nodes
 		fout << "Mobile Nodes" << endl << "------------" << endl;		
-		fout << "IP: " << m.getIP() << ", MAC: " << m.getMAC() << ", COA: " << m.getCOA() << endl << endl;
+		fout << "IP: " << m.getIP() << ", MAC: " << m.getMAC() << ", COA: ";
+		if(m.getCOA().isSet()) fout << m.getCOA() << endl << endl;
+		else fout << "N/A" << endl << endl;
 
 		// Home Agents
 		fout << "Home Agents" << endl << "-----------" << endl;
@@ -1070,4 +3589,268 @@ void outputDatabase(mobileNode m, homeAgent h, foreignAgent f, correspondentNode
 	// Close file
 	fout.close();
 
-}
\ No newline at end of file
+}
+
+/*
+Counts the heap allocations made by one protocol step on a warmed-up simulation. Datagram
+routing for a registered mobile node should not allocate at all, since every entity is passed
+by reference and the tables update in place, and neither should agent discovery, whose
+advertisements carry their care-of-addresses inline.
+*/
+void benchmarkRoutingAllocations()
+{
+	const int steps = 1000;
+
+	// Build and register one mobile node in a foreign network
+	simulation sim;
+	IPv4Addr homeAddress = generateIP();
+	uint32_t home = sim.net.addHomeAgent(homeAddress);
+	uint32_t foreign = sim.net.addForeignAgent(generateUniqueIP(sim.net));
+	uint32_t correspondent = sim.net.addCorrespondent(generateUniqueIP(sim.net));
+	uint32_t mobile = sim.net.addMobileNode(homeAddress, generateMAC(), home, correspondent);
+	mobileNode &MN = sim.net.getMobileNode(mobile);
+	homeAgent &HA = sim.net.getHomeAgent(home);
+	foreignAgent &FA = sim.net.getForeignAgent(foreign);
+	correspondentNode &CN = sim.net.getCorrespondent(correspondent);
+	sim.net.moveTo(mobile, foreign);
+
+	// Narration is left to the logging options (silent by default in benchmark mode)
+	registerMN(MN, HA, FA);
+
+	// Warm up, then count
+	for(int i = 0; i < 10; i++) indirectRouting(MN, HA, FA, CN);
+	uint64_t before = heapAllocations.load();
+	for(int i = 0; i < steps; i++) indirectRouting(MN, HA, FA, CN);
+	double indirectAllocations = (double) (heapAllocations.load() - before) / steps;
+
+	for(int i = 0; i < 10; i++) agentDiscovery(MN, HA, FA, FOREIGN, ADVERTISEMENT);
+	before = heapAllocations.load();
+	for(int i = 0; i < steps; i++) agentDiscovery(MN, HA, FA, FOREIGN, ADVERTISEMENT);
+	double discoveryAllocations = (double) (heapAllocations.load() - before) / steps;
+
+	for(int i = 0; i < 10; i++) directRouting(MN, HA, FA, CN);
+	before = heapAllocations.load();
+	for(int i = 0; i < steps; i++) directRouting(MN, HA, FA, CN);
+	double directAllocations = (double) (heapAllocations.load() - before) / steps;
+	logFlush();
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Heap allocations per protocol step           " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "Indirect routing: " << indirectAllocations;
+	benchCheck(indirectAllocations == 0, " (CHECK FAILED: expected 0)");
+	cout << endl;
+	cout << "Agent discovery: " << discoveryAllocations;
+	benchCheck(discoveryAllocations == 0, " (CHECK FAILED: expected 0)");
+	cout << endl;
+	cout << "Direct routing: " << directAllocations;
+	benchCheck(directAllocations == 0, " (CHECK FAILED: expected 0)");
+	cout << endl << endl;
+}
+
+/*
+Measures each protocol path and the agents' table operations with population mobile nodes,
+all served by one home agent and visiting one foreign agent, so both agents' tables hold
+every mobile node. Each call picks a random mobile node. Results go to the report, which
+prints them and can write them as JSON.
+*/
+void benchmarkProtocol(const vector<size_t> &sizes, benchReport &report)
+{
+	const uint64_t steps = 200000;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Protocol paths and agent tables              " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Operation                     | Population | ns/op | allocs/op | ops/sec |" << endl;
+
+	// Address generation does not depend on the population
+	randomService::local().seed(1);
+	uint64_t sink = 0;
+	report.add(measureOperation("generateIP", 0, steps, [&sink](uint64_t) { sink += generateIP().toUint(); }));
+	report.add(measureOperation("generateMAC", 0, steps, [&sink](uint64_t) { sink += generateMAC().toUint(); }));
+
+	for(size_t s = 0; s < sizes.size(); s++)
+	{
+		size_t n = sizes[s];
+		if(n == 0 || n > 0xFFFFFF) continue;
+
+		// Every mobile node registered with the one home agent through the one foreign agent
+		simulation sim;
+		sim.net.reserve(n, 1, 1, 1);
+		uint32_t home = sim.net.addHomeAgent(IPv4Addr(11, 0, 0, 0));
+		uint32_t foreign = sim.net.addForeignAgent(IPv4Addr(192, 168, 1, 1));
+		uint32_t correspondent = sim.net.addCorrespondent(IPv4Addr(172, 16, 0, 1));
+		homeAgent &HA = sim.net.getHomeAgent(home);
+		foreignAgent &FA = sim.net.getForeignAgent(foreign);
+		correspondentNode &CN = sim.net.getCorrespondent(correspondent);
+		for(size_t i = 0; i < n; i++)
+		{
+			uint32_t mobile = sim.net.addMobileNode(benchAddress((uint32_t) i), MacAddr(0x020000000000ull | i), home, correspondent);
+			sim.net.moveTo(mobile, foreign);
+			registerMN(sim.net.getMobileNode(mobile), HA, FA);
+		}
+
+		// Mobile node for call i
+		uint32_t state = 2463534242u;
+		auto pick = [&sim, &state, n]() -> mobileNode& { return sim.net.getMobileNode(benchRandom(state) % n); };
+
+		report.add(measureOperation("generateUniqueIP", n, steps, [&sim, &sink](uint64_t) { sink += generateUniqueIP(sim.net).toUint(); }));
+		report.add(measureOperation("agentDiscovery advertisement", n, steps, [&](uint64_t) { agentDiscovery(pick(), HA, FA, FOREIGN, ADVERTISEMENT); }));
+		report.add(measureOperation("agentDiscovery solicitation", n, steps, [&](uint64_t) { agentDiscovery(pick(), HA, FA, FOREIGN, SOLICITATION); }));
+		report.add(measureOperation("registerMN", n, steps, [&](uint64_t) { registerMN(pick(), HA, FA); }));
+		report.add(measureOperation("indirectRouting", n, steps, [&](uint64_t) { indirectRouting(pick(), HA, FA, CN); }));
+		report.add(measureOperation("directRouting", n, steps, [&](uint64_t) { directRouting(pick(), HA, FA, CN); }));
+
+		// The agents' tables on their own
+		IPv4Addr coa = FA.getFA();
+		report.add(measureOperation("homeAgent addEntry", n, steps, [&](uint64_t) { HA.addEntry(pick().getIP(), coa, 1800); }));
+		report.add(measureOperation("homeAgent lookupCOA", n, steps, [&](uint64_t) { IPv4Addr found; sink += HA.lookupCOA(pick().getIP(), found); }));
+		report.add(measureOperation("homeAgent remove+add", n, steps, [&](uint64_t)
+		{
+			IPv4Addr address = pick().getIP();
+			HA.removeEntry(address);
+			HA.addEntry(address, coa, 1800);
+		}));
+		report.add(measureOperation("foreignAgent addEntry", n, steps, [&](uint64_t)
+		{
+			mobileNode &MN = pick();
+			FA.addEntry(MN.getIP(), HA.getHA(), MN.getMAC(), 1800);
+		}));
+		report.add(measureOperation("foreignAgent findVisitor", n, steps, [&](uint64_t) { sink += FA.findVisitor(pick().getIP()) != NULL; }));
+		report.add(measureOperation("foreignAgent findVisitorByMAC", n, steps, [&](uint64_t) { sink += FA.findVisitorByMAC(pick().getMAC()) != NULL; }));
+
+		// A care-of-address pool with one address per mobile node, all but one in use
+		careOfAddressPool pool;
+		pool.configure(IPv4Addr(10, 0, 0, 0), n);
+		IPv4Addr taken;
+		for(size_t i = 0; i + 1 < n; i++) pool.allocate(taken);
+		report.add(measureOperation("coaPool allocate+release", n, steps, [&](uint64_t)
+		{
+			sink += pool.allocate(taken) && pool.release(taken);
+		}));
+		if(!benchCheck(HA.bindingCount() == n && FA.visitorCount() == n, "(CHECK FAILED: tables lost entries)")) cout << endl;
+	}
+	logFlush();
+	if(!benchCheck(sink != 0, "(CHECK FAILED: nothing found)")) cout << endl;
+	cout << endl;
+}
+
+/*
+Measures registration bursts for each relay batch size (0 is the unbatched registerMN path):
+population mobile nodes, all visiting one foreign agent and served by one home agent,
+register within one network second. A first burst fills the tables and the second, where
+every mobile node re-registers, is timed. Reports registrations per second of simulator wall
+time, including event handling, and each request's network latency from request to reply.
+*/
+void benchmarkRegistrationBatching(const vector<size_t> &sizes, benchReport &report)
+{
+	const size_t batchSizes[] = { 0, 1, 4, 16, 64, 256 };
+	ostringstream latencies;
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "            Registration bursts by batch size            " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Operation                     | Population | ns/op | allocs/op | ops/sec |" << endl;
+
+	protocolMetrics &metrics = protocolMetrics::instance();
+	for(size_t s = 0; s < sizes.size(); s++)
+	{
+		size_t n = sizes[s];
+		if(n == 0 || n > 1000000) continue;
+		for(size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++)
+		{
+			simulation sim;
+			sim.net.reserve(n, 1, 1, 1);
+			uint32_t home = sim.net.addHomeAgent(IPv4Addr(11, 0, 0, 0));
+			uint32_t foreign = sim.net.addForeignAgent(IPv4Addr(192, 168, 1, 1));
+			uint32_t correspondent = sim.net.addCorrespondent(IPv4Addr(172, 16, 0, 1));
+			for(size_t i = 0; i < n; i++)
+				sim.net.moveTo(sim.net.addMobileNode(benchAddress((uint32_t) i), MacAddr(0x020000000000ull | i), home, correspondent), foreign);
+			sim.relay.configure(batchSizes[b], 50 * MILLISECOND);
+
+			registrationRelayStats before;
+			uint64_t registrationsBefore = 0, allocationsBefore = 0;
+			benchTimer timer;
+			for(int pass = 0; pass < 2; pass++)
+			{
+				simTime start = sim.events.now();
+				for(size_t i = 0; i < n; i++) sim.events.schedule(start + i * SECOND / n, simEvent(REGISTRATION_EVENT, (uint32_t) i, 0));
+				if(pass == 1)
+				{
+					before = sim.relay.stats();
+					registrationsBefore = metrics.counter(COUNT_REGISTRATIONS);
+					allocationsBefore = heapAllocations.load();
+					timer = benchTimer();
+				}
+				runSimulation(sim, start + 2 * SECOND);
+			}
+			double ns = timer.elapsedNs();
+			uint64_t registrations = metrics.counter(COUNT_REGISTRATIONS) - registrationsBefore;
+
+			benchResult result;
+			result.name = batchSizes[b] == 0 ? "registration unbatched" : "registration batch " + to_string(batchSizes[b]);
+			result.population = n;
+			result.operations = registrations;
+			result.nsPerOp = registrations > 0 ? ns / registrations : 0;
+			result.allocsPerOp = registrations > 0 ? (double) (heapAllocations.load() - allocationsBefore) / registrations : 0;
+			result.opsPerSecond = ns > 0 ? registrations * 1e9 / ns : 0;
+			report.add(result);
+
+			// Unbatched requests cross MN -> FA -> HA -> FA -> MN without waiting
+			const registrationRelayStats &after = sim.relay.stats();
+			uint64_t relayed = after.requests - before.requests;
+			double mean = relayed > 0 ? (double) (after.latency - before.latency) / relayed / MILLISECOND : 4.0 * linkDelay / MILLISECOND;
+			double longest = relayed > 0 ? (double) after.maxLatency / MILLISECOND : 4.0 * linkDelay / MILLISECOND;
+			latencies << result.name << ", " << n << " mobile nodes: latency mean " << mean << " ms, max " << longest << " ms";
+			if(relayed > 0) latencies << ", " << (double) relayed / (after.batches - before.batches) << " requests per batch";
+			latencies << endl;
+		}
+	}
+	logFlush();
+	cout << endl << latencies.str() << endl;
+}
+
+/*
+Runs the same mobility scenario with each routing method, with handoff buffering off and on.
+Datagrams reaching the foreign agent a mobile node has just left are lost without buffering;
+with it they are held and every one is delivered once the new foreign agent reports the move.
+*/
+void benchmarkHandoffBuffering()
+{
+	const routing_t methods[] = { INDIRECT, DIRECT };
+
+	cout << "---------------------------------------------------------" << endl;
+	cout << "     Handoff buffering (waypoint mobility, 60 sec)       " << endl;
+	cout << "---------------------------------------------------------" << endl;
+	cout << "| Routing  | Buffer | delivered | dropped | held | held delivered | lost |" << endl;
+
+	for(int m = 0; m < 2; m++)
+	{
+		for(size_t depth = 0; depth <= 16; depth += 16)
+		{
+			scenarioConfig config;
+			config.name = string(methods[m] == DIRECT ? "direct" : "indirect") + (depth > 0 ? " buffered" : "");
+			config.networkSelection = FOREIGN;
+			config.routingMethod = methods[m];
+			config.duration = 60 * SECOND;
+			config.datagramInterval = 100 * MILLISECOND;
+			config.seed = 7;
+			config.mobileNodes = 1000;
+			config.foreignAgents = 50;
+			config.mobility.pattern = RANDOM_WAYPOINT;
+			config.handoffBufferDepth = depth;
+
+			scenarioResult result;
+			string error;
+			bool ran = runScenario(config, result, error);
+			logFlush();
+			const datagramStats &run = result.datagrams;
+			cout << "| " << (methods[m] == DIRECT ? "direct" : "indirect") << " | " << depth << " | "
+			     << run.delivered << " | " << run.dropped << " | " << run.held << " | " << run.flushed << " | " << run.lost << " |";
+			if(depth == 0) benchCheck(ran && run.delivered > 0 && run.held == 0);
+			else benchCheck(ran && run.delivered > 0 && run.held > 0 && run.flushed == run.held);
+			cout << endl;
+		}
+	}
+	cout << endl;
+}
@@ -0,0 +1,293 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Always-on metrics for the Mobile IP protocol phases: agent discovery, registration request,
+registration reply, home agent lookup, tunneling, foreign agent delivery and the extra delay of
+datagrams held over a handoff. Each phase keeps two latency histograms, one in wall time and
+one in simulated (network) time, and the protocol keeps event counters.
+
+Histograms are log-linear in the style of HdrHistogram. Values below 32 each get their own
+bucket. Above that, every power of two is split into 16 buckets, so any value is recorded
+within about 6%, from nanoseconds to hours, in under 8 KB. Wall time is read from the CPU
+timestamp counter where there is one, and ticks are converted to nanoseconds only when the
+metrics are read. Reading the clock costs more than recording a value, so only one call in
+wallSampling of each phase is timed. Counts and network times are recorded for every call.
+
+Every counter is a relaxed atomic with a single writer, the simulation thread, which
+updates it with a plain load and store (no locked instruction). Any other thread can read
+the metrics at any time without locking, such as the dumper that appends a snapshot to a
+JSON Lines file at a fixed interval.
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include "portability.h"
+
+using namespace std;
+
+// Protocol phases that are timed
+enum metricPhase { PHASE_DISCOVERY, PHASE_REGISTRATION_REQUEST, PHASE_REGISTRATION_REPLY, PHASE_HA_LOOKUP, PHASE_TUNNEL,
+                   PHASE_DELIVERY, PHASE_HANDOFF_BUFFER, PHASE_COUNT };
+
+// Protocol events that are counted
+enum metricCounter { COUNT_ADVERTISEMENTS, COUNT_SOLICITATIONS, COUNT_REGISTRATIONS, COUNT_LOOKUP_MISSES,
+                     COUNT_TUNNEL_FAILURES, COUNT_DATAGRAMS_DELIVERED, COUNT_DATAGRAMS_DROPPED, COUNT_BINDING_CACHE_HITS,
+                     COUNT_BINDING_UPDATES, COUNT_BINDING_INVALIDATIONS, COUNT_HANDOFF_HELD, COUNT_HANDOFF_LOST,
+                     COUNT_REGISTRATION_BATCHES, COUNT_COUNTERS };
+
+// Wall clock for phase timing, in ticks (timestamp counter cycles, or nanoseconds elsewhere)
+inline uint64_t metricsClock()
+{
+	if(cycleCounterAvailable) return cycleCounter();
+	return (uint64_t) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Adds one to a counter that only the calling thread writes
+inline void bumpCounter(atomic<uint64_t> &counter, uint64_t amount = 1)
+{
+	counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+class latencyHistogram
+{
+	public:
+		// Values below 2 * subBuckets are exact; each power of two above is split subBuckets ways
+		static const int subBits = 4;
+		static const size_t subBuckets = 1 << subBits;
+		static const size_t bucketCount = (64 - subBits + 1) * subBuckets;
+
+		// Constructor
+		latencyHistogram() : total(0), sum(0), largest(0)
+		{
+			for(size_t i = 0; i < bucketCount; i++) buckets[i].store(0, memory_order_relaxed);
+		}
+
+		// Member Functions
+		// Single writer only
+		void record(uint64_t value)
+		{
+			bumpCounter(buckets[bucketOf(value)]);
+			bumpCounter(total);
+			bumpCounter(sum, value);
+			if(value > largest.load(memory_order_relaxed)) largest.store(value, memory_order_relaxed);
+		}
+
+		uint64_t count() const { return total.load(memory_order_relaxed); }
+		uint64_t max() const { return largest.load(memory_order_relaxed); }
+		uint64_t valueSum() const { return sum.load(memory_order_relaxed); }
+		double mean() const { uint64_t n = count(); return n == 0 ? 0 : (double) valueSum() / n; }
+
+		// Smallest value v such that at least fraction of the recorded values are <= v (to
+		// bucket precision, never above the largest value seen)
+		uint64_t percentile(double fraction) const
+		{
+			uint64_t n = count();
+			if(n == 0) return 0;
+			uint64_t rank = (uint64_t) (fraction * n);
+			if(rank == 0) rank = 1;
+			uint64_t seen = 0;
+			for(size_t i = 0; i < bucketCount; i++)
+			{
+				seen += buckets[i].load(memory_order_relaxed);
+				if(seen >= rank)
+				{
+					uint64_t upper = upperBound(i);
+					return upper < max() ? upper : max();
+				}
+			}
+			return max();
+		}
+
+		static size_t bucketOf(uint64_t value)
+		{
+			if(value < 2 * subBuckets) return (size_t) value;
+			int exponent = highestBit(value) - subBits;
+			return (size_t) (exponent + 1) * subBuckets + (size_t) ((value >> exponent) & (subBuckets - 1));
+		}
+
+		// Largest value that falls in bucket i
+		static uint64_t upperBound(size_t i)
+		{
+			if(i < 2 * subBuckets) return i;
+			int exponent = (int) (i / subBuckets) - 1;
+			uint64_t lower = (uint64_t) (subBuckets + i % subBuckets) << exponent;
+			return lower + ((uint64_t) 1 << exponent) - 1;
+		}
+
+	private:
+		// Data Members
+		atomic<uint64_t> buckets[bucketCount];  // Values recorded in each bucket
+		atomic<uint64_t> total;                 // Values recorded
+		atomic<uint64_t> sum;                   // Sum of the values (for the mean)
+		atomic<uint64_t> largest;               // Largest value recorded
+};
+
+class protocolMetrics
+{
+	public:
+		// Member Functions
+		static protocolMetrics& instance()
+		{
+			static protocolMetrics metrics;
+			return metrics;
+		}
+
+		// One call in wallSampling of each phase is timed in wall time
+		static const uint32_t wallSampling = 8;
+
+		// Called when a phase starts. Returns the wall clock reading if this call is timed, or 0.
+		uint64_t start(metricPhase phase)
+		{
+			uint32_t tick = sampleTicks[phase]++;
+			return tick % wallSampling == 0 ? metricsClock() : 0;
+		}
+
+		// Records one run of a phase, given what start() returned and the network time it
+		// took in the simulation
+		void record(metricPhase phase, uint64_t started, uint64_t simulated)
+		{
+			if(started != 0) wall[phase].record(metricsClock() - started);
+			network[phase].record(simulated);
+		}
+
+		void count(metricCounter counter, uint64_t amount = 1) { bumpCounter(counters[counter], amount); }
+		uint64_t counter(metricCounter counter) const { return counters[counter].load(memory_order_relaxed); }
+
+		// Nanoseconds per wall clock tick, measured against the steady clock since startup
+		double nsPerTick() const
+		{
+			double ns = (double) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - startTime).count();
+			uint64_t ticks = metricsClock() - startTicks;
+			return ticks == 0 ? 1 : ns / ticks;
+		}
+
+		// Appends one snapshot of every phase and counter to out as a JSON object on one line.
+		// Wall times are in nanoseconds and network times in microseconds.
+		void writeJSON(ostream &out) const
+		{
+			static const char* const phaseNames[PHASE_COUNT] = { "discovery", "registration_request", "registration_reply",
+				"ha_lookup", "tunnel", "delivery", "handoff_buffer" };
+			static const char* const counterNames[COUNT_COUNTERS] = { "advertisements", "solicitations", "registrations",
+				"lookup_misses", "tunnel_failures", "datagrams_delivered", "datagrams_dropped", "binding_cache_hits",
+				"binding_updates", "binding_invalidations", "handoff_held", "handoff_lost", "registration_batches" };
+			double scale = nsPerTick();
+			double uptime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+			out << fixed;
+			out.precision(3);
+			out << "{\"uptime_s\":" << uptime << ",\"phases\":{";
+			for(int p = 0; p < PHASE_COUNT; p++)
+			{
+				out << (p == 0 ? "" : ",") << "\"" << phaseNames[p] << "\":{\"count\":" << network[p].count();
+				out << ",\"wall_samples\":" << wall[p].count() << ",\"wall_ns\":";
+				writeSummary(out, wall[p], scale);
+				out << ",\"network_us\":";
+				writeSummary(out, network[p], 1);
+				out << "}";
+			}
+			out << "},\"counters\":{";
+			for(int c = 0; c < COUNT_COUNTERS; c++)
+				out << (c == 0 ? "" : ",") << "\"" << counterNames[c] << "\":" << counters[c].load(memory_order_relaxed);
+			out << "}}" << endl;
+		}
+
+		const latencyHistogram& wallTime(metricPhase phase) const { return wall[phase]; }
+		const latencyHistogram& networkTime(metricPhase phase) const { return network[phase]; }
+
+	private:
+		// Constructor
+		protocolMetrics() : startTime(chrono::steady_clock::now()), startTicks(metricsClock())
+		{
+			for(int c = 0; c < COUNT_COUNTERS; c++) counters[c].store(0, memory_order_relaxed);
+			for(int p = 0; p < PHASE_COUNT; p++) sampleTicks[p] = 0;
+		}
+
+		protocolMetrics(const protocolMetrics&);
+		protocolMetrics& operator=(const protocolMetrics&);
+
+		static void writeSummary(ostream &out, const latencyHistogram &h, double scale)
+		{
+			out << "{\"mean\":" << h.mean() * scale << ",\"p50\":" << h.percentile(0.50) * scale << ",\"p90\":" << h.percentile(0.90) * scale;
+			out << ",\"p99\":" << h.percentile(0.99) * scale << ",\"p999\":" << h.percentile(0.999) * scale << ",\"max\":" << h.max() * scale << "}";
+		}
+
+		// Data Members
+		latencyHistogram wall[PHASE_COUNT];        // Wall time per phase (ticks)
+		latencyHistogram network[PHASE_COUNT];     // Network time per phase (microseconds)
+		atomic<uint64_t> counters[COUNT_COUNTERS]; // Protocol event counts
+		uint32_t sampleTicks[PHASE_COUNT];         // Calls of each phase (writer only)
+		chrono::steady_clock::time_point startTime;// Steady clock at startup
+		uint64_t startTicks;                       // metricsClock() at startup
+};
+
+/*
+Background thread that appends a metrics snapshot to a file every interval, and once more
+when it is stopped
+*/
+class metricsDumper
+{
+	public:
+		// Constructor
+		metricsDumper() : interval(0), stopping(false) {}
+		~metricsDumper() { stop(); }
+
+		// Member Functions
+		// Starts dumping to fileName every seconds seconds. Returns false if the file cannot be
+		// created.
+		bool start(const char* fileName, double seconds)
+		{
+			file.open(fileName);
+			if(!file.is_open()) return false;
+			interval = seconds;
+			stopping = false;
+			writer = thread(&metricsDumper::run, this);
+			return true;
+		}
+
+		// Writes the final snapshot and stops the thread
+		void stop()
+		{
+			if(!writer.joinable()) return;
+			{
+				lock_guard<mutex> lock(guard);
+				stopping = true;
+			}
+			wake.notify_one();
+			writer.join();
+		}
+
+	private:
+		// Member Functions
+		void run()
+		{
+			unique_lock<mutex> lock(guard);
+			while(!stopping)
+			{
+				wake.wait_for(lock, chrono::duration<double>(interval), [this]() { return stopping; });
+				protocolMetrics::instance().writeJSON(file);
+			}
+		}
+
+		// Data Members
+		ofstream file;             // Snapshot file (JSON Lines)
+		double interval;           // Seconds between snapshots
+		bool stopping;             // Set by stop()
+		mutex guard;               // Protects stopping
+		condition_variable wake;   // Signals stop()
+		thread writer;             // Dump thread
+};
+
+#endif
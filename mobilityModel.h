@@ -0,0 +1,454 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Mobility models that move mobile nodes over a rectangular area and report when one leaves its
+foreign agent's radio range for another's, so handoffs follow from movement instead of a
+script.
+
+The foreign agents are spread evenly over the area, each near the middle of its own share of
+it, and heard up to a range that by default overlaps the neighboring agents' coverage. A
+coverage index (see coverageIndex.h) finds the agents in range of any position. A node keeps
+its agent for as long as it stays in that agent's range and then moves to the strongest agent
+in range, as a mobile node that registers again only when it stops hearing its agent's
+advertisements (lazy cell switching). A node out of every agent's range keeps its agent until
+it hears another. Three models choose where nodes go:
+
+	random waypoint  pick a point anywhere in the area, travel to it at a random speed,
+	                 pause, repeat
+	Manhattan grid   travel along a grid of streets one block at a time, going straight at
+	                 each intersection half the time and turning left or right otherwise
+	commuter         travel between a home point and a work point of the node's own,
+	                 dwelling at each end for about the dwell time
+
+Each node travels in legs: a straight segment at constant velocity, or a pause. Positions,
+velocities, the time left on each leg and the position and range of each node's agent are
+kept as a structure of arrays (one array per field), padded to a whole number of lanes, so a
+step advances every node and checks it is still in its agent's range in one fixed-width inner
+loop that the compiler turns into SIMD instructions (at -O2 as well as -O3). Only nodes whose
+leg has ended are then visited one at a time, and the nodes that left their agent's range are
+looked up in the coverage index together in one batch. A leg that ends part way through a step starts the
+next leg at the end of the step. Every node draws from its own random stream, so a node's path
+does not depend on any other node's.
+*/
+#ifndef MOBILITY_MODEL_H
+#define MOBILITY_MODEL_H
+
+#include <vector>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "randomStream.h"
+#include "coverageIndex.h"
+
+using namespace std;
+
+// How mobile nodes choose where to go
+enum mobilityPattern { MOBILITY_NONE, RANDOM_WAYPOINT, MANHATTAN_GRID, COMMUTER };
+
+// Area and movement settings (distances in meters, speeds in meters per second, times in seconds)
+struct mobilitySettings
+{
+	mobilitySettings() : pattern(MOBILITY_NONE), width(5000), height(5000), minSpeed(1), maxSpeed(15), pause(30),
+		streetSpacing(100), dwell(8 * 3600), range(0) {}
+
+	mobilityPattern pattern;  // Model (MOBILITY_NONE leaves the nodes where they are)
+	float width;              // Size of the area
+	float height;
+	float minSpeed;           // Each leg's speed is uniform in [minSpeed, maxSpeed]
+	float maxSpeed;
+	float pause;              // Random waypoint: wait at each waypoint
+	float streetSpacing;      // Manhattan grid: distance between streets
+	float dwell;              // Commuter: mean stay at home or at work
+	float range;              // Radio range of each foreign agent (0 picks 0.9 times the agents' spacing)
+};
+
+// Movement since the engine was configured
+struct mobilityStats
+{
+	mobilityStats() : steps(0), updates(0), legs(0), crossings(0), heard(0), uncovered(0), handoffs(0), wallTicks(0) {}
+
+	void add(const mobilityStats &other)
+	{
+		steps += other.steps;
+		updates += other.updates;
+		legs += other.legs;
+		crossings += other.crossings;
+		heard += other.heard;
+		uncovered += other.uncovered;
+		handoffs += other.handoffs;
+		wallTicks += other.wallTicks;
+	}
+
+	uint64_t steps;      // Steps taken
+	uint64_t updates;    // Node positions updated
+	uint64_t legs;       // Legs started
+	uint64_t crossings;  // Moves out of a foreign agent's range to another's
+	uint64_t heard;      // Advertisements in range where those moves were made
+	uint64_t uncovered;  // Node steps spent out of every foreign agent's range
+	uint64_t handoffs;   // Crossings that made a visiting node hand off (kept by the caller)
+	uint64_t wallTicks;  // Wall time spent in step() (metricsClock ticks, kept by the caller)
+};
+
+class mobilityEngine
+{
+	public:
+		// Constructor
+		mobilityEngine() : agents(0), cellsX(1), cellsY(1) {}
+
+		// Nodes advanced together by the inner step loop (the lane arrays hold a multiple of this)
+		static const size_t lanes = 8;
+
+		// Member Functions
+		// Uses the given model over an area covered by agentCount foreign agents, and forgets
+		// every node. Agent a sits in cell a of a grid of about agentCount cells, a random
+		// distance from the cell's middle.
+		void configure(const mobilitySettings &s, size_t agentCount)
+		{
+			settings = s;
+			agents = agentCount;
+			cellsX = (uint32_t) ceil(sqrt((double) agentCount * settings.width / settings.height));
+			if(cellsX < 1) cellsX = 1;
+			cellsY = (uint32_t) ((agentCount + cellsX - 1) / cellsX);
+			if(cellsY < 1) cellsY = 1;
+			float cellWidth = settings.width / cellsX, cellHeight = settings.height / cellsY;
+			if(settings.range <= 0) settings.range = 0.9f * (cellWidth > cellHeight ? cellWidth : cellHeight);
+			coverage.configure(settings.width, settings.height, settings.range);
+			for(uint32_t a = 0; a < agents; a++)
+			{
+				randomStream r = randomService::local().entityStream(a, STREAM_AGENT_PLACEMENT);
+				float jitterX = ((float) r.fraction() - 0.5f) * 0.5f, jitterY = ((float) r.fraction() - 0.5f) * 0.5f;
+				coverage.add(((a % cellsX) + 0.5f + jitterX) * cellWidth, ((a / cellsX) + 0.5f + jitterY) * cellHeight, settings.range);
+			}
+			coverage.build();
+			x.clear(); y.clear(); vx.clear(); vy.clear(); remaining.clear(); servingX.clear(); servingY.clear();
+			servingRange2.clear(); outside.clear(); agent.clear(); phase.clear(); homeX.clear(); homeY.clear();
+			workX.clear(); workY.clear(); random.clear();
+			counts = mobilityStats();
+		}
+
+		bool enabled() const { return settings.pattern != MOBILITY_NONE && agents > 0; }
+		size_t size() const { return agent.size(); }
+		float positionX(uint32_t node) const { return x[node]; }
+		float positionY(uint32_t node) const { return y[node]; }
+		const mobilitySettings& getSettings() const { return settings; }
+		const mobilityStats& stats() const { return counts; }
+		mobilityStats& stats() { return counts; }
+		const coverageIndex& getCoverage() const { return coverage; }
+
+		// Foreign agent serving a node
+		uint32_t agentOf(uint32_t node) const { return agent[node]; }
+
+		// Adds the node with the next handle at a starting point chosen by the model. Returns the
+		// foreign agent serving it: the strongest in range, or the one whose share of the area it
+		// starts in.
+		uint32_t add()
+		{
+			uint32_t node = (uint32_t) agent.size();
+			random.push_back(randomService::local().entityStream(node, STREAM_MOBILITY));
+			randomStream &r = random.back();
+			float startX = (float) r.fraction() * settings.width, startY = (float) r.fraction() * settings.height;
+			if(settings.pattern == MANHATTAN_GRID) snapToStreet(startX, startY);
+			if(node == x.size())
+			{
+				// Another lane group, idle until nodes are added to it
+				size_t padded = x.size() + lanes;
+				x.resize(padded, 0);
+				y.resize(padded, 0);
+				vx.resize(padded, 0);
+				vy.resize(padded, 0);
+				remaining.resize(padded, 0);
+				servingX.resize(padded, 0);
+				servingY.resize(padded, 0);
+				servingRange2.resize(padded, 0);
+				outside.resize(padded, 0);
+			}
+			x[node] = startX;
+			y[node] = startY;
+			phase.push_back(0);
+			if(settings.pattern == COMMUTER)
+			{
+				// Home is where the node starts, work is anywhere else in the area
+				homeX.push_back(startX);
+				homeY.push_back(startY);
+				workX.push_back((float) r.fraction() * settings.width);
+				workY.push_back((float) r.fraction() * settings.height);
+			}
+			uint32_t serving = coverage.best(startX, startY);
+			agent.push_back(serving != coverageIndex::NONE ? serving : shareAt(startX, startY));
+			serve(node, agent.back());
+
+			// Commuters leave home at different times; the other models set off at once
+			if(settings.pattern == COMMUTER) pauseFor(node, settings.dwell * (float) r.fraction());
+			else startLeg(node);
+			return agentOf(node);
+		}
+
+		// Moves every node on by the given seconds. Returns the nodes now served by a different
+		// foreign agent, valid until the next call.
+		const vector<uint32_t>& step(float seconds)
+		{
+			crossed.clear();
+			size_t n = agent.size();
+			if(!enabled() || n == 0) return crossed;
+
+			advance(x.data(), y.data(), vx.data(), vy.data(), remaining.data(), servingX.data(), servingY.data(),
+			        servingRange2.data(), outside.data(), n, seconds);
+
+			// Start new legs and gather the nodes out of their agent's range
+			lost.clear();
+			lostX.clear();
+			lostY.clear();
+			for(size_t i = 0; i < n; i++)
+			{
+				if(remaining[i] <= 0) startLeg((uint32_t) i);
+				if(outside[i] == 0) continue;
+				lost.push_back((uint32_t) i);
+				lostX.push_back(x[i]);
+				lostY.push_back(y[i]);
+			}
+
+			// Look them all up in one batch and move each to the strongest agent it hears
+			found.resize(lost.size());
+			coverage.locate(lostX.data(), lostY.data(), lost.size(), found.data());
+			for(size_t k = 0; k < lost.size(); k++)
+			{
+				uint32_t node = lost[k];
+				if(found[k] == coverageIndex::NONE)
+				{
+					counts.uncovered++;
+					continue;
+				}
+				counts.heard += coverage.countInRange(lostX[k], lostY[k]);
+				agent[node] = found[k];
+				serve(node, found[k]);
+				crossed.push_back(node);
+			}
+
+			counts.steps++;
+			counts.updates += n;
+			counts.crossings += crossed.size();
+			return crossed;
+		}
+
+		// Snapshot support: settings, coverage grid and every node's state are saved as blocks
+		// (statistics are not saved)
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.value(settings);
+			out.value(agents);
+			out.value(cellsX);
+			out.value(cellsY);
+			coverage.save(out);
+			out.array(x);
+			out.array(y);
+			out.array(vx);
+			out.array(vy);
+			out.array(remaining);
+			out.array(agent);
+			out.array(phase);
+			out.array(homeX);
+			out.array(homeY);
+			out.array(workX);
+			out.array(workY);
+			out.array(random);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.value(settings) || !in.value(agents) || !in.value(cellsX) || !in.value(cellsY) || !coverage.load(in) ||
+			   !in.array(x) || !in.array(y) || !in.array(vx) || !in.array(vy) || !in.array(remaining) || !in.array(agent) ||
+			   !in.array(phase) || !in.array(homeX) || !in.array(homeY) || !in.array(workX) || !in.array(workY) || !in.array(random))
+				return false;
+			size_t n = agent.size(), padded = (n + lanes - 1) / lanes * lanes;
+			bool commuters = settings.pattern == COMMUTER;
+			if(coverage.size() != agents || x.size() != padded || y.size() != padded || vx.size() != padded ||
+			   vy.size() != padded || remaining.size() != padded || phase.size() != n || random.size() != n ||
+			   homeX.size() != (commuters ? n : 0) || homeY.size() != homeX.size() || workX.size() != homeX.size() ||
+			   workY.size() != homeX.size())
+				return in.fail("mobility model is inconsistent");
+			for(size_t i = 0; i < n; i++)
+				if(agent[i] >= agents) return in.fail("mobility model is inconsistent");
+
+			// The serving agents' positions follow from the agents
+			servingX.assign(padded, 0);
+			servingY.assign(padded, 0);
+			servingRange2.assign(padded, 0);
+			outside.assign(padded, 0);
+			for(size_t i = 0; i < n; i++) serve((uint32_t) i, agent[i]);
+			counts = mobilityStats();
+			return true;
+		}
+
+	private:
+		// Leg phases: moving or paused, and for commuters which end the node is bound for
+		static const uint8_t MOVING = 1;
+		static const uint8_t TO_WORK = 2;
+
+		// Member Functions
+		// Moves the first n nodes (rounded up to whole lane groups) along their legs by seconds and
+		// flags those out of their agent's range, a lane group at a time. The arrays do not
+		// overlap, so the fixed-width inner loop is vectorized.
+		static void advance(float* __restrict px, float* __restrict py, const float* __restrict pvx, const float* __restrict pvy,
+		                    float* __restrict left, const float* __restrict sx, const float* __restrict sy,
+		                    const float* __restrict sr2, uint32_t* __restrict away, size_t n, float seconds)
+		{
+			for(size_t group = 0; group < n; group += lanes)
+			{
+				for(size_t lane = 0; lane < lanes; lane++)
+				{
+					size_t i = group + lane;
+					float t = left[i] < seconds ? left[i] : seconds;
+					px[i] += pvx[i] * t;
+					py[i] += pvy[i] * t;
+					left[i] -= seconds;
+					float dx = px[i] - sx[i], dy = py[i] - sy[i];
+					away[i] = dx * dx + dy * dy > sr2[i] ? 1 : 0;
+				}
+			}
+		}
+
+		// Copies the position and range of a node's agent into the lane arrays
+		void serve(uint32_t node, uint32_t a)
+		{
+			servingX[node] = coverage.positionX(a);
+			servingY[node] = coverage.positionY(a);
+			float range = coverage.range(a);
+			servingRange2[node] = range * range;
+		}
+
+		// Street direction of a Manhattan grid heading (0 east, 1 north, 2 west, 3 south)
+		static float headingX(int heading) { return heading == 0 ? 1.0f : (heading == 2 ? -1.0f : 0.0f); }
+		static float headingY(int heading) { return heading == 1 ? 1.0f : (heading == 3 ? -1.0f : 0.0f); }
+
+		// Agent whose share of the area holds (px, py) (the last agent takes any unused cells)
+		uint32_t shareAt(float px, float py) const
+		{
+			float cx = px / (settings.width / cellsX), cy = py / (settings.height / cellsY);
+			cx = cx < 0 ? 0 : (cx > cellsX - 1 ? cellsX - 1 : cx);
+			cy = cy < 0 ? 0 : (cy > cellsY - 1 ? cellsY - 1 : cy);
+			size_t c = (size_t) cy * cellsX + (size_t) cx;
+			return (uint32_t) (c < agents ? c : agents - 1);
+		}
+
+		void snapToStreet(float &px, float &py) const
+		{
+			float spacing = settings.streetSpacing;
+			px = floorf(px / spacing + 0.5f) * spacing;
+			py = floorf(py / spacing + 0.5f) * spacing;
+			if(px > settings.width) px -= spacing;
+			if(py > settings.height) py -= spacing;
+		}
+
+		float speed(randomStream &r) const
+		{
+			return settings.minSpeed + (float) r.fraction() * (settings.maxSpeed - settings.minSpeed);
+		}
+
+		// Travels in a straight line from the current position to (toX, toY)
+		void travelTo(uint32_t node, float toX, float toY, float metersPerSecond)
+		{
+			float dx = toX - x[node], dy = toY - y[node];
+			float distance = sqrtf(dx * dx + dy * dy);
+			if(distance <= 0 || metersPerSecond <= 0)
+			{
+				pauseFor(node, 0);
+				return;
+			}
+			vx[node] = dx / distance * metersPerSecond;
+			vy[node] = dy / distance * metersPerSecond;
+			remaining[node] = distance / metersPerSecond;
+			phase[node] |= MOVING;
+		}
+
+		void pauseFor(uint32_t node, float seconds)
+		{
+			vx[node] = 0;
+			vy[node] = 0;
+			remaining[node] = seconds;
+			phase[node] &= (uint8_t) ~MOVING;
+		}
+
+		// Chooses a node's next leg once its current leg has ended
+		void startLeg(uint32_t node)
+		{
+			randomStream &r = random[node];
+			counts.legs++;
+			switch(settings.pattern)
+			{
+				case RANDOM_WAYPOINT:
+					if((phase[node] & MOVING) && settings.pause > 0) pauseFor(node, settings.pause);
+					else travelTo(node, (float) r.fraction() * settings.width, (float) r.fraction() * settings.height, speed(r));
+					break;
+
+				case MANHATTAN_GRID:
+				{
+					// Straight on half the time, otherwise left or right; turn back only at a corner
+					// of the area. The heading is kept in the phase's upper bits.
+					float px = x[node], py = y[node];
+					snapToStreet(px, py);
+					x[node] = px;
+					y[node] = py;
+					int heading = phase[node] >> 2;
+					uint32_t roll = r.below(4);
+					int order[4] = { heading, (heading + 1) & 3, (heading + 3) & 3, (heading + 2) & 3 };
+					if(roll == 2) { order[0] = (heading + 1) & 3; order[1] = heading; }
+					if(roll == 3) { order[0] = (heading + 3) & 3; order[2] = heading; }
+					for(int k = 0; k < 4; k++)
+					{
+						float toX = px + headingX(order[k]) * settings.streetSpacing;
+						float toY = py + headingY(order[k]) * settings.streetSpacing;
+						if(toX < 0 || toY < 0 || toX > settings.width || toY > settings.height) continue;
+						phase[node] = (uint8_t) (order[k] << 2);
+						travelTo(node, toX, toY, speed(r));
+						break;
+					}
+					break;
+				}
+
+				case COMMUTER:
+					if(phase[node] & MOVING) pauseFor(node, settings.dwell * (0.5f + (float) r.fraction()));
+					else
+					{
+						phase[node] ^= TO_WORK;
+						if(phase[node] & TO_WORK) travelTo(node, workX[node], workY[node], speed(r));
+						else travelTo(node, homeX[node], homeY[node], speed(r));
+					}
+					break;
+
+				case MOBILITY_NONE:
+					pauseFor(node, 0);
+					break;
+			}
+		}
+
+		// Data Members
+		mobilitySettings settings;  // Model and area
+		size_t agents;              // Foreign agents covering the area
+		uint32_t cellsX, cellsY;    // Grid the agents are placed on, one per cell
+		coverageIndex coverage;     // Agents' radio coverage
+		vector<float> x, y;         // Position of each node (lane arrays)
+		vector<float> vx, vy;       // Velocity on the current leg (lane arrays)
+		vector<float> remaining;    // Seconds left on the current leg (lane array)
+		vector<float> servingX;     // Position of each node's agent (lane arrays)
+		vector<float> servingY;
+		vector<float> servingRange2;// Square of its range (lane array)
+		vector<uint32_t> outside;   // Set by a step for nodes out of their agent's range (lane array)
+		vector<uint32_t> agent;     // Foreign agent serving each node
+		vector<uint8_t> phase;      // Leg phase bits (and Manhattan heading)
+		vector<float> homeX, homeY; // Commuter home points (commuter model only)
+		vector<float> workX, workY; // Commuter work points
+		vector<randomStream> random;// Each node's choices
+		vector<uint32_t> crossed;   // Nodes handed out by step()
+		vector<uint32_t> lost;      // Nodes out of range in the current step, and their positions
+		vector<float> lostX, lostY;
+		vector<uint32_t> found;     // Strongest agent each of them hears
+		mobilityStats counts;       // Activity counters
+};
+
+#endif
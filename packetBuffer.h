@@ -0,0 +1,141 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Packet buffers and the IP-in-IP tunnel datapath (RFC 2003). A packet buffer keeps free
+headroom in front of the packet. The home agent (or a correspondent using direct routing)
+tunnels a datagram by writing an outer IPv4 header into that headroom, and a foreign agent
+removes it by moving the start offset past it. The datagram itself is never copied, and an
+anchor foreign agent can re-tunnel a packet in place over and over.
+
+A buffer's storage is inline, so a buffer on the stack needs no heap allocation. Header
+checksums are kept valid at every hop. Forwarding decrements the TTL and patches the header
+checksum incrementally (RFC 1624) instead of summing the header again.
+*/
+#ifndef PACKET_BUFFER_H
+#define PACKET_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+#include "wireFormat.h"
+
+using namespace std;
+
+class packetBuffer
+{
+	public:
+		// Bytes of storage, and bytes kept free in front of a new packet (room for several
+		// outer headers)
+		static const size_t capacity = 2048;
+		static const size_t headroom = 128;
+
+		// Constructor
+		packetBuffer() : start(headroom), end(headroom) {}
+
+		// Member Functions
+		uint8_t* data() { return storage + start; }
+		const uint8_t* data() const { return storage + start; }
+		size_t length() const { return end - start; }
+		size_t headroomLeft() const { return start; }
+
+		// Empties the buffer, restoring the full headroom
+		void reset() { start = end = headroom; }
+
+		// Extends the packet at the back and returns the new bytes (NULL if there is no room)
+		uint8_t* append(size_t bytes)
+		{
+			if(bytes > capacity - end) return NULL;
+			uint8_t* p = storage + end;
+			end += bytes;
+			return p;
+		}
+
+		// Extends the packet at the front into the headroom and returns the new bytes (NULL if
+		// the headroom is used up)
+		uint8_t* prepend(size_t bytes)
+		{
+			if(bytes > start) return NULL;
+			start -= bytes;
+			return storage + start;
+		}
+
+		// Drops bytes from the front of the packet
+		bool pull(size_t bytes)
+		{
+			if(bytes > length()) return false;
+			start += bytes;
+			return true;
+		}
+
+		// Cuts the packet down to length bytes
+		void trim(size_t bytes) { if(bytes < length()) end = start + bytes; }
+
+	private:
+		// Data Members
+		size_t start;               // Offset of the first packet byte
+		size_t end;                 // Offset past the last packet byte
+		uint8_t storage[capacity];  // Headroom, packet and tailroom
+};
+
+/*
+Decrements the TTL of the IPv4 header at header when a router forwards the packet. The
+header checksum is updated incrementally: HC' = ~(~HC + ~m + m') over the TTL/protocol word.
+Returns false (leaving the header untouched) if the TTL has run out.
+*/
+inline bool forwardHop(uint8_t* header)
+{
+	if(header[8] <= 1) return false;
+	uint16_t before = wireGet16(header + 8);
+	header[8]--;
+	uint32_t sum = (uint32_t) (uint16_t) ~wireGet16(header + 10) + (uint16_t) ~before + wireGet16(header + 8);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	wirePut16(header + 10, (uint16_t) ~sum);
+	return true;
+}
+
+/*
+Tunnels the IPv4 packet in the buffer from source to destination by writing an outer header
+(protocol 4) into the headroom. The outer header copies the inner type of service. Only the
+inner version and length are checked here; the tunnel exit verifies the inner checksum.
+Returns false if the buffer does not hold an IPv4 packet or the headroom is used up.
+*/
+inline bool encapsulate(packetBuffer &packet, IPv4Addr source, IPv4Addr destination, uint16_t identification)
+{
+	const uint8_t* inner = packet.data();
+	if(packet.length() < IPV4_HEADER_SIZE || (inner[0] >> 4) != 4) return false;
+	size_t innerLength = wireGet16(inner + 2);
+	if(innerLength < IPV4_HEADER_SIZE || innerLength > packet.length()) return false;
+	uint8_t typeOfService = inner[1];
+	packet.trim(innerLength);
+
+	uint8_t* outer = packet.prepend(IPV4_HEADER_SIZE);
+	if(outer == NULL) return false;
+	encodeIPv4Header(outer, IPV4_HEADER_SIZE, source, destination, IP_PROTOCOL_IPIP, innerLength, identification, 64, typeOfService);
+	return true;
+}
+
+/*
+Removes the outer header of a tunneled packet so the buffer starts at the inner datagram.
+The outer header and the inner header are both checked. Returns false (leaving the buffer
+untouched) if the packet is not a valid IP-in-IP packet. If tunnelSource is not NULL, it is
+set to the encapsulator's address.
+*/
+inline bool decapsulate(packetBuffer &packet, IPv4Addr* tunnelSource = NULL)
+{
+	ipv4View outer;
+	if(!outer.parse(packet.data(), packet.length()) || outer.protocol() != IP_PROTOCOL_IPIP) return false;
+	ipv4View inner;
+	if(!inner.parse(outer.payload(), outer.payloadLength())) return false;
+
+	if(tunnelSource != NULL) *tunnelSource = outer.source();
+	packet.pull(outer.headerLength());
+	packet.trim(inner.totalLength());
+	return true;
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Compiler intrinsics the simulator relies on, behind one name each so that GCC, Clang and
+MSVC builds all compile. Where a target has no equivalent, the helper falls back to plain
+C++ or says so (cycleCounterAvailable).
+*/
+#ifndef PORTABILITY_H
+#define PORTABILITY_H
+
+#include <stdint.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+// True where cycleCounter() reads the CPU timestamp counter
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+const bool cycleCounterAvailable = true;
+#else
+const bool cycleCounterAvailable = false;
+#endif
+
+// CPU timestamp counter, or 0 where there is none (see cycleCounterAvailable)
+inline uint64_t cycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// Position of the highest set bit of value (value > 0), so highestBit(1) is 0
+inline int highestBit(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (int) index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if(_BitScanReverse(&index, (unsigned long) (value >> 32))) return (int) index + 32;
+	_BitScanReverse(&index, (unsigned long) value);
+	return (int) index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+// Hints that the cache line holding address will be read soon. Does nothing where the compiler
+// has no prefetch instruction to offer.
+inline void prefetch(const void* address)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_prefetch((const char*) address, _MM_HINT_T0);
+#else
+	(void) address;
+#endif
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Seedable random numbers for the simulator, replacing the C library's rand(). Every random
+choice comes from a randomStream, a xoshiro256** generator: four 64-bit words of state, a few
+shifts and rotates per number, and no shared state, so streams on different threads never
+contend or interfere.
+
+A stream is named by a master seed and a stream number. Both are mixed through splitmix64 to
+fill the state, so any two names give unrelated sequences, and a stream gives the same numbers
+whatever else runs before it or beside it. Each thread has a randomService holding its master
+seed and a shared stream (number 0) for work such as building a topology; entities that make
+their own choices, such as mobile nodes, carry a stream of their own numbered after their
+handle. A run is then repeatable from its seed alone, whatever the order its events are
+handled in or the number of threads it is spread over.
+
+Numbers in a range are drawn without modulo bias (Lemire's multiply-and-reject method), and
+every range is inclusive of both ends, so a range never produces a value outside it (such as
+a registration lifetime of 0).
+*/
+#ifndef RANDOM_STREAM_H
+#define RANDOM_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+// Next value of a splitmix64 sequence, used to turn seeds into generator state
+inline uint64_t splitmix64(uint64_t &state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+class randomStream
+{
+	public:
+		// Constructor: stream number stream of master seed seed
+		randomStream(uint64_t seed = 0, uint64_t stream = 0)
+		{
+			uint64_t mix = seed, number = stream;
+			mix = splitmix64(mix) ^ splitmix64(number);
+			for(int i = 0; i < 4; i++) state[i] = splitmix64(mix);
+		}
+
+		// Member Functions
+		// Next 64 random bits
+		uint64_t next()
+		{
+			uint64_t result = rotate(state[1] * 5, 7) * 9;
+			uint64_t t = state[1] << 17;
+			state[2] ^= state[0];
+			state[3] ^= state[1];
+			state[1] ^= state[2];
+			state[0] ^= state[3];
+			state[2] ^= t;
+			state[3] = rotate(state[3], 45);
+			return result;
+		}
+
+		// Uniform value in [0, bound) (bound > 0)
+		uint32_t below(uint32_t bound)
+		{
+			uint64_t product = (next() >> 32) * bound;
+			uint32_t low = (uint32_t) product;
+			if(low < bound)
+			{
+				uint32_t threshold = (uint32_t) -bound % bound;
+				while(low < threshold)
+				{
+					product = (next() >> 32) * bound;
+					low = (uint32_t) product;
+				}
+			}
+			return (uint32_t) (product >> 32);
+		}
+
+		// Uniform value in [0, 1)
+		double fraction() { return (double) (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+		// Uniform value in [low, high]
+		uint32_t between(uint32_t low, uint32_t high)
+		{
+			return high - low == 0xFFFFFFFF ? (uint32_t) (next() >> 32) : low + below(high - low + 1);
+		}
+
+	private:
+		static uint64_t rotate(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+		// Data Members
+		uint64_t state[4];  // xoshiro256** state (never all zero)
+};
+
+// What an entity stream is used for, so one entity can have several independent streams
+enum randomPurpose { STREAM_MOBILE_NODE, STREAM_MOBILITY, STREAM_AGENT_PLACEMENT };
+
+/*
+Random numbers of one thread: the master seed its streams are named from and its shared
+stream. Seeding a thread again restarts its shared stream.
+*/
+class randomService
+{
+	public:
+		// Stream numbers below firstEntityStream are the thread's own; entity streams follow
+		static const uint64_t firstEntityStream = 1;
+
+		// Constructor
+		randomService() : masterSeed(0), shared(0, 0) {}
+
+		// Member Functions
+		// Service of the calling thread
+		static randomService& local()
+		{
+			static thread_local randomService service;
+			return service;
+		}
+
+		void seed(uint64_t master)
+		{
+			masterSeed = master;
+			shared = randomStream(master, 0);
+		}
+
+		uint64_t seed() const { return masterSeed; }
+		randomStream& stream() { return shared; }
+
+		// Stream of the entity with the given handle for one purpose, independent of the shared
+		// stream and of every other entity's and purpose's
+		randomStream entityStream(uint64_t handle, randomPurpose purpose = STREAM_MOBILE_NODE) const
+		{
+			return randomStream(masterSeed, firstEntityStream + ((uint64_t) purpose << 32) + handle);
+		}
+
+	private:
+		// Data Members
+		uint64_t masterSeed;   // Seed every stream is named from
+		randomStream shared;   // Thread's shared stream (number 0)
+};
+
+// Shared stream of the calling thread
+inline randomStream& threadRandom() { return randomService::local().stream(); }
+
+#endif
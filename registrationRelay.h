@@ -0,0 +1,154 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Batched registration relay at the foreign agents. Instead of relaying each registration
+request to the home agent as it arrives, a foreign agent queues the requests bound for the
+same home agent and relays them as one message, either when the batch is full or when its
+oldest request has waited for the batch's time limit. The home agent applies the whole batch
+in one pass over its binding table and answers with one combined reply, which the foreign
+agent splits back into a reply per mobile node.
+
+Each (foreign agent, home agent) pair that has had a request gets its own queue, found
+through an address index. Taking a batch swaps the queue with a scratch array, so once every
+queue has grown to the batch size, queuing and relaying never allocate.
+*/
+#ifndef REGISTRATION_RELAY_H
+#define REGISTRATION_RELAY_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "addressIndex.h"
+#include "eventScheduler.h"
+
+using namespace std;
+
+// Registration request waiting at a foreign agent for its batch to be relayed
+struct pendingRegistration
+{
+	uint32_t mobile;   // Handle of the requesting mobile node
+	uint32_t session;  // Registration event key (1 starts the mobile node's datagram stream)
+	simTime arrived;   // When the mobile node sent the request
+};
+
+// Relay activity since the relay was created
+struct registrationRelayStats
+{
+	registrationRelayStats() : batches(0), requests(0), fullBatches(0), latency(0), maxLatency(0), wallTicks(0) {}
+
+	void add(const registrationRelayStats &other)
+	{
+		batches += other.batches;
+		requests += other.requests;
+		fullBatches += other.fullBatches;
+		latency += other.latency;
+		if(other.maxLatency > maxLatency) maxLatency = other.maxLatency;
+		wallTicks += other.wallTicks;
+	}
+
+	uint64_t batches;      // Relay messages sent to home agents
+	uint64_t requests;     // Registration requests they carried
+	uint64_t fullBatches;  // Batches sent because they were full rather than on time
+	uint64_t latency;      // Sum of the requests' network time from request to reply (microseconds)
+	uint64_t maxLatency;   // Longest of those
+	uint64_t wallTicks;    // Wall time spent relaying and applying batches (metricsClock ticks)
+};
+
+class registrationRelay
+{
+	public:
+		// Constructor
+		registrationRelay() : batchLimit(0), maxWait(0) {}
+
+		// Member Functions
+		// Batches of up to batchSize requests, each sent at most wait after its first request
+		// (batchSize 0 turns batching off)
+		void configure(size_t batchSize, simTime wait)
+		{
+			batchLimit = batchSize;
+			maxWait = wait;
+		}
+
+		bool enabled() const { return batchLimit > 0; }
+		size_t batchSize() const { return batchLimit; }
+		simTime wait() const { return maxWait; }
+		const registrationRelayStats& stats() const { return counts; }
+		registrationRelayStats& stats() { return counts; }
+
+		// Queues a request from a foreign agent for its home agent. Returns the size of the
+		// batch with the request added.
+		size_t enqueue(uint32_t foreign, uint32_t home, const pendingRegistration &request)
+		{
+			uint64_t key = keyOf(foreign, home);
+			uint32_t queue = index.find(key);
+			if(queue == addressIndex::NONE)
+			{
+				queue = (uint32_t) queues.size();
+				queues.push_back(vector<pendingRegistration>());
+				queues.back().reserve(batchLimit);
+				index.insert(key, queue);
+			}
+			queues[queue].push_back(request);
+			return queues[queue].size();
+		}
+
+		// When the oldest request of a batch was sent. Returns false if the batch is empty.
+		bool oldest(uint32_t foreign, uint32_t home, simTime &arrived) const
+		{
+			uint32_t queue = index.find(keyOf(foreign, home));
+			if(queue == addressIndex::NONE || queues[queue].empty()) return false;
+			arrived = queues[queue].front().arrived;
+			return true;
+		}
+
+		// Empties a batch and returns its requests, oldest first. The array is valid until the
+		// next call.
+		const vector<pendingRegistration>& take(uint32_t foreign, uint32_t home)
+		{
+			batch.clear();
+			uint32_t queue = index.find(keyOf(foreign, home));
+			if(queue != addressIndex::NONE) batch.swap(queues[queue]);
+			return batch;
+		}
+
+		// Snapshot support: the settings and every queued request (statistics are not saved)
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.value(batchLimit);
+			out.value(maxWait);
+			index.save(out);
+			out.value(queues.size());
+			for(size_t i = 0; i < queues.size(); i++) out.array(queues[i]);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			size_t count;
+			if(!in.value(batchLimit) || !in.value(maxWait) || !index.load(in) || !in.value(count)) return false;
+			if(count != index.size()) return in.fail("registration relay is inconsistent");
+			queues.assign(count, vector<pendingRegistration>());
+			for(size_t i = 0; i < count; i++)
+				if(!in.array(queues[i])) return false;
+			return true;
+		}
+
+	private:
+		// Index key of a (foreign agent, home agent) pair (never 0)
+		static uint64_t keyOf(uint32_t foreign, uint32_t home) { return ((uint64_t) foreign << 32 | home) + 1; }
+
+		// Data Members
+		size_t batchLimit;                          // Requests per batch (0 disables batching)
+		simTime maxWait;                            // Longest a request waits for its batch
+		addressIndex index;                         // (foreign agent, home agent) -> queue
+		vector<vector<pendingRegistration> > queues;// Requests waiting in each queue
+		vector<pendingRegistration> batch;          // Batch handed out by take()
+		registrationRelayStats counts;              // Activity counters
+};
+
+#endif
@@ -0,0 +1,358 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Loopback UDP transport for Mobile IP registration (Linux only). The server binds a
+non-blocking socket to 127.0.0.1 (port 434 by default) and waits on it with epoll. It
+receives requests in batches with recvmmsg, passes each one to a handler that writes the
+reply, and sends every reply in the batch with a single sendmmsg. It knows nothing about
+home agents; the simulator supplies the handler.
+
+The load generator acts as many foreign agents. Each foreign agent has its own socket and
+keeps a window of requests in flight. It stamps every request's identification field with
+its index, so each reply can be matched to the time its request was sent. The report gives
+registrations per second and median and p99 reply latency.
+*/
+#ifndef REGISTRATION_SERVER_H
+#define REGISTRATION_SERVER_H
+
+#ifdef __linux__
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include "address.h"
+#include "wireFormat.h"
+
+using namespace std;
+
+// Messages moved per recvmmsg/sendmmsg call
+const int REGISTRATION_BATCH = 64;
+
+// Largest registration message handled (requests may carry extensions)
+const size_t REGISTRATION_MESSAGE_MAX = 256;
+
+// Opens a non-blocking UDP socket bound to 127.0.0.1:port (0 picks a free port)
+inline int openLoopbackSocket(uint16_t port, string &error)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0)
+	{
+		error = string("socket: ") + strerror(errno);
+		return -1;
+	}
+	int bufferSize = 4 << 20;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(bind(fd, (sockaddr*) &address, sizeof(address)) < 0)
+	{
+		error = "bind 127.0.0.1:" + to_string(port) + ": " + strerror(errno);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// recvmmsg/sendmmsg headers and buffers for one batch of messages
+struct messageBatch
+{
+	messageBatch()
+	{
+		memset(headers, 0, sizeof(headers));
+		for(int i = 0; i < REGISTRATION_BATCH; i++)
+		{
+			vectors[i].iov_base = buffers[i];
+			vectors[i].iov_len = REGISTRATION_MESSAGE_MAX;
+			headers[i].msg_hdr.msg_iov = &vectors[i];
+			headers[i].msg_hdr.msg_iovlen = 1;
+			headers[i].msg_hdr.msg_name = &peers[i];
+			headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		}
+	}
+
+	// Resets message i to receive a full buffer from any peer
+	void prepareReceive(int i)
+	{
+		vectors[i].iov_len = REGISTRATION_MESSAGE_MAX;
+		headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+	}
+
+	mmsghdr headers[REGISTRATION_BATCH];
+	iovec vectors[REGISTRATION_BATCH];
+	sockaddr_in peers[REGISTRATION_BATCH];
+	uint8_t buffers[REGISTRATION_BATCH][REGISTRATION_MESSAGE_MAX];
+};
+
+class registrationServer
+{
+	public:
+		// Constructor
+		registrationServer() : socketFd(-1), epollFd(-1), running(false), received(0), replied(0), dropped(0) {}
+
+		~registrationServer()
+		{
+			if(socketFd >= 0) close(socketFd);
+			if(epollFd >= 0) close(epollFd);
+		}
+
+		// Member Functions
+		// Binds the service socket. Returns false and sets error on failure.
+		bool open(uint16_t port, string &error)
+		{
+			socketFd = openLoopbackSocket(port, error);
+			if(socketFd < 0) return false;
+			epollFd = epoll_create1(EPOLL_CLOEXEC);
+			epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events = EPOLLIN;
+			if(epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, socketFd, &event) < 0)
+			{
+				error = string("epoll: ") + strerror(errno);
+				return false;
+			}
+			running = true;
+			return true;
+		}
+
+		// Port the socket is bound to
+		uint16_t port() const
+		{
+			sockaddr_in address;
+			socklen_t length = sizeof(address);
+			getsockname(socketFd, (sockaddr*) &address, &length);
+			return ntohs(address.sin_port);
+		}
+
+		// Serves requests until stop() is called. handler(request, length, reply, capacity)
+		// returns the reply length, or 0 to send nothing.
+		template <class Handler>
+		void run(Handler handler)
+		{
+			messageBatch in, out;
+			epoll_event event;
+			while(running.load(memory_order_relaxed))
+			{
+				if(epoll_wait(epollFd, &event, 1, 100) <= 0) continue;
+
+				// Drain the socket one batch at a time
+				while(true)
+				{
+					for(int i = 0; i < REGISTRATION_BATCH; i++) in.prepareReceive(i);
+					int count = recvmmsg(socketFd, in.headers, REGISTRATION_BATCH, MSG_DONTWAIT, NULL);
+					if(count <= 0) break;
+					received.fetch_add((uint64_t) count, memory_order_relaxed);
+
+					int replies = 0;
+					for(int i = 0; i < count; i++)
+					{
+						size_t length = handler(in.buffers[i], (size_t) in.headers[i].msg_len, out.buffers[replies], REGISTRATION_MESSAGE_MAX);
+						if(length == 0) continue;
+						out.vectors[replies].iov_len = length;
+						out.peers[replies] = in.peers[i];
+						out.headers[replies].msg_hdr.msg_namelen = in.headers[i].msg_hdr.msg_namelen;
+						replies++;
+					}
+					sendBatch(out, replies);
+					if(count < REGISTRATION_BATCH) break;
+				}
+			}
+		}
+
+		void stop() { running = false; }
+		uint64_t requestsReceived() const { return received.load(); }
+		uint64_t repliesSent() const { return replied.load(); }
+		uint64_t repliesDropped() const { return dropped.load(); }
+
+	private:
+		registrationServer(const registrationServer&);
+		registrationServer& operator=(const registrationServer&);
+
+		// Sends replies, retrying partial sends. Replies the socket cannot take are dropped,
+		// as a UDP service would.
+		void sendBatch(messageBatch &out, int count)
+		{
+			int sent = 0;
+			while(sent < count)
+			{
+				int n = sendmmsg(socketFd, out.headers + sent, (unsigned) (count - sent), MSG_DONTWAIT);
+				if(n <= 0)
+				{
+					dropped.fetch_add((uint64_t) (count - sent), memory_order_relaxed);
+					break;
+				}
+				sent += n;
+			}
+			replied.fetch_add((uint64_t) sent, memory_order_relaxed);
+		}
+
+		// Data Members
+		int socketFd;                // Service socket
+		int epollFd;                 // Readiness notification
+		atomic<bool> running;        // Cleared by stop()
+		atomic<uint64_t> received;   // Requests received
+		atomic<uint64_t> replied;    // Replies sent
+		atomic<uint64_t> dropped;    // Replies the socket refused
+};
+
+// Outcome of a load test
+struct registrationLoadResult
+{
+	registrationLoadResult() : sent(0), accepted(0), rejected(0), lost(0), seconds(0), medianUs(0), p99Us(0) {}
+
+	uint64_t sent;      // Requests sent
+	uint64_t accepted;  // Replies with code 0
+	uint64_t rejected;  // Replies with any other code
+	uint64_t lost;      // Requests never answered
+	double seconds;     // Wall time of the test
+	double medianUs;    // Median reply latency
+	double p99Us;       // 99th percentile reply latency
+};
+
+/*
+Sends requests registration requests to the server on 127.0.0.1:port from foreignAgents
+sockets, each keeping up to window requests in flight. Mobile node i registers home address
+10.x.x.x (i mod 16M) with care-of address 127.1.x.x of its foreign agent.
+*/
+inline bool runRegistrationLoad(uint16_t port, IPv4Addr homeAgent, size_t requests, size_t foreignAgents, size_t window,
+                                registrationLoadResult &result, string &error)
+{
+	typedef chrono::steady_clock clock;
+	const clock::duration giveUp = chrono::seconds(1);
+
+	// One connected socket per foreign agent
+	int epollFd = epoll_create1(EPOLL_CLOEXEC);
+	vector<int> sockets;
+	sockaddr_in server;
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_port = htons(port);
+	server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	for(size_t i = 0; i < foreignAgents; i++)
+	{
+		int fd = openLoopbackSocket(0, error);
+		if(fd < 0 || connect(fd, (sockaddr*) &server, sizeof(server)) < 0)
+		{
+			if(fd >= 0) error = string("connect: ") + strerror(errno);
+			for(size_t j = 0; j < sockets.size(); j++) close(sockets[j]);
+			if(fd >= 0) close(fd);
+			close(epollFd);
+			return false;
+		}
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.u32 = (uint32_t) i;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+		sockets.push_back(fd);
+	}
+
+	vector<clock::time_point> sentAt(requests);
+	vector<uint32_t> latencies;
+	latencies.reserve(requests);
+	vector<size_t> inFlight(foreignAgents, 0);
+	messageBatch batch;
+	vector<epoll_event> events(foreignAgents);
+	size_t next = 0;
+	clock::time_point start = clock::now();
+	clock::time_point lastReply = start;
+
+	while(result.accepted + result.rejected < requests)
+	{
+		// Top up every foreign agent's window
+		for(size_t fa = 0; fa < foreignAgents && next < requests; fa++)
+		{
+			int count = 0;
+			while(count < REGISTRATION_BATCH && inFlight[fa] + (size_t) count < window && next + (size_t) count < requests)
+			{
+				size_t i = next + (size_t) count;
+				IPv4Addr coa(0x7F010000u | (uint32_t) (fa & 0xFFFF));
+				batch.vectors[count].iov_len = encodeRegistrationRequest(batch.buffers[count], REGISTRATION_MESSAGE_MAX, 0, 1800,
+					IPv4Addr(0x0A000000u | (uint32_t) (i & 0xFFFFFF)), homeAgent, coa, i);
+				batch.headers[count].msg_hdr.msg_name = NULL;
+				batch.headers[count].msg_hdr.msg_namelen = 0;
+				count++;
+			}
+			if(count == 0) continue;
+			clock::time_point now = clock::now();
+			int sent = sendmmsg(sockets[fa], batch.headers, (unsigned) count, MSG_DONTWAIT);
+			if(sent <= 0) continue;
+			for(int j = 0; j < sent; j++) sentAt[next + (size_t) j] = now;
+			next += (size_t) sent;
+			inFlight[fa] += (size_t) sent;
+			result.sent += (uint64_t) sent;
+		}
+		for(int i = 0; i < REGISTRATION_BATCH; i++)
+		{
+			batch.headers[i].msg_hdr.msg_name = &batch.peers[i];
+			batch.prepareReceive(i);
+		}
+
+		// Collect replies
+		int ready = epoll_wait(epollFd, events.data(), (int) events.size(), 10);
+		clock::time_point now = clock::now();
+		for(int e = 0; e < ready; e++)
+		{
+			size_t fa = events[e].data.u32;
+			int count;
+			while((count = recvmmsg(sockets[fa], batch.headers, REGISTRATION_BATCH, MSG_DONTWAIT, NULL)) > 0)
+			{
+				now = clock::now();
+				for(int j = 0; j < count; j++)
+				{
+					registrationView reply;
+					if(!reply.parse(batch.buffers[j], batch.headers[j].msg_len) || reply.isRequest()) continue;
+					uint64_t id = reply.identification();
+					if(id >= requests) continue;
+					latencies.push_back((uint32_t) chrono::duration_cast<chrono::nanoseconds>(now - sentAt[id]).count());
+					if(reply.code() == REGISTRATION_ACCEPTED) result.accepted++;
+					else result.rejected++;
+					if(inFlight[fa] > 0) inFlight[fa]--;
+					lastReply = now;
+				}
+				for(int j = 0; j < count; j++) batch.prepareReceive(j);
+			}
+		}
+
+		// Requests lost on the way stop coming back; give up once replies dry up
+		if(now - lastReply > giveUp) break;
+	}
+	result.seconds = chrono::duration<double>(clock::now() - start).count();
+	result.lost = result.sent - result.accepted - result.rejected + (requests - result.sent);
+
+	if(!latencies.empty())
+	{
+		size_t median = latencies.size() / 2;
+		nth_element(latencies.begin(), latencies.begin() + median, latencies.end());
+		result.medianUs = latencies[median] / 1000.0;
+		size_t p99 = latencies.size() * 99 / 100;
+		nth_element(latencies.begin(), latencies.begin() + p99, latencies.end());
+		result.p99Us = latencies[p99] / 1000.0;
+	}
+
+	for(size_t i = 0; i < sockets.size(); i++) close(sockets[i]);
+	close(epollFd);
+	return true;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,319 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Binary snapshots of the simulator state. A snapshot file is a header followed by a sequence
+of blocks. Each block is one raw array of fixed-size records, such as a hash table's slot
+array or a timer pool, and starts with its byte count and record size. Blocks are padded to
+8 bytes.
+
+Writing gathers every block with writev, so the file is produced in one sequential pass and
+no table is copied. Restoring maps the file with mmap and copies each block straight into
+its table. Hash tables come back slot for slot, with no rehashing and no per-record parsing.
+
+Classes with state to save provide save(writer) and load(reader), which must list their
+blocks in the same order. The format is versioned. A snapshot is only read back by a build
+with the same version and record sizes, on a machine with the same byte order; any other
+file is rejected.
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+// Bump whenever a saved class changes its blocks or record layout
+const uint32_t SNAPSHOT_VERSION = 9;
+
+// Start of every snapshot file
+struct snapshotHeader
+{
+	char magic[8];       // "MIPSNAP\0"
+	uint32_t version;    // SNAPSHOT_VERSION of the writer
+	uint32_t byteOrder;  // 0x01020304 as written by the writer
+	uint64_t blocks;     // Blocks that follow
+	uint64_t bytes;      // Bytes that follow the header
+};
+
+// Start of every block
+struct snapshotBlock
+{
+	uint64_t bytes;       // Record bytes in the block (without padding)
+	uint32_t recordSize;  // sizeof one record
+	uint32_t reserved;    // Always 0
+};
+
+class snapshotWriter
+{
+	public:
+		// Member Functions
+		// Adds the elements of a vector as one block. They are not copied, so the vector
+		// must not change until write() returns.
+		template <class T>
+		void array(const vector<T> &records)
+		{
+			static_assert(is_trivially_copyable<T>::value, "snapshot records must be trivially copyable");
+			add(records.data(), records.size() * sizeof(T), sizeof(T));
+		}
+
+		// Adds one value as a block (the value is copied)
+		template <class T>
+		void value(const T &record)
+		{
+			static_assert(is_trivially_copyable<T>::value, "snapshot records must be trivially copyable");
+			copies.push_back(string((const char*) &record, sizeof(T)));
+			add(copies.back().data(), sizeof(T), sizeof(T));
+		}
+
+		// Writes the header and every block to fileName in one pass
+		bool write(const char* fileName, string &error)
+		{
+			static const char padding[8] = { 0 };
+			snapshotHeader header;
+			memcpy(header.magic, "MIPSNAP", 8);
+			header.version = SNAPSHOT_VERSION;
+			header.byteOrder = 0x01020304;
+			header.blocks = blocks.size();
+			header.bytes = 0;
+
+			vector<iovec> pieces;
+			pieces.reserve(1 + 3 * blocks.size());
+			pieces.push_back(piece(&header, sizeof(header)));
+			for(size_t i = 0; i < blocks.size(); i++)
+			{
+				size_t pad = (8 - blocks[i].bytes % 8) % 8;
+				pieces.push_back(piece(&blocks[i], sizeof(snapshotBlock)));
+				if(blocks[i].bytes > 0) pieces.push_back(piece(data[i], (size_t) blocks[i].bytes));
+				if(pad > 0) pieces.push_back(piece(padding, pad));
+				header.bytes += sizeof(snapshotBlock) + blocks[i].bytes + pad;
+			}
+
+			int fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if(fd < 0)
+			{
+				error = string("Could not create snapshot ") + fileName + ": " + strerror(errno);
+				return false;
+			}
+			bool written = writeAll(fd, pieces);
+			if(!written) error = string("Could not write snapshot ") + fileName + ": " + strerror(errno);
+			if(::close(fd) != 0 && written)
+			{
+				error = string("Could not write snapshot ") + fileName + ": " + strerror(errno);
+				written = false;
+			}
+			if(!written) ::unlink(fileName);
+			return written;
+		}
+
+	private:
+		// Member Functions
+		void add(const void* records, size_t bytes, size_t recordSize)
+		{
+			snapshotBlock block;
+			block.bytes = bytes;
+			block.recordSize = (uint32_t) recordSize;
+			block.reserved = 0;
+			blocks.push_back(block);
+			data.push_back(records);
+		}
+
+		static iovec piece(const void* base, size_t length)
+		{
+			iovec v;
+			v.iov_base = const_cast<void*>(base);
+			v.iov_len = length;
+			return v;
+		}
+
+		// writev in batches of at most IOV_MAX pieces, resuming after short writes
+		static bool writeAll(int fd, vector<iovec> &pieces)
+		{
+			size_t next = 0;
+			while(next < pieces.size())
+			{
+				int count = (int) (pieces.size() - next < (size_t) IOV_MAX ? pieces.size() - next : (size_t) IOV_MAX);
+				ssize_t sent = ::writev(fd, &pieces[next], count);
+				if(sent < 0)
+				{
+					if(errno == EINTR) continue;
+					return false;
+				}
+				size_t left = (size_t) sent;
+				while(next < pieces.size() && left >= pieces[next].iov_len) left -= pieces[next++].iov_len;
+				if(left > 0)
+				{
+					pieces[next].iov_base = (char*) pieces[next].iov_base + left;
+					pieces[next].iov_len -= left;
+				}
+			}
+			return true;
+		}
+
+		// Data Members
+		vector<snapshotBlock> blocks;  // Block headers in file order
+		vector<const void*> data;      // Records of each block
+		deque<string> copies;          // Values added with value()
+};
+
+class snapshotReader
+{
+	public:
+		// Constructor
+		snapshotReader() : base(NULL), size(0), position(0), blockBytes(0) {}
+		~snapshotReader() { if(base != NULL) ::munmap(base, size); }
+
+		// Member Functions
+		// Maps fileName and checks its header. Returns false with error set if the file cannot
+		// be read or is not a snapshot of this version.
+		bool open(const char* fileName, string &error)
+		{
+			name = fileName;
+			int fd = ::open(fileName, O_RDONLY);
+			if(fd < 0)
+			{
+				error = string("Could not open snapshot ") + fileName + ": " + strerror(errno);
+				return false;
+			}
+			struct stat info;
+			if(::fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(snapshotHeader))
+			{
+				::close(fd);
+				error = name + " is not a snapshot";
+				return false;
+			}
+			size = (size_t) info.st_size;
+			void* mapped = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if(mapped == MAP_FAILED)
+			{
+				error = string("Could not map snapshot ") + fileName + ": " + strerror(errno);
+				return false;
+			}
+			base = (char*) mapped;
+			::madvise(base, size, MADV_SEQUENTIAL);
+
+			snapshotHeader header;
+			memcpy(&header, base, sizeof(header));
+			if(memcmp(header.magic, "MIPSNAP", 8) != 0)
+			{
+				error = name + " is not a snapshot";
+				return false;
+			}
+			if(header.byteOrder != 0x01020304)
+			{
+				error = name + " was written on a machine with another byte order";
+				return false;
+			}
+			if(header.version != SNAPSHOT_VERSION)
+			{
+				error = name + " is a version " + to_string(header.version) + " snapshot, this simulator reads version " + to_string(SNAPSHOT_VERSION);
+				return false;
+			}
+			if(header.bytes != size - sizeof(header))
+			{
+				error = name + " is truncated";
+				return false;
+			}
+			position = sizeof(header);
+			return true;
+		}
+
+		// Replaces the contents of a vector with the next block
+		template <class T>
+		bool array(vector<T> &records)
+		{
+			static_assert(is_trivially_copyable<T>::value, "snapshot records must be trivially copyable");
+			const char* block = next(sizeof(T));
+			if(block == NULL) return false;
+			const T* first = (const T*) block;
+			records.assign(first, first + blockBytes / sizeof(T));
+			return true;
+		}
+
+		// Reads the next block into one value
+		template <class T>
+		bool value(T &record)
+		{
+			static_assert(is_trivially_copyable<T>::value, "snapshot records must be trivially copyable");
+			const char* block = next(sizeof(T));
+			if(block == NULL) return false;
+			if(blockBytes != sizeof(T)) return fail("block does not hold one value");
+			memcpy((void*) &record, block, sizeof(T));
+			return true;
+		}
+
+		// Marks the snapshot as unusable (a loader found inconsistent data) and returns false
+		bool fail(const string &reason)
+		{
+			if(problem == "") problem = name + ": " + reason + " (block at byte " + to_string(position) + ")";
+			return false;
+		}
+
+		// Why the last read failed
+		const string& error() const { return problem; }
+
+		// Bytes mapped
+		size_t bytes() const { return size; }
+
+	private:
+		// Member Functions
+		// Returns the records of the next block and moves past it, or NULL if it is missing or
+		// holds a different record type
+		const char* next(size_t recordSize)
+		{
+			if(problem != "") return NULL;
+			snapshotBlock block;
+			if(size - position < sizeof(block))
+			{
+				fail("snapshot ends early");
+				return NULL;
+			}
+			memcpy(&block, base + position, sizeof(block));
+			if(block.recordSize != recordSize || block.bytes % recordSize != 0)
+			{
+				fail("record size " + to_string(block.recordSize) + " where " + to_string(recordSize) + " was expected");
+				return NULL;
+			}
+			size_t padded = (size_t) block.bytes + (8 - block.bytes % 8) % 8;
+			if(size - position - sizeof(block) < padded)
+			{
+				fail("snapshot ends early");
+				return NULL;
+			}
+			const char* records = base + position + sizeof(block);
+			position += sizeof(block) + padded;
+			blockBytes = (size_t) block.bytes;
+			return records;
+		}
+
+		// Data Members
+		char* base;          // Mapped file
+		size_t size;         // Bytes mapped
+		size_t position;     // Offset of the next block
+		size_t blockBytes;   // Record bytes of the last block returned by next()
+		string name;         // File name for error messages
+		string problem;      // First error found
+};
+
+#endif
+
+#endif
@@ -0,0 +1,270 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Hierarchical timing wheel used to expire registration lifetimes. Time is counted in ticks
+(the simulator uses one tick per second). There are four levels of 256 slots; level 0 holds
+timers due within the current 256 ticks, level 1 timers due within the current 65536 ticks
+and so on. When the clock crosses a level boundary the matching slot of the level above is
+cascaded down, so scheduling, cancelling and expiring a timer are all O(1) amortized and no
+sorted sweep over live registrations is ever needed.
+
+Timers live in a node pool linked by index, so the wheel does not allocate per timer once the
+pool has grown to the number of live timers. A timer is identified by a 64-bit id (pool index
+plus generation) so a stale id can be cancelled safely after its timer has fired. Id 0 is
+never returned and means "no timer".
+*/
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+typedef uint64_t timerId;
+
+// Information handed back when a timer fires
+struct timerEvent
+{
+	timerEvent() : type(0), key(0) {}
+	timerEvent(int t, uint64_t k) : type(t), key(k) {}
+
+	int type;        // What expired (meaning defined by the caller)
+	uint64_t key;    // What the timer belongs to (e.g. agent and home address)
+};
+
+class timerWheel
+{
+	public:
+		// Constructor
+		timerWheel() : current(0), live(0), freeList(NIL)
+		{
+			for(int i = 0; i < levels * slotsPerLevel; i++) heads[i] = NIL;
+			for(int i = 0; i < levels; i++) levelCount[i] = 0;
+		}
+
+		// Member Functions
+		uint64_t now() const { return current; }
+		size_t size() const { return live; }
+
+		void reserve(size_t timers) { nodes.reserve(timers); }
+
+		// Schedules a timer that fires when the clock reaches deadline. Deadlines in the
+		// past fire on the next tick.
+		timerId schedule(uint64_t deadline, const timerEvent &event)
+		{
+			uint32_t index = allocateNode();
+			timerNode &node = nodes[index];
+			if(deadline <= current) deadline = current + 1;
+			if(deadline - current > maxDelay) deadline = current + maxDelay;
+			node.deadline = deadline;
+			node.event = event;
+			link(index);
+			live++;
+			return makeId(index, node.generation);
+		}
+
+		// Cancels a pending timer. Returns false if the timer already fired or was cancelled.
+		bool cancel(timerId id)
+		{
+			uint32_t index;
+			if(!lookup(id, index)) return false;
+			unlink(index);
+			releaseNode(index);
+			live--;
+			return true;
+		}
+
+		bool pending(timerId id) const
+		{
+			uint32_t index;
+			return lookup(id, index);
+		}
+
+		// Ticks left before a pending timer fires (0 if it is not pending)
+		uint64_t remaining(timerId id) const
+		{
+			uint32_t index;
+			if(!lookup(id, index)) return 0;
+			return nodes[index].deadline - current;
+		}
+
+		// Advances the clock to time, calling handler(id, event) for every timer that comes
+		// due along the way. The handler may schedule or cancel timers.
+		template <class Handler>
+		void advance(uint64_t time, Handler handler)
+		{
+			while(current < time)
+			{
+				// Nothing due in level 0: jump to the last tick before the next cascade
+				if(levelCount[0] == 0)
+				{
+					uint64_t skip = current | (slotsPerLevel - 1);
+					if(skip >= time)
+					{
+						current = time;
+						break;
+					}
+					current = skip;
+				}
+				current++;
+
+				// Cascade higher levels whose slot boundary was just crossed
+				for(int level = 1; level < levels; level++)
+				{
+					if((current & ((1ull << (bitsPerLevel * level)) - 1)) != 0) break;
+					cascade(level, (int) ((current >> (bitsPerLevel * level)) & (slotsPerLevel - 1)));
+				}
+
+				// Fire every timer in the current level 0 slot
+				uint32_t &head = heads[current & (slotsPerLevel - 1)];
+				while(head != NIL)
+				{
+					uint32_t index = head;
+					timerId id = makeId(index, nodes[index].generation);
+					timerEvent event = nodes[index].event;
+					unlink(index);
+					releaseNode(index);
+					live--;
+					handler(id, event);
+				}
+			}
+		}
+
+		// Snapshot support: the timer pool and every slot list are saved and restored as
+		// blocks, so timer ids held elsewhere stay valid
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.array(nodes);
+			out.value(heads);
+			out.value(levelCount);
+			out.value(current);
+			out.value(live);
+			out.value(freeList);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.array(nodes) || !in.value(heads) || !in.value(levelCount) || !in.value(current) || !in.value(live) || !in.value(freeList))
+				return false;
+			if(live > nodes.size() || (freeList != NIL && freeList >= nodes.size())) return in.fail("timer wheel is inconsistent");
+			return true;
+		}
+
+	private:
+		// Wheel geometry
+		static const int bitsPerLevel = 8;
+		static const int slotsPerLevel = 1 << bitsPerLevel;
+		static const int levels = 4;
+		static const uint64_t maxDelay = (1ull << (bitsPerLevel * levels)) - 1;
+		static const uint32_t NIL = 0xFFFFFFFF;
+
+		// Timer pool node
+		struct timerNode
+		{
+			uint64_t deadline;    // Tick the timer fires on
+			timerEvent event;     // Returned to the handler
+			uint32_t prev;        // Previous node in slot (or free list)
+			uint32_t next;        // Next node in slot (or free list)
+			uint32_t generation;  // Bumped each time the node is released
+			uint16_t slot;        // level * slotsPerLevel + slot index
+			bool active;          // Node holds a pending timer
+		};
+
+		// Member Functions
+		static timerId makeId(uint32_t index, uint32_t generation)
+		{
+			return ((uint64_t) generation << 32) | (uint64_t) (index + 1);
+		}
+
+		bool lookup(timerId id, uint32_t &index) const
+		{
+			if(id == 0) return false;
+			index = (uint32_t) (id & 0xFFFFFFFF) - 1;
+			return index < nodes.size() && nodes[index].active && nodes[index].generation == (uint32_t) (id >> 32);
+		}
+
+		uint32_t allocateNode()
+		{
+			uint32_t index;
+			if(freeList != NIL)
+			{
+				index = freeList;
+				freeList = nodes[index].next;
+			}
+			else
+			{
+				index = (uint32_t) nodes.size();
+				timerNode node;
+				node.generation = 0;
+				nodes.push_back(node);
+			}
+			nodes[index].active = true;
+			return index;
+		}
+
+		void releaseNode(uint32_t index)
+		{
+			nodes[index].active = false;
+			nodes[index].generation++;
+			nodes[index].next = freeList;
+			freeList = index;
+		}
+
+		// Places a node in the slot matching its deadline relative to the current tick
+		void link(uint32_t index)
+		{
+			timerNode &node = nodes[index];
+			int level = 0;
+			while(level < levels - 1 && (node.deadline >> (bitsPerLevel * (level + 1))) != (current >> (bitsPerLevel * (level + 1))))
+				level++;
+			int slot = level * slotsPerLevel + (int) ((node.deadline >> (bitsPerLevel * level)) & (slotsPerLevel - 1));
+
+			node.slot = (uint16_t) slot;
+			node.prev = NIL;
+			node.next = heads[slot];
+			if(heads[slot] != NIL) nodes[heads[slot]].prev = index;
+			heads[slot] = index;
+			levelCount[level]++;
+		}
+
+		void unlink(uint32_t index)
+		{
+			timerNode &node = nodes[index];
+			if(node.prev != NIL) nodes[node.prev].next = node.next;
+			else heads[node.slot] = node.next;
+			if(node.next != NIL) nodes[node.next].prev = node.prev;
+			levelCount[node.slot / slotsPerLevel]--;
+		}
+
+		// Moves every timer of a higher-level slot down to the level matching its deadline
+		void cascade(int level, int slot)
+		{
+			uint32_t index = heads[level * slotsPerLevel + slot];
+			heads[level * slotsPerLevel + slot] = NIL;
+			while(index != NIL)
+			{
+				uint32_t next = nodes[index].next;
+				levelCount[level]--;
+				link(index);
+				index = next;
+			}
+		}
+
+		// Data Members
+		vector<timerNode> nodes;                    // Timer pool
+		uint32_t heads[levels * slotsPerLevel];     // First node of every slot
+		size_t levelCount[levels];                  // Timers held at each level
+		uint64_t current;                           // Current tick
+		size_t live;                                // Pending timers
+		uint32_t freeList;                          // First released node
+};
+
+#endif
@@ -0,0 +1,305 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Visitor List used by the foreign agent. Visitor entries are stored densely in one array,
+with two open-addressing indexes into it: one on the mobile node's home address, used when
+a decapsulated datagram arrives, and one on its MAC address, used for link-layer delivery.
+An index slot holds only a 4-byte row number, and the key is compared through the entry.
+Re-registrations update the existing entry in place. Removal moves the last entry into the
+hole, so it takes constant time and the array never has gaps. An entry is 32 bytes with no
+heap allocation of its own. A foreign agent with only a few visitors searches the array
+directly and builds no indexes at all.
+*/
+#ifndef VISITOR_TABLE_H
+#define VISITOR_TABLE_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+#include "timerWheel.h"
+
+using namespace std;
+
+// Visitor List entries
+class visitorEntry
+{
+	public:
+		// Constructors
+		visitorEntry() : lifetime(0), timer(0) {}
+		visitorEntry(IPv4Addr home, IPv4Addr HA, MacAddr MAC, int time)
+			: mediaAddress(MAC), homeAddress(home), HAAddress(HA), lifetime(time), timer(0) {}
+
+		// Members
+		MacAddr mediaAddress;  // MAC address
+		IPv4Addr homeAddress;  // Home address of a mobility node
+		IPv4Addr HAAddress;    // Home agent address
+		int lifetime;          // Lifetime of the entry in seconds
+		timerId timer;         // Lifetime expiry timer (0 if none)
+};
+
+static_assert(sizeof(visitorEntry) == 32, "visitorEntry must stay 32 bytes");
+
+class visitorTable
+{
+	public:
+		// Lists this short are searched directly; the address indexes are built once a list
+		// grows past it
+		static const size_t scanLimit = 8;
+
+		// Constructor
+		visitorTable() : mask(0) {}
+
+		// Member Functions
+		size_t size() const { return entries.size(); }
+		bool empty() const { return entries.empty(); }
+
+		// Bytes held by the entries and both indexes
+		size_t memoryUsage() const
+		{
+			return entries.capacity() * sizeof(visitorEntry) + (homeSlots.capacity() + macSlots.capacity()) * sizeof(uint32_t);
+		}
+
+		// Adds a visitor or updates the existing entry in place and returns it. The pointer is
+		// valid until the next insert or erase.
+		visitorEntry* insert(IPv4Addr home, IPv4Addr HA, MacAddr MAC, int time)
+		{
+			uint32_t row = rowOf(home);
+			if(row != NONE)
+			{
+				visitorEntry &entry = entries[row];
+				if(entry.mediaAddress != MAC && indexed())
+				{
+					unlink(BY_MAC, row);
+					entry.mediaAddress = MAC;
+					link(BY_MAC, row);
+				}
+				entry.HAAddress = HA;
+				entry.mediaAddress = MAC;
+				entry.lifetime = time;
+				return &entry;
+			}
+
+			// Grow by half rather than doubling to keep the spare capacity small
+			if(entries.size() == entries.capacity()) entries.reserve(entries.size() + entries.size() / 2 + 4);
+			row = (uint32_t) entries.size();
+			entries.push_back(visitorEntry(home, HA, MAC, time));
+			if(entries.size() > scanLimit)
+			{
+				if(entries.size() * 10 > homeSlots.size() * 7) rebuild();
+				else
+				{
+					link(BY_HOME, row);
+					link(BY_MAC, row);
+				}
+			}
+			return &entries.back();
+		}
+
+		// Returns the visitor with this home address, or NULL
+		visitorEntry* find(IPv4Addr home)
+		{
+			uint32_t row = rowOf(home);
+			return row == NONE ? NULL : &entries[row];
+		}
+
+		const visitorEntry* find(IPv4Addr home) const
+		{
+			return const_cast<visitorTable*>(this)->find(home);
+		}
+
+		// Returns the visitor with this MAC address, or NULL
+		const visitorEntry* findByMAC(MacAddr MAC) const
+		{
+			if(!MAC.isSet()) return NULL;
+			uint32_t row = NONE;
+			if(indexed()) row = lookup(BY_MAC, MAC.toUint());
+			else
+			{
+				for(size_t i = 0; i < entries.size() && row == NONE; i++)
+					if(entries[i].mediaAddress == MAC) row = (uint32_t) i;
+			}
+			return row == NONE ? NULL : &entries[row];
+		}
+
+		// Removes the visitor with this home address. Returns false if it was not listed.
+		bool erase(IPv4Addr home)
+		{
+			uint32_t row = rowOf(home);
+			if(row == NONE) return false;
+
+			// Fill the hole with the last entry and repoint its index slots
+			uint32_t last = (uint32_t) entries.size() - 1;
+			if(indexed())
+			{
+				unlink(BY_HOME, row);
+				unlink(BY_MAC, row);
+				if(row != last)
+				{
+					relink(BY_HOME, last, row);
+					relink(BY_MAC, last, row);
+				}
+			}
+			entries[row] = entries[last];
+			entries.pop_back();
+			return true;
+		}
+
+		void clear()
+		{
+			entries.clear();
+			homeSlots.clear();
+			macSlots.clear();
+			mask = 0;
+		}
+
+		// Calls visit(entry) for every visitor in the table
+		template <class Visitor>
+		void forEach(Visitor visit) const
+		{
+			for(size_t i = 0; i < entries.size(); i++) visit(entries[i]);
+		}
+
+		// Snapshot support: the entries and both indexes are saved and restored as blocks
+		template <class Writer>
+		void save(Writer &out) const
+		{
+			out.array(entries);
+			out.array(homeSlots);
+			out.array(macSlots);
+		}
+
+		template <class Reader>
+		bool load(Reader &in)
+		{
+			if(!in.array(entries) || !in.array(homeSlots) || !in.array(macSlots)) return false;
+			size_t slots = homeSlots.size();
+			bool consistent = slots == 0 ? entries.size() <= scanLimit : (slots & (slots - 1)) == 0 && entries.size() * 10 <= slots * 7;
+			if(macSlots.size() != slots || !consistent) return in.fail("visitor list is inconsistent");
+			mask = slots == 0 ? 0 : slots - 1;
+			return true;
+		}
+
+	private:
+		// Row returned when an address is not listed
+		static const uint32_t NONE = 0xFFFFFFFF;
+
+		// Which address an index is on
+		enum indexKey { BY_HOME, BY_MAC };
+
+		// Member Functions
+		bool indexed() const { return !homeSlots.empty(); }
+
+		uint64_t keyOf(indexKey by, uint32_t row) const
+		{
+			return by == BY_HOME ? entries[row].homeAddress.toUint() : entries[row].mediaAddress.toUint();
+		}
+
+		// Index slots hold row + 1 (0 marks an empty slot). The key is read back from the
+		// entry, so a slot is only 4 bytes.
+		vector<uint32_t>& slotsOf(indexKey by) { return by == BY_HOME ? homeSlots : macSlots; }
+		const vector<uint32_t>& slotsOf(indexKey by) const { return by == BY_HOME ? homeSlots : macSlots; }
+
+		uint32_t rowOf(IPv4Addr home) const
+		{
+			if(indexed()) return lookup(BY_HOME, home.toUint());
+			for(size_t i = 0; i < entries.size(); i++)
+				if(entries[i].homeAddress == home) return (uint32_t) i;
+			return NONE;
+		}
+
+		uint32_t lookup(indexKey by, uint64_t key) const
+		{
+			const vector<uint32_t> &slots = slotsOf(by);
+			size_t i = hashAddress(key) & mask;
+			while(slots[i] != 0)
+			{
+				if(keyOf(by, slots[i] - 1) == key) return slots[i] - 1;
+				i = (i + 1) & mask;
+			}
+			return NONE;
+		}
+
+		// Points the row's key at the row, replacing any other row with the same key
+		void link(indexKey by, uint32_t row)
+		{
+			uint64_t key = keyOf(by, row);
+			if(key == 0) return;
+			vector<uint32_t> &slots = slotsOf(by);
+			size_t i = hashAddress(key) & mask;
+			while(slots[i] != 0 && keyOf(by, slots[i] - 1) != key) i = (i + 1) & mask;
+			slots[i] = row + 1;
+		}
+
+		// Removes the row's key if it still points at the row (another visitor may have
+		// claimed the same MAC since), backward-shifting the probe run so there are no
+		// tombstones
+		void unlink(indexKey by, uint32_t row)
+		{
+			uint64_t key = keyOf(by, row);
+			if(key == 0) return;
+			vector<uint32_t> &slots = slotsOf(by);
+			size_t hole = hashAddress(key) & mask;
+			while(slots[hole] != 0 && keyOf(by, slots[hole] - 1) != key) hole = (hole + 1) & mask;
+			if(slots[hole] != row + 1) return;
+
+			size_t i = hole;
+			while(true)
+			{
+				i = (i + 1) & mask;
+				if(slots[i] == 0) break;
+				size_t home = hashAddress(keyOf(by, slots[i] - 1)) & mask;
+				if(((i - home) & mask) >= ((i - hole) & mask))
+				{
+					slots[hole] = slots[i];
+					hole = i;
+				}
+			}
+			slots[hole] = 0;
+		}
+
+		// Repoints the slot for row from at row to (from is about to move there)
+		void relink(indexKey by, uint32_t from, uint32_t to)
+		{
+			uint64_t key = keyOf(by, from);
+			if(key == 0) return;
+			vector<uint32_t> &slots = slotsOf(by);
+			size_t i = hashAddress(key) & mask;
+			while(slots[i] != 0)
+			{
+				if(slots[i] == from + 1)
+				{
+					slots[i] = to + 1;
+					return;
+				}
+				i = (i + 1) & mask;
+			}
+		}
+
+		// Sizes both indexes for the current entries (at most 70% full) and fills them
+		void rebuild()
+		{
+			size_t cap = 16;
+			while(cap * 7 < entries.size() * 10) cap *= 2;
+			homeSlots.assign(cap, 0);
+			macSlots.assign(cap, 0);
+			mask = cap - 1;
+			for(uint32_t row = 0; row < entries.size(); row++)
+			{
+				link(BY_HOME, row);
+				link(BY_MAC, row);
+			}
+		}
+
+		// Data Members
+		vector<visitorEntry> entries;  // Visitor entries, densely packed
+		vector<uint32_t> homeSlots;    // Home address index (built past scanLimit)
+		vector<uint32_t> macSlots;     // MAC address index (built past scanLimit)
+		size_t mask;                   // Index size - 1
+};
+
+#endif
@@ -0,0 +1,441 @@
+/*
+CPE 400
+Project 2
+Topic: Mobile IP
+*/
+
+/*
+Byte-level encoding of the simulator's messages using the Mobile IP wire layouts (RFC 5944):
+
+	Agent advertisement:  ICMP Router Advertisement (type 9) followed by the Mobility Agent
+	                      Advertisement Extension (type 16) with the R/B/H/F/M/G/r/T flags
+	                      and the list of care-of addresses
+	Agent solicitation:   ICMP Router Solicitation (type 10)
+	Registration request: UDP payload to port 434, type 1, 24 bytes with a 64-bit identification
+	Registration reply:   UDP payload from port 434, type 3, 20 bytes with a 64-bit identification
+	Datagram:             IPv4 header + UDP header + 32-bit sequence number
+
+Encoders write into a buffer supplied by the caller and return the number of bytes written,
+or 0 if the buffer is too small. Decoding is done with views: a view checks the message in
+place (length, type and checksum) and then reads each field straight out of the buffer when
+it is asked for. Nothing is copied and nothing is allocated. All fields are in network byte
+order.
+*/
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+
+using namespace std;
+
+// Protocol numbers, ports and message types
+const uint8_t IP_PROTOCOL_ICMP = 1;
+const uint8_t IP_PROTOCOL_IPIP = 4;
+const uint8_t IP_PROTOCOL_UDP = 17;
+const uint16_t REGISTRATION_PORT = 434;           // Mobile IP registration (RFC 5944)
+const uint16_t DATAGRAM_PORT = 5000;              // Correspondent application traffic (simulator's choice)
+const uint8_t ICMP_ADVERTISEMENT_TYPE = 9;
+const uint8_t ICMP_SOLICITATION_TYPE = 10;
+const uint8_t MOBILITY_EXTENSION_TYPE = 16;
+const uint8_t REGISTRATION_REQUEST_TYPE = 1;
+const uint8_t REGISTRATION_REPLY_TYPE = 3;
+
+// Fixed message sizes in bytes
+const size_t IPV4_HEADER_SIZE = 20;
+const size_t UDP_HEADER_SIZE = 8;
+const size_t SOLICITATION_SIZE = 8;
+const size_t ADVERTISEMENT_BASE_SIZE = 24;        // Router advertisement with one address + extension without COAs
+const size_t REGISTRATION_REQUEST_SIZE = 24;
+const size_t REGISTRATION_REPLY_SIZE = 20;
+const size_t DATAGRAM_SIZE = IPV4_HEADER_SIZE + UDP_HEADER_SIZE + 4;
+
+// Mobility Agent Advertisement Extension flags (first flag byte)
+const uint8_t ADVERTISE_REGISTRATION_REQUIRED = 0x80;  // R
+const uint8_t ADVERTISE_BUSY = 0x40;                   // B
+const uint8_t ADVERTISE_HOME_AGENT = 0x20;             // H
+const uint8_t ADVERTISE_FOREIGN_AGENT = 0x10;          // F
+
+// Registration reply codes
+const uint8_t REGISTRATION_ACCEPTED = 0;
+const uint8_t REGISTRATION_UNKNOWN_HOME_AGENT = 136;  // Denied by home agent: unknown home agent address
+
+// Big-endian field access
+inline void wirePut16(uint8_t* p, uint16_t v) { p[0] = (uint8_t) (v >> 8); p[1] = (uint8_t) v; }
+inline void wirePut32(uint8_t* p, uint32_t v) { wirePut16(p, (uint16_t) (v >> 16)); wirePut16(p + 2, (uint16_t) v); }
+inline void wirePut64(uint8_t* p, uint64_t v) { wirePut32(p, (uint32_t) (v >> 32)); wirePut32(p + 4, (uint32_t) v); }
+inline uint16_t wireGet16(const uint8_t* p) { return (uint16_t) ((p[0] << 8) | p[1]); }
+inline uint32_t wireGet32(const uint8_t* p) { return ((uint32_t) wireGet16(p) << 16) | wireGet16(p + 2); }
+inline uint64_t wireGet64(const uint8_t* p) { return ((uint64_t) wireGet32(p) << 32) | wireGet32(p + 4); }
+
+// Internet checksum (RFC 1071): one's-complement sum of 16-bit words. The sum is taken 32
+// bits at a time into a 64-bit accumulator and folded at the end, which gives the same result.
+// Partial sums can be chained across several buffers (of even length) before being finished.
+inline uint32_t checksumAdd(const uint8_t* data, size_t length, uint32_t partial = 0)
+{
+	uint64_t sum = partial;
+	while(length >= 4)
+	{
+		sum += wireGet32(data);
+		data += 4;
+		length -= 4;
+	}
+	if(length >= 2)
+	{
+		sum += wireGet16(data);
+		data += 2;
+		length -= 2;
+	}
+	if(length > 0) sum += (uint32_t) data[0] << 8;
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	return (uint32_t) sum;
+}
+
+inline uint16_t checksumFinish(uint32_t sum)
+{
+	while(sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+	return (uint16_t) ~sum;
+}
+
+inline uint16_t internetChecksum(const uint8_t* data, size_t length) { return checksumFinish(checksumAdd(data, length)); }
+
+/*
+IPv4 header without options. The header checksum is filled in.
+*/
+inline size_t encodeIPv4Header(uint8_t* out, size_t capacity, IPv4Addr source, IPv4Addr destination, uint8_t protocol,
+                               size_t payloadLength, uint16_t identification, uint8_t ttl = 64, uint8_t typeOfService = 0)
+{
+	if(capacity < IPV4_HEADER_SIZE || payloadLength > 0xFFFF - IPV4_HEADER_SIZE) return 0;
+	out[0] = 0x45;                   // Version 4, 5-word header
+	out[1] = typeOfService;
+	wirePut16(out + 2, (uint16_t) (IPV4_HEADER_SIZE + payloadLength));
+	wirePut16(out + 4, identification);
+	wirePut16(out + 6, 0);           // Flags and fragment offset
+	out[8] = ttl;
+	out[9] = protocol;
+	wirePut16(out + 10, 0);
+	wirePut32(out + 12, source.toUint());
+	wirePut32(out + 16, destination.toUint());
+	wirePut16(out + 10, internetChecksum(out, IPV4_HEADER_SIZE));
+	return IPV4_HEADER_SIZE;
+}
+
+class ipv4View
+{
+	public:
+		// Constructor
+		ipv4View() : data(NULL), length(0) {}
+
+		// Member Functions
+		// Checks version, lengths and header checksum. Bytes past the total length are ignored.
+		bool parse(const uint8_t* buffer, size_t size)
+		{
+			if(size < IPV4_HEADER_SIZE || (buffer[0] >> 4) != 4) return false;
+			size_t header = (size_t) (buffer[0] & 0x0F) * 4;
+			size_t total = wireGet16(buffer + 2);
+			if(header < IPV4_HEADER_SIZE || total < header || total > size) return false;
+			if(internetChecksum(buffer, header) != 0) return false;
+			data = buffer;
+			length = total;
+			return true;
+		}
+
+		size_t headerLength() const { return (size_t) (data[0] & 0x0F) * 4; }
+		size_t totalLength() const { return length; }
+		uint16_t identification() const { return wireGet16(data + 4); }
+		uint8_t ttl() const { return data[8]; }
+		uint8_t protocol() const { return data[9]; }
+		IPv4Addr source() const { return IPv4Addr(wireGet32(data + 12)); }
+		IPv4Addr destination() const { return IPv4Addr(wireGet32(data + 16)); }
+		const uint8_t* payload() const { return data + headerLength(); }
+		size_t payloadLength() const { return length - headerLength(); }
+
+	private:
+		// Data Members
+		const uint8_t* data;  // Start of the header
+		size_t length;        // Total length from the header
+};
+
+/*
+UDP header for a payload already written at out + UDP_HEADER_SIZE. The checksum covers the
+IPv4 pseudo-header, so the addresses are needed.
+*/
+inline size_t encodeUdpHeader(uint8_t* out, size_t capacity, IPv4Addr source, IPv4Addr destination,
+                              uint16_t sourcePort, uint16_t destinationPort, size_t payloadLength)
+{
+	if(capacity < UDP_HEADER_SIZE + payloadLength || payloadLength > 0xFFFF - UDP_HEADER_SIZE) return 0;
+	uint16_t length = (uint16_t) (UDP_HEADER_SIZE + payloadLength);
+	wirePut16(out, sourcePort);
+	wirePut16(out + 2, destinationPort);
+	wirePut16(out + 4, length);
+	wirePut16(out + 6, 0);
+
+	uint8_t pseudo[12];
+	wirePut32(pseudo, source.toUint());
+	wirePut32(pseudo + 4, destination.toUint());
+	pseudo[8] = 0;
+	pseudo[9] = IP_PROTOCOL_UDP;
+	wirePut16(pseudo + 10, length);
+	uint16_t checksum = checksumFinish(checksumAdd(out, length, checksumAdd(pseudo, sizeof(pseudo))));
+	wirePut16(out + 6, checksum == 0 ? 0xFFFF : checksum);
+	return UDP_HEADER_SIZE;
+}
+
+class udpView
+{
+	public:
+		// Constructor
+		udpView() : data(NULL), length(0) {}
+
+		// Member Functions
+		// Checks the length and, unless the sender left it zero, the checksum
+		bool parse(const uint8_t* buffer, size_t size, IPv4Addr source, IPv4Addr destination)
+		{
+			if(size < UDP_HEADER_SIZE) return false;
+			size_t total = wireGet16(buffer + 4);
+			if(total < UDP_HEADER_SIZE || total > size) return false;
+			if(wireGet16(buffer + 6) != 0)
+			{
+				uint8_t pseudo[12];
+				wirePut32(pseudo, source.toUint());
+				wirePut32(pseudo + 4, destination.toUint());
+				pseudo[8] = 0;
+				pseudo[9] = IP_PROTOCOL_UDP;
+				wirePut16(pseudo + 10, (uint16_t) total);
+				if(checksumFinish(checksumAdd(buffer, total, checksumAdd(pseudo, sizeof(pseudo)))) != 0) return false;
+			}
+			data = buffer;
+			length = total;
+			return true;
+		}
+
+		uint16_t sourcePort() const { return wireGet16(data); }
+		uint16_t destinationPort() const { return wireGet16(data + 2); }
+		const uint8_t* payload() const { return data + UDP_HEADER_SIZE; }
+		size_t payloadLength() const { return length - UDP_HEADER_SIZE; }
+
+	private:
+		// Data Members
+		const uint8_t* data;  // Start of the header
+		size_t length;        // Length from the header
+};
+
+// Fields of an agent advertisement other than the care-of addresses
+struct advertisementFields
+{
+	advertisementFields() : lifetime(1800), sequence(0), registrationLifetime(0xFFFF), flags(0) {}
+
+	IPv4Addr agent;                 // Address of the advertising agent
+	uint16_t lifetime;              // Seconds the advertisement stays valid
+	uint16_t sequence;              // Advertisement count since the agent started
+	uint16_t registrationLifetime;  // Longest registration the agent accepts (0xFFFF = infinite)
+	uint8_t flags;                  // ADVERTISE_* bits
+};
+
+/*
+Agent advertisement with the agent as its only router address. COAs are taken from the
+range [first, last) so any container of IPv4Addr can be encoded without copying.
+*/
+template <class Iterator>
+size_t encodeAdvertisement(uint8_t* out, size_t capacity, const advertisementFields &fields, Iterator first, Iterator last)
+{
+	size_t coas = 0;
+	for(Iterator i = first; i != last; ++i) coas++;
+	size_t size = ADVERTISEMENT_BASE_SIZE + 4 * coas;
+	if(capacity < size || 6 + 4 * coas > 0xFF) return 0;
+
+	// ICMP Router Advertisement
+	out[0] = ICMP_ADVERTISEMENT_TYPE;
+	out[1] = 0;                                 // Code
+	wirePut16(out + 2, 0);
+	out[4] = 1;                                 // Num addrs
+	out[5] = 2;                                 // Addr entry size (words)
+	wirePut16(out + 6, fields.lifetime);
+	wirePut32(out + 8, fields.agent.toUint());
+	wirePut32(out + 12, 0);                     // Preference level
+
+	// Mobility Agent Advertisement Extension
+	out[16] = MOBILITY_EXTENSION_TYPE;
+	out[17] = (uint8_t) (6 + 4 * coas);
+	wirePut16(out + 18, fields.sequence);
+	wirePut16(out + 20, fields.registrationLifetime);
+	out[22] = fields.flags;
+	out[23] = 0;
+	uint8_t* p = out + ADVERTISEMENT_BASE_SIZE;
+	for(Iterator i = first; i != last; ++i, p += 4) wirePut32(p, (*i).toUint());
+
+	wirePut16(out + 2, internetChecksum(out, size));
+	return size;
+}
+
+inline size_t encodeSolicitation(uint8_t* out, size_t capacity)
+{
+	if(capacity < SOLICITATION_SIZE) return 0;
+	out[0] = ICMP_SOLICITATION_TYPE;
+	out[1] = 0;
+	wirePut16(out + 2, 0);
+	wirePut32(out + 4, 0);                      // Reserved
+	wirePut16(out + 2, internetChecksum(out, SOLICITATION_SIZE));
+	return SOLICITATION_SIZE;
+}
+
+inline bool isSolicitation(const uint8_t* data, size_t length)
+{
+	return length >= SOLICITATION_SIZE && data[0] == ICMP_SOLICITATION_TYPE && internetChecksum(data, length) == 0;
+}
+
+class advertisementView
+{
+	public:
+		// Constructor
+		advertisementView() : data(NULL), extension(NULL) {}
+
+		// Member Functions
+		// Checks the ICMP header and checksum and finds the mobility agent extension
+		bool parse(const uint8_t* buffer, size_t size)
+		{
+			if(size < 8 || buffer[0] != ICMP_ADVERTISEMENT_TYPE || internetChecksum(buffer, size) != 0) return false;
+			if(buffer[4] > 0 && buffer[5] < 2) return false;
+			size_t offset = 8 + (size_t) buffer[4] * buffer[5] * 4;
+
+			// Skip padding and other extensions until the mobility agent extension
+			while(offset < size)
+			{
+				if(buffer[offset] == 0)
+				{
+					offset++;
+					continue;
+				}
+				if(offset + 2 > size || offset + 2 + buffer[offset + 1] > size) return false;
+				if(buffer[offset] == MOBILITY_EXTENSION_TYPE)
+				{
+					if(buffer[offset + 1] < 6 || (buffer[offset + 1] - 6) % 4 != 0) return false;
+					data = buffer;
+					extension = buffer + offset;
+					return true;
+				}
+				offset += 2 + buffer[offset + 1];
+			}
+			return false;
+		}
+
+		uint16_t lifetime() const { return wireGet16(data + 6); }
+		size_t routerCount() const { return data[4]; }
+		IPv4Addr router(size_t i) const { return IPv4Addr(wireGet32(data + 8 + i * data[5] * 4)); }
+		uint16_t sequence() const { return wireGet16(extension + 2); }
+		uint16_t registrationLifetime() const { return wireGet16(extension + 4); }
+		uint8_t flags() const { return extension[6]; }
+		bool registrationRequired() const { return (extension[6] & ADVERTISE_REGISTRATION_REQUIRED) != 0; }
+		bool homeAgent() const { return (extension[6] & ADVERTISE_HOME_AGENT) != 0; }
+		bool foreignAgent() const { return (extension[6] & ADVERTISE_FOREIGN_AGENT) != 0; }
+		size_t coaCount() const { return (size_t) (extension[1] - 6) / 4; }
+		IPv4Addr coa(size_t i) const { return IPv4Addr(wireGet32(extension + 8 + 4 * i)); }
+
+	private:
+		// Data Members
+		const uint8_t* data;       // Start of the ICMP message
+		const uint8_t* extension;  // Start of the mobility agent extension
+};
+
+/*
+Registration request: type, flags (S B D M G r T x), lifetime, home address, home agent,
+care-of address and identification
+*/
+inline size_t encodeRegistrationRequest(uint8_t* out, size_t capacity, uint8_t flags, uint16_t lifetime,
+                                        IPv4Addr home, IPv4Addr homeAgent, IPv4Addr careOf, uint64_t identification)
+{
+	if(capacity < REGISTRATION_REQUEST_SIZE) return 0;
+	out[0] = REGISTRATION_REQUEST_TYPE;
+	out[1] = flags;
+	wirePut16(out + 2, lifetime);
+	wirePut32(out + 4, home.toUint());
+	wirePut32(out + 8, homeAgent.toUint());
+	wirePut32(out + 12, careOf.toUint());
+	wirePut64(out + 16, identification);
+	return REGISTRATION_REQUEST_SIZE;
+}
+
+/*
+Registration reply: type, code, lifetime, home address, home agent and identification
+*/
+inline size_t encodeRegistrationReply(uint8_t* out, size_t capacity, uint8_t code, uint16_t lifetime,
+                                      IPv4Addr home, IPv4Addr homeAgent, uint64_t identification)
+{
+	if(capacity < REGISTRATION_REPLY_SIZE) return 0;
+	out[0] = REGISTRATION_REPLY_TYPE;
+	out[1] = code;
+	wirePut16(out + 2, lifetime);
+	wirePut32(out + 4, home.toUint());
+	wirePut32(out + 8, homeAgent.toUint());
+	wirePut64(out + 12, identification);
+	return REGISTRATION_REPLY_SIZE;
+}
+
+class registrationView
+{
+	public:
+		// Constructor
+		registrationView() : data(NULL) {}
+
+		// Member Functions
+		// Accepts a request or reply that fits in size bytes (extensions are ignored)
+		bool parse(const uint8_t* buffer, size_t size)
+		{
+			if(size < REGISTRATION_REPLY_SIZE) return false;
+			if(buffer[0] == REGISTRATION_REQUEST_TYPE && size < REGISTRATION_REQUEST_SIZE) return false;
+			if(buffer[0] != REGISTRATION_REQUEST_TYPE && buffer[0] != REGISTRATION_REPLY_TYPE) return false;
+			data = buffer;
+			return true;
+		}
+
+		bool isRequest() const { return data[0] == REGISTRATION_REQUEST_TYPE; }
+		uint8_t flags() const { return data[1]; }  // Request flags
+		uint8_t code() const { return data[1]; }   // Reply code
+		uint16_t lifetime() const { return wireGet16(data + 2); }
+		IPv4Addr homeAddress() const { return IPv4Addr(wireGet32(data + 4)); }
+		IPv4Addr homeAgent() const { return IPv4Addr(wireGet32(data + 8)); }
+		IPv4Addr careOfAddress() const { return isRequest() ? IPv4Addr(wireGet32(data + 12)) : IPv4Addr(); }
+		uint64_t identification() const { return wireGet64(data + (isRequest() ? 16 : 12)); }
+
+	private:
+		// Data Members
+		const uint8_t* data;  // Start of the message
+};
+
+/*
+Correspondent datagram: IPv4 and UDP headers carrying the 32-bit sequence number
+*/
+inline size_t encodeDatagram(uint8_t* out, size_t capacity, IPv4Addr source, IPv4Addr destination, uint32_t sequenceNumber)
+{
+	if(capacity < DATAGRAM_SIZE) return 0;
+	uint8_t* udp = out + IPV4_HEADER_SIZE;
+	wirePut32(udp + UDP_HEADER_SIZE, sequenceNumber);
+	encodeUdpHeader(udp, capacity - IPV4_HEADER_SIZE, source, destination, DATAGRAM_PORT, DATAGRAM_PORT, 4);
+	encodeIPv4Header(out, capacity, source, destination, IP_PROTOCOL_UDP, UDP_HEADER_SIZE + 4, (uint16_t) sequenceNumber);
+	return DATAGRAM_SIZE;
+}
+
+class datagramView
+{
+	public:
+		// Member Functions
+		bool parse(const uint8_t* buffer, size_t size)
+		{
+			if(!ip.parse(buffer, size) || ip.protocol() != IP_PROTOCOL_UDP) return false;
+			if(!udp.parse(ip.payload(), ip.payloadLength(), ip.source(), ip.destination())) return false;
+			return udp.destinationPort() == DATAGRAM_PORT && udp.payloadLength() >= 4;
+		}
+
+		IPv4Addr source() const { return ip.source(); }
+		IPv4Addr destination() const { return ip.destination(); }
+		uint32_t sequenceNumber() const { return wireGet32(udp.payload()); }
+
+	private:
+		// Data Members
+		ipv4View ip;  // Outer headers
+		udpView udp;
+};
+
+#endif